@@ -323,6 +323,7 @@ const m_option_t common_opts[] = {
 #else
     {"cache", "MPlayer was compiled without cache2 support.\n", CONF_TYPE_PRINT, CONF_NOCFG, 0, 0, NULL},
 #endif /* CONFIG_STREAM_CACHE */
+    {"file-readahead", &stream_file_readahead, CONF_TYPE_INT, CONF_RANGE, 0, 65536, NULL},
     {"vcd", "-vcd N has been removed, use vcd://N instead.\n", CONF_TYPE_PRINT, CONF_NOCFG ,0,0, NULL},
     {"cuefile", "-cuefile has been removed, use cue://filename:N where N is the track number.\n", CONF_TYPE_PRINT, 0, 0, 0, NULL},
     {"cdrom-device", &cdrom_device, CONF_TYPE_STRING, 0, 0, 0, NULL},
@@ -456,6 +457,10 @@ const m_option_t common_opts[] = {
     { "sub-demuxer", &sub_demuxer_name, CONF_TYPE_STRING, 0, 0, 0, NULL },
     { "extbased", &extension_parsing, CONF_TYPE_FLAG, 0, 0, 1, NULL },
     { "noextbased", &extension_parsing, CONF_TYPE_FLAG, 0, 1, 0, NULL },
+    { "demuxer-thread", &demuxer_thread, CONF_TYPE_FLAG, 0, 0, 1, NULL },
+    { "nodemuxer-thread", &demuxer_thread, CONF_TYPE_FLAG, 0, 1, 0, NULL },
+    { "demuxer-thread-bytes", &demuxer_thread_bytes, CONF_TYPE_INT, CONF_RANGE, 64, 65536, NULL },
+    { "demuxer-thread-secs", &demuxer_thread_secs, CONF_TYPE_FLOAT, CONF_RANGE, 0.1, 60.0, NULL },
 
     {"mf", mfopts_conf, CONF_TYPE_SUBCONFIG, 0,0,0, NULL},
 #ifdef CONFIG_RADIO
@@ -35,6 +35,10 @@
 #include "libvo/vo_fbdev.h"
 #include "libvo/vo_zr.h"
 #include "mp_fifo.h"
+#include "mp_telemetry.h"
+#ifdef XENON
+#include "libxenon_miss/xenon_pthread.h"
+#endif
 
 
 const m_option_t vd_conf[]={
@@ -171,6 +175,11 @@ const m_option_t mplayer_opts[]={
     // wait for v-sync (vesa)
     {"vsync", &vo_vsync, CONF_TYPE_FLAG, 0, 0, 1, NULL},
     {"novsync", &vo_vsync, CONF_TYPE_FLAG, 0, 1, 0, NULL},
+    // frames decoded ahead by a separate thread
+    {"frame-queue", &vo_frame_queue, CONF_TYPE_INT, CONF_RANGE, 0, 8, NULL},
+    // audio decoded and played by a separate thread
+    {"audio-thread", &audio_thread, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+    {"noaudio-thread", &audio_thread, CONF_TYPE_FLAG, 0, 1, 0, NULL},
     {"panscan", &vo_panscan, CONF_TYPE_FLOAT, CONF_RANGE, -1.0, 1.0, NULL},
     {"panscanrange", &vo_panscanrange, CONF_TYPE_FLOAT, CONF_RANGE, -19.0, 99.0, NULL},
 
@@ -264,6 +273,17 @@ const m_option_t mplayer_opts[]={
     {"autoq", &auto_quality, CONF_TYPE_INT, CONF_RANGE, 0, 100, NULL},
 
     {"benchmark", &benchmark, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+    {"demuxer-bench", &demuxer_bench, CONF_TYPE_INT, CONF_RANGE, 0, 1000000, NULL},
+    {"video-stall", &video_stall, CONF_TYPE_INT, CONF_RANGE, 0, 1000000, NULL},
+    {"perf-graph", &telemetry_graph, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+    {"noperf-graph", &telemetry_graph, CONF_TYPE_FLAG, 0, 1, 0, NULL},
+    {"telemetry-csv", &telemetry_csv, CONF_TYPE_STRING, 0, 0, 0, NULL},
+#ifdef XENON
+    // worker placement, compare with -benchmark -lavdopts threads=N
+    {"thread-policy", &xenon_thread_policy, CONF_TYPE_INT, CONF_RANGE, 0, XENON_POLICY_NB - 1, NULL},
+    // plays the file under each policy with 1 to 3 threads, with -benchmark -frames N
+    {"thread-bench", &thread_bench, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+#endif
 
 #ifdef CONFIG_NETWORKING
     {"udp-slave", &udp_slave, CONF_TYPE_FLAG, 0, 0, 1, NULL},
@@ -317,6 +337,8 @@ const m_option_t mplayer_opts[]={
     {"autosync", &autosync, CONF_TYPE_INT, CONF_RANGE, 0, 10000, NULL},
 
     {"softsleep", &softsleep, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+    {"display-sync", &display_sync, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+    {"nodisplay-sync", &display_sync, CONF_TYPE_FLAG, 0, 1, 0, NULL},
 #ifdef HAVE_RTC
     {"nortc", &nortc, CONF_TYPE_FLAG, 0, 0, 1, NULL},
     {"rtc", &nortc, CONF_TYPE_FLAG, 0, 1, 0, NULL},
@@ -18,6 +18,7 @@
 
 #include <stdlib.h>
 #include <inttypes.h>
+#include <math.h>
 #include <unistd.h>
 #include <string.h>
 
@@ -69,6 +70,7 @@
 
 #include "mp_core.h"
 #include "mp_fifo.h"
+#include "mp_telemetry.h"
 #include "libavutil/avstring.h"
 #include "edl.h"
 
@@ -834,6 +836,33 @@ static int mp_property_channels(m_option_t *prop, int action, void *arg,
     return m_property_int_ro(prop, action, arg, mpctx->sh_audio->channels);
 }
 
+/// Audio thread state and refill statistics (RO)
+static int mp_property_audio_feeder(m_option_t *prop, int action, void *arg,
+                                    MPContext *mpctx)
+{
+    static char buf[128];
+    audio_feeder_stats_t stats;
+    if (!mpctx->sh_audio)
+        return M_PROPERTY_UNAVAILABLE;
+    audio_feeder_get_stats(&stats);
+    snprintf(buf, sizeof(buf),
+             "%s thread, %d underruns, refill gap max %.1f ms, ao min %.1f ms",
+             stats.running ? "with" : "without", stats.underruns,
+             stats.max_gap, stats.min_queued);
+    return m_property_string_ro(prop, action, arg, buf);
+}
+
+/// Times the ao ran nearly dry since the start of the file (RO)
+static int mp_property_audio_underruns(m_option_t *prop, int action,
+                                       void *arg, MPContext *mpctx)
+{
+    audio_feeder_stats_t stats;
+    if (!mpctx->sh_audio)
+        return M_PROPERTY_UNAVAILABLE;
+    audio_feeder_get_stats(&stats);
+    return m_property_int_ro(prop, action, arg, stats.underruns);
+}
+
 /// Balance (RW)
 static int mp_property_balance(m_option_t *prop, int action, void *arg,
                               MPContext *mpctx)
@@ -1409,6 +1438,91 @@ static int mp_property_aspect(m_option_t *prop, int action, void *arg,
     return m_property_float_ro(prop, action, arg, mpctx->sh_video->aspect);
 }
 
+/// Decode-ahead queue depth, decode time percentiles and late frames (RO)
+static int mp_property_frame_queue(m_option_t *prop, int action, void *arg,
+                                   MPContext *mpctx)
+{
+    static char buf[160];
+    frame_queue_stats_t stats;
+    if (!mpctx->sh_video)
+        return M_PROPERTY_UNAVAILABLE;
+    frame_queue_get_stats(&stats);
+    snprintf(buf, sizeof(buf),
+             "depth %d/%d, decode p50 %.1f p90 %.1f p99 %.1f max %.1f ms over %d frames, late %d, empty %d",
+             stats.depth, stats.max_depth, stats.decode_p50, stats.decode_p90,
+             stats.decode_p99, stats.decode_max, stats.decoded, stats.late,
+             stats.empty);
+    return m_property_string_ro(prop, action, arg, buf);
+}
+
+/// Frames decoded ahead (RO)
+static int mp_property_frame_queue_depth(m_option_t *prop, int action,
+                                         void *arg, MPContext *mpctx)
+{
+    frame_queue_stats_t stats;
+    if (!mpctx->sh_video)
+        return M_PROPERTY_UNAVAILABLE;
+    frame_queue_get_stats(&stats);
+    return m_property_int_ro(prop, action, arg, stats.depth);
+}
+
+/// Frames flipped late since the start of the file (RO)
+static int mp_property_frame_queue_late(m_option_t *prop, int action,
+                                        void *arg, MPContext *mpctx)
+{
+    frame_queue_stats_t stats;
+    if (!mpctx->sh_video)
+        return M_PROPERTY_UNAVAILABLE;
+    frame_queue_get_stats(&stats);
+    return m_property_int_ro(prop, action, arg, stats.late);
+}
+
+/// Average and max time of each stage, A-V drift and cache over the last frames (RO)
+static int mp_property_telemetry(m_option_t *prop, int action, void *arg,
+                                 MPContext *mpctx)
+{
+    static mp_telemetry_frame_t frames[120];
+    static char buf[320];
+    static const char *const names[TELEMETRY_STAGES] = {
+        "demux", "decode", "filter", "upload", "flip"
+    };
+    unsigned int sum[TELEMETRY_STAGES] = {0}, max[TELEMETRY_STAGES] = {0};
+    float drift = 0;
+    int dropped = 0;
+    int n, i, s, pos;
+
+    if (!mpctx->sh_video)
+        return M_PROPERTY_UNAVAILABLE;
+    n = telemetry_read(frames, sizeof(frames) / sizeof(*frames));
+    if (!n)
+        return M_PROPERTY_UNAVAILABLE;
+    for (i = 0; i < n; i++) {
+        for (s = 0; s < TELEMETRY_STAGES; s++) {
+            sum[s] += frames[i].usecs[s];
+            if (frames[i].usecs[s] > max[s])
+                max[s] = frames[i].usecs[s];
+        }
+        if (fabs(frames[i].av_drift) > fabs(drift))
+            drift = frames[i].av_drift;
+        dropped += frames[i].dropped;
+    }
+    pos = 0;
+    for (s = 0; s < TELEMETRY_STAGES; s++)
+        pos += snprintf(buf + pos, sizeof(buf) - pos, "%s %.1f/%.1f, ", names[s],
+                        sum[s] / 1000.0 / n, max[s] / 1000.0);
+    snprintf(buf + pos, sizeof(buf) - pos,
+             "ms avg/max over %d frames, A-V max %+.3f, cache %d%%, dropped %d",
+             n, drift, frames[n - 1].cache, dropped);
+    return m_property_string_ro(prop, action, arg, buf);
+}
+
+/// Frame timing graph on the OSD (RW)
+static int mp_property_perf_graph(m_option_t *prop, int action, void *arg,
+                                  MPContext *mpctx)
+{
+    return m_property_flag(prop, action, arg, &telemetry_graph);
+}
+
 ///@}
 
 /// \defgroup SubProprties Subtitles properties
@@ -2120,6 +2234,10 @@ static const m_option_t mp_properties[] = {
      0, 0, 0, NULL },
     { "channels", mp_property_channels, CONF_TYPE_INT,
      0, 0, 0, NULL },
+    { "audio_feeder", mp_property_audio_feeder, CONF_TYPE_STRING,
+     0, 0, 0, NULL },
+    { "audio_underruns", mp_property_audio_underruns, CONF_TYPE_INT,
+     0, 0, 0, NULL },
     { "switch_audio", mp_property_audio, CONF_TYPE_INT,
      CONF_RANGE, -2, 65535, NULL },
     { "balance", mp_property_balance, CONF_TYPE_FLOAT,
@@ -2166,6 +2284,16 @@ static const m_option_t mp_properties[] = {
      0, 0, 0, NULL },
     { "aspect", mp_property_aspect, CONF_TYPE_FLOAT,
      0, 0, 0, NULL },
+    { "frame_queue", mp_property_frame_queue, CONF_TYPE_STRING,
+     0, 0, 0, NULL },
+    { "frame_queue_depth", mp_property_frame_queue_depth, CONF_TYPE_INT,
+     0, 0, 0, NULL },
+    { "frame_queue_late", mp_property_frame_queue_late, CONF_TYPE_INT,
+     0, 0, 0, NULL },
+    { "telemetry", mp_property_telemetry, CONF_TYPE_STRING,
+     0, 0, 0, NULL },
+    { "perf_graph", mp_property_perf_graph, CONF_TYPE_FLAG,
+     M_OPT_RANGE, 0, 1, NULL },
     { "switch_video", mp_property_video, CONF_TYPE_INT,
      CONF_RANGE, -2, 65535, NULL },
     { "switch_program", mp_property_program, CONF_TYPE_INT,
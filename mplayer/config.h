@@ -130,7 +130,7 @@ extern char MPLAYER_LIBDIR[100];
 #undef CONFIG_SIGHANDLER
 #define CONFIG_SORTSUB 1
 #define CONFIG_STREAM_CACHE 1
-#undef PTHREAD_CACHE
+#define PTHREAD_CACHE 1
 
 
 /* CPU stuff */
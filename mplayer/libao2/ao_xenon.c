@@ -24,6 +24,7 @@
 #include <malloc.h>
 #include <string.h>
 #include "config.h"
+#include "mp_msg.h"
 #include "libaf/af_format.h"
 #include "audio_out.h"
 #include "audio_out_internal.h"
@@ -41,8 +42,15 @@ static const ao_info_t info = {
 
 #define XENON_BUFFER_SIZE 64*1024
 
+/* the hardware only runs at 48 kHz stereo, xenon_sound_init() takes no rate */
+#define XENON_SAMPLERATE 48000
+#define XENON_CHANNELS 2
+
 LIBAO_EXTERN(xenon)
 
+static int ring_size = XENON_BUFFER_SIZE;
+static int prepause_space = 0;
+
 /*
 // to set/get/query special features/parameters
  */
@@ -61,13 +69,22 @@ static void sound_reset(void) {
 static int init(int rate, int channels, int format, int flags) {
         xenon_sound_init();
 
-        ao_data.buffersize = XENON_BUFFER_SIZE;
+        // the ring is empty right after init, what's free is its real size
+        ring_size = xenon_sound_get_free();
+        if (ring_size <= 0 || ring_size > XENON_BUFFER_SIZE)
+                ring_size = XENON_BUFFER_SIZE;
+
         ao_data.outburst = 2048;
-        ao_data.channels = 2;
-        ao_data.samplerate = 48000;
+        ao_data.buffersize = ring_size - ring_size % ao_data.outburst;
+        ao_data.channels = XENON_CHANNELS;
+        ao_data.samplerate = XENON_SAMPLERATE;
         ao_data.format = AF_FORMAT_S16_LE;
         ao_data.bps = ao_data.channels * ao_data.samplerate * sizeof (signed short);
 
+        if (rate != ao_data.samplerate || channels != ao_data.channels)
+                mp_msg(MSGT_AO, MSGL_V, "[AO XENON] %d Hz %d ch converted to %d Hz %d ch by libaf\n",
+                        rate, channels, ao_data.samplerate, ao_data.channels);
+
         return 1;
 }
 
@@ -89,6 +106,8 @@ static void reset(void) {
 // stop playing, keep buffers (for pause)
  */
 static void audio_pause(void) {
+        // the hardware can't hold its ring, remember how much was queued
+        prepause_space = get_space();
         reset();
 }
 
@@ -97,14 +116,23 @@ static void audio_pause(void) {
  */
 static void audio_resume(void) {
         sound_reset();
+        mp_ao_resume_refill(&audio_out_xenon, prepause_space);
 }
 
 /*
 // return: how many bytes can be played without blocking
  */
 static int get_space(void) {
+        int free = xenon_sound_get_free();
+        // what's queued stays within buffersize, the ring is a bit larger
+        int space = ao_data.buffersize - (ring_size - free);
+
+        if (space > free)
+                space = free;
+        if (space < 0)
+                space = 0;
 
-        return xenon_sound_get_free();
+        return space - space % ao_data.outburst;
 }
 
 /*
@@ -113,9 +141,18 @@ static int get_space(void) {
 // return: number of bytes played
  */
 static int play(void* data, int len, int flags) {
-        if (!(flags & AOPLAY_FINAL_CHUNK))
+        int space = xenon_sound_get_free();
+
+        // never block in xenon_sound_submit()
+        if (len > space)
+                len = space;
+
+        if (!(flags & AOPLAY_FINAL_CHUNK) || len == space)
                 len -= len % ao_data.outburst;
 
+        if (len <= 0)
+                return 0;
+
         xenon_sound_submit(data, len);
 
         return len;
@@ -125,7 +162,11 @@ static int play(void* data, int len, int flags) {
  * return: delay in seconds between first and last sample in buffer
  */
 static float get_delay(void) {
-        //return ((float) (ao_data.buffersize - xenon_sound_get_unplayed())) / ((float) ao_data.bps);
-        return 0.f;
+        int queued = ring_size - xenon_sound_get_free();
+
+        if (queued < 0)
+                queued = 0;
+
+        return (float) queued / (float) ao_data.bps;
 }
 
@@ -50,6 +50,7 @@ extern float movie_aspect;
 extern float screen_size_xy;
 
 extern const m_option_t lavc_decode_opts_conf[];
+extern int lavc_param_threads; // -lavdopts threads, swept by -thread-bench
 extern const m_option_t xvid_dec_opts[];
 
 #define VDCTRL_QUERY_FORMAT 3 /* test for availabilty of a format */
@@ -32,9 +32,14 @@
 #include "libavutil/intreadwrite.h"
 #include "mpbswap.h"
 #include "fmt-conversion.h"
+#include "osdep/timer.h"
 
 #include "vd_internal.h"
 
+#ifdef XENON
+#include "libxenon_miss/xenon_pthread.h"
+#endif
+
 #ifndef AV_EF_COMPLIANT
 #define AV_EF_COMPLIANT 0
 #endif
@@ -67,6 +72,26 @@ LIBVD_EXTERN(ffmpeg)
 #include "libavcodec/xvmc.h"
 #endif
 
+// adaptive skipping (-lavdopts adaptive): decoding gets cheaper one step at a
+// time while it doesn't fit in the frame time and gets back to full quality
+// once the content allows it
+#define SKIP_LEVELS  6
+#define SKIP_WINDOW  24     // frames between two decisions
+#define SKIP_BUDGET  0.80   // share of the frame time decoding may take
+#define SKIP_BACKOFF 0.65   // back off if the level below is predicted under this
+
+static const struct {
+    enum AVDiscard loop_filter;
+    enum AVDiscard frame;
+} skip_levels[SKIP_LEVELS] = {
+    { AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { AVDISCARD_NONREF,  AVDISCARD_DEFAULT },
+    { AVDISCARD_BIDIR,   AVDISCARD_DEFAULT },
+    { AVDISCARD_ALL,     AVDISCARD_DEFAULT },
+    { AVDISCARD_ALL,     AVDISCARD_NONREF  },
+    { AVDISCARD_ALL,     AVDISCARD_BIDIR   },
+};
+
 typedef struct {
     AVCodecContext *avctx;
     AVFrame *pic;
@@ -82,6 +107,14 @@ typedef struct {
     int b_count;
     AVRational last_sample_aspect_ratio;
     int palette_sent;
+    // adaptive skipping
+    int skip_level;
+    float type_cost[3];         // decode usecs per I, P and B frame
+    float type_share[3];
+    int window_frames;
+    int window_drops;           // frames the player asked to drop
+    float left_cost[SKIP_LEVELS];  // predicted cost when the level was left upwards
+    float entry_cost[SKIP_LEVELS]; // first window after entering it
 } vd_ffmpeg_ctx;
 
 #include "m_option.h"
@@ -113,9 +146,11 @@ static char *lavc_param_lowres_str=NULL;
 static char *lavc_param_skip_loop_filter_str = NULL;
 static char *lavc_param_skip_idct_str = NULL;
 static char *lavc_param_skip_frame_str = NULL;
-static int lavc_param_threads=1;
+int lavc_param_threads=1;
 static int lavc_param_bitexact=0;
+static int lavc_param_adaptive=0;
 static char *lavc_avopt = NULL;
+static enum AVDiscard skip_loop_filter;
 static enum AVDiscard skip_idct;
 static enum AVDiscard skip_frame;
 
@@ -145,6 +180,7 @@ const m_option_t lavc_decode_opts_conf[]={
     {"skipframe"     , &lavc_param_skip_frame_str       , CONF_TYPE_STRING  , 0, 0, 0, NULL},
     {"threads"       , &lavc_param_threads              , CONF_TYPE_INT     , CONF_RANGE, 1, 8, NULL},
     {"bitexact"      , &lavc_param_bitexact             , CONF_TYPE_FLAG    , 0, 0, CODEC_FLAG_BITEXACT, NULL},
+    {"adaptive"      , &lavc_param_adaptive             , CONF_TYPE_FLAG    , 0, 0, 1, NULL},
     {"o"             , &lavc_avopt                      , CONF_TYPE_STRING  , 0, 0, 0, NULL},
     {NULL, NULL, 0, 0, 0, 0, NULL}
 };
@@ -328,6 +364,7 @@ static int init(sh_video_t *sh){
         }
     }
 
+    skip_loop_filter = avctx->skip_loop_filter;
     skip_idct = avctx->skip_idct;
     skip_frame = avctx->skip_frame;
 
@@ -405,6 +442,18 @@ static int init(sh_video_t *sh){
         avctx->bits_per_coded_sample= sh->bih->biBitCount;
 
     avctx->thread_count = lavc_param_threads;
+#ifdef XENON
+    // every worker needs a hardware thread of its own, the pool doesn't
+    // queue and libavcodec fails to open if one can't be created
+    if (avctx->thread_count > 1) {
+        int avail = xenon_thread_available(XENON_THREAD_DECODE);
+        if (avctx->thread_count > avail) {
+            avctx->thread_count = FFMAX(avail, 1);
+            mp_msg(MSGT_DECVIDEO, MSGL_V, "[VD_FFMPEG] %d hardware threads free, using %d decoding threads\n",
+                   avail, avctx->thread_count);
+        }
+    }
+#endif
     avctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
     if(lavc_codec->capabilities & CODEC_CAP_HWACCEL)
         // HACK around badly placed checks in mpeg_mc_decode_init
@@ -732,6 +781,117 @@ static av_unused void swap_palette(void *pal)
         p[i] = le2me_32(p[i]);
 }
 
+static int skip_type(int pict_type)
+{
+    switch (pict_type) {
+    case AV_PICTURE_TYPE_I:
+    case AV_PICTURE_TYPE_SI:
+        return 0;
+    case AV_PICTURE_TYPE_B:
+    case AV_PICTURE_TYPE_BI:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+static const char *AVDiscard2str(enum AVDiscard discard)
+{
+    switch (discard) {
+    case AVDISCARD_NONE:    return "none";
+    case AVDISCARD_NONREF:  return "nonref";
+    case AVDISCARD_BIDIR:   return "bidir";
+    case AVDISCARD_NONKEY:  return "nonkey";
+    case AVDISCARD_ALL:     return "all";
+    default:                return "default";
+    }
+}
+
+static void skip_set_level(sh_video_t *sh, vd_ffmpeg_ctx *ctx, int level,
+                           float predicted)
+{
+    ctx->skip_level = level;
+    ctx->entry_cost[level] = 0;
+    // the costs are measured again at this level, the first window then
+    // gives the entry cost instead of the averages of the level left
+    memset(ctx->type_cost, 0, sizeof(ctx->type_cost));
+    mp_msg(MSGT_DECVIDEO, MSGL_V,
+           "[lavc] adaptive skipping level %d: loop filter %s, frames %s "
+           "(decoding %.1f ms per frame of %.1f ms)\n", level,
+           AVDiscard2str(skip_levels[level].loop_filter),
+           AVDiscard2str(skip_levels[level].frame),
+           predicted / 1000, sh->frametime * 1000);
+}
+
+/**
+ * \brief account the decode time of a frame, change the skip level once per
+ *        window if needed
+ *
+ * The cost is kept per frame type and weighted by how often each type shows
+ * up, a run of I frames doesn't escalate by itself. With frame threads a call
+ * submits one packet and returns the frame of a packet submitted thread_count
+ * - 1 calls earlier, its time belongs to neither type: all calls then go into
+ * a single average. Frames the player asked to drop are decoded with more
+ * skipped and don't count in the costs, types not decoded yet at this level
+ * are left out.
+ */
+static void skip_update(sh_video_t *sh, vd_ffmpeg_ctx *ctx, const AVFrame *pic,
+                        int got_picture, unsigned int usecs, int flags)
+{
+    float predicted = 0, share = 0, budget;
+    int level = ctx->skip_level;
+    int i;
+
+    if (sh->frametime <= 0)
+        return;
+    ctx->window_frames++;
+    if (flags & 3)
+        ctx->window_drops++;
+    if (got_picture) {
+        int type = ctx->avctx->active_thread_type & FF_THREAD_FRAME ?
+                   1 : skip_type(pic->pict_type);
+        if (!(flags & 3))
+            ctx->type_cost[type] = ctx->type_cost[type] ?
+                0.9f * ctx->type_cost[type] + 0.1f * usecs : usecs;
+        for (i = 0; i < 3; i++)
+            ctx->type_share[i] = 0.95f * ctx->type_share[i] + (i == type ? 0.05f : 0);
+    }
+    if (ctx->window_frames < SKIP_WINDOW)
+        return;
+
+    for (i = 0; i < 3; i++) {
+        if (!ctx->type_cost[i])
+            continue;
+        predicted += ctx->type_share[i] * ctx->type_cost[i];
+        share     += ctx->type_share[i];
+    }
+    if (share <= 0) {
+        // nothing decoded at this level yet, start a new window
+        ctx->window_frames = 0;
+        ctx->window_drops  = 0;
+        return;
+    }
+    predicted /= share;
+    budget = sh->frametime * 1000000;
+
+    if (!ctx->entry_cost[level])
+        ctx->entry_cost[level] = predicted;
+
+    // the player dropping frames means decoding is not the only thing late
+    if ((predicted > SKIP_BUDGET * budget || ctx->window_drops > 1) &&
+        level < SKIP_LEVELS - 1) {
+        ctx->left_cost[level] = predicted;
+        skip_set_level(sh, ctx, level + 1, predicted);
+    } else if (level > 0 && !ctx->window_drops) {
+        // the cost below as measured, scaled by how the content changed since
+        float below = ctx->left_cost[level - 1] * predicted / ctx->entry_cost[level];
+        if (below < SKIP_BACKOFF * budget)
+            skip_set_level(sh, ctx, level - 1, below);
+    }
+    ctx->window_frames = 0;
+    ctx->window_drops  = 0;
+}
+
 // decode a frame
 static mp_image_t *decode(sh_video_t *sh, void *data, int len, int flags){
     int got_picture=0;
@@ -742,6 +902,7 @@ static mp_image_t *decode(sh_video_t *sh, void *data, int len, int flags){
     mp_image_t *mpi=NULL;
     int dr1= ctx->do_dr1;
     AVPacket pkt;
+    unsigned int t;
 
     if(len<=0) return NULL; // skipped frame
 
@@ -758,9 +919,16 @@ static mp_image_t *decode(sh_video_t *sh, void *data, int len, int flags){
         }
     }
 
+    avctx->skip_loop_filter = skip_loop_filter;
     avctx->skip_idct = skip_idct;
     avctx->skip_frame = skip_frame;
 
+    // never less than asked for with the other options
+    if (lavc_param_adaptive) {
+        avctx->skip_loop_filter = FFMAX(skip_loop_filter, skip_levels[ctx->skip_level].loop_filter);
+        avctx->skip_frame = FFMAX(skip_frame, skip_levels[ctx->skip_level].frame);
+    }
+
     if (flags&3) {
         avctx->skip_frame = AVDISCARD_NONREF;
         if (flags&2)
@@ -794,7 +962,10 @@ static mp_image_t *decode(sh_video_t *sh, void *data, int len, int flags){
         }
         ctx->palette_sent = 1;
     }
+    t = GetTimer();
     ret = avcodec_decode_video2(avctx, pic, &got_picture, &pkt);
+    if (lavc_param_adaptive)
+        skip_update(sh, ctx, pic, got_picture, GetTimer() - t, flags);
     pkt.data = NULL;
     pkt.size = 0;
     av_destruct_packet(&pkt);
@@ -65,13 +65,17 @@ static inline int check_varlen(uint8_t *ptr, uint8_t *endptr, int len) {
     return len&3 ? ptr + (1<<((len&3) - 1)) <= endptr : 1;
 }
 
-static void asf_descrambling(unsigned char **src,unsigned len, struct asf_priv* asf){
+static void asf_descrambling(demux_packet_t *dp, struct asf_priv* asf){
   unsigned char *dst;
-  unsigned char *s2=*src;
+  unsigned char *s2=dp->buffer;
+  unsigned len=dp->len;
   unsigned i=0,x,y;
+  int alloc_size;
   if (len > UINT_MAX - MP_INPUT_BUFFER_PADDING_SIZE)
 	return;
-  dst = malloc(len + MP_INPUT_BUFFER_PADDING_SIZE);
+  dst = demux_packet_alloc_buffer(len, &alloc_size);
+  if (!dst)
+	return;
   while(len>=asf->scrambling_h*asf->scrambling_w*asf->scrambling_b+i){
 //    mp_msg(MSGT_DEMUX,MSGL_DBG4,"descrambling! (w=%d  b=%d)\n",w,asf_scrambling_b);
 	//i+=asf_scrambling_h*asf_scrambling_w;
@@ -83,8 +87,9 @@ static void asf_descrambling(unsigned char **src,unsigned len, struct asf_priv*
 	s2+=asf->scrambling_h*asf->scrambling_w*asf->scrambling_b;
   }
   //if(i<len) fast_memcpy(dst+i,src+i,len-i);
-  free(*src);
-  *src = dst;
+  demux_packet_release_buffer(dp->buffer, dp->alloc_size);
+  dp->buffer = dst;
+  dp->alloc_size = alloc_size;
 }
 
 /*****************************************************************
@@ -155,7 +160,7 @@ static int demux_asf_read_packet(demuxer_t *demux,unsigned char *data,int len,in
         // closed segment, finalize packet:
 		if(ds==demux->audio)
 		  if(asf->scrambling_h>1 && asf->scrambling_w>1 && asf->scrambling_b>0)
-		    asf_descrambling(&ds->asf_packet->buffer,ds->asf_packet->len,asf);
+		    asf_descrambling(ds->asf_packet,asf);
         ds_add_packet(ds,ds->asf_packet);
         ds->asf_packet=NULL;
       } else {
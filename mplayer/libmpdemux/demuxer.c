@@ -54,6 +54,9 @@
 #include "av_helpers.h"
 #endif
 #include "libavutil/avstring.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 // This is quite experimental, in particular it will mess up the pts values
 // in the queue - on the other hand it might fix some issues like generating
@@ -64,6 +67,11 @@
 
 static void clear_parser(sh_common_t *sh);
 
+// background demuxing, see demux_thread_start()
+int demuxer_thread = 0;
+int demuxer_thread_bytes = 8192;    // kB queued over all streams
+float demuxer_thread_secs = 2.0;    // queued per active stream
+
 // Demuxer list
 extern const demuxer_desc_t demuxer_desc_rawaudio;
 extern const demuxer_desc_t demuxer_desc_rawvideo;
@@ -187,6 +195,370 @@ const demuxer_desc_t *const demuxer_list[] = {
     NULL
 };
 
+/*
+ * Packet pool: headers and payload buffers are recycled instead of going
+ * back to malloc for every packet. Payloads are sorted into power of two
+ * size classes (padding included); they stay plain malloc() blocks, so
+ * demuxers that realloc() or free() dp->buffer themselves keep working,
+ * such a buffer simply leaves the pool.
+ */
+#define PKT_POOL_MIN_SHIFT 8
+#define PKT_POOL_MAX_SHIFT 20
+#define PKT_POOL_CLASSES (PKT_POOL_MAX_SHIFT - PKT_POOL_MIN_SHIFT + 1)
+#define PKT_POOL_MAX_BYTES (8 * 1024 * 1024) // payload memory kept for reuse
+#define PKT_POOL_MAX_HEADERS 1024
+
+static struct {
+    demux_packet_t *headers;             // free headers, linked through next
+    int num_headers;
+    void *buffers[PKT_POOL_CLASSES];     // free buffers, linked through their first word
+    int64_t cached_bytes;
+    // statistics
+    int live_headers, max_live_headers;
+    int64_t live_bytes, max_live_bytes;
+    unsigned hits, misses;
+} pkt_pool;
+
+#if HAVE_PTHREADS
+static pthread_mutex_t pkt_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define pkt_pool_lock()   pthread_mutex_lock(&pkt_pool_mutex)
+#define pkt_pool_unlock() pthread_mutex_unlock(&pkt_pool_mutex)
+#else
+#define pkt_pool_lock()
+#define pkt_pool_unlock()
+#endif
+
+demux_packet_t *demux_packet_alloc(void)
+{
+    demux_packet_t *dp;
+    pkt_pool_lock();
+    dp = pkt_pool.headers;
+    if (dp) {
+        pkt_pool.headers = dp->next;
+        pkt_pool.num_headers--;
+    }
+    if (++pkt_pool.live_headers > pkt_pool.max_live_headers)
+        pkt_pool.max_live_headers = pkt_pool.live_headers;
+    pkt_pool_unlock();
+    if (!dp)
+        dp = malloc(sizeof(demux_packet_t));
+    return dp;
+}
+
+void demux_packet_release(demux_packet_t *dp)
+{
+    pkt_pool_lock();
+    pkt_pool.live_headers--;
+    if (pkt_pool.num_headers < PKT_POOL_MAX_HEADERS) {
+        dp->next = pkt_pool.headers;
+        pkt_pool.headers = dp;
+        pkt_pool.num_headers++;
+        dp = NULL;
+    }
+    pkt_pool_unlock();
+    free(dp);
+}
+
+/**
+ * \brief get a buffer for len bytes of payload plus padding
+ * \param alloc_size set to the usable size, 0 if the buffer is not pooled
+ */
+unsigned char *demux_packet_alloc_buffer(int len, int *alloc_size)
+{
+    int need = len + MP_INPUT_BUFFER_PADDING_SIZE;
+    int c = 0;
+    void *buf = NULL;
+    if (len < 0 || need < 0)
+        return NULL;
+    while (c < PKT_POOL_CLASSES && (1 << (c + PKT_POOL_MIN_SHIFT)) < need)
+        c++;
+    if (c == PKT_POOL_CLASSES) {
+        *alloc_size = 0;
+        pkt_pool_lock();
+        pkt_pool.misses++;
+        pkt_pool_unlock();
+        return malloc(need);
+    }
+    *alloc_size = 1 << (c + PKT_POOL_MIN_SHIFT);
+    pkt_pool_lock();
+    buf = pkt_pool.buffers[c];
+    if (buf) {
+        pkt_pool.buffers[c] = *(void **)buf;
+        pkt_pool.cached_bytes -= *alloc_size;
+        pkt_pool.hits++;
+    } else
+        pkt_pool.misses++;
+    pkt_pool.live_bytes += *alloc_size;
+    if (pkt_pool.live_bytes > pkt_pool.max_live_bytes)
+        pkt_pool.max_live_bytes = pkt_pool.live_bytes;
+    pkt_pool_unlock();
+    if (!buf) {
+        buf = malloc(*alloc_size);
+        if (!buf) {
+            pkt_pool_lock();
+            pkt_pool.live_bytes -= *alloc_size;
+            pkt_pool_unlock();
+        }
+    }
+    return buf;
+}
+
+void demux_packet_release_buffer(unsigned char *buf, int alloc_size)
+{
+    int c = 0;
+    if (!buf)
+        return;
+    if (!alloc_size) {
+        free(buf);
+        return;
+    }
+    while ((1 << (c + PKT_POOL_MIN_SHIFT)) < alloc_size)
+        c++;
+    pkt_pool_lock();
+    pkt_pool.live_bytes -= alloc_size;
+    if (pkt_pool.cached_bytes + alloc_size <= PKT_POOL_MAX_BYTES) {
+        *(void **)buf = pkt_pool.buffers[c];
+        pkt_pool.buffers[c] = buf;
+        pkt_pool.cached_bytes += alloc_size;
+        buf = NULL;
+    }
+    pkt_pool_unlock();
+    free(buf);
+}
+
+void demux_packet_pool_stats(void)
+{
+    pkt_pool_lock();
+    mp_msg(MSGT_DEMUXER, MSGL_V, "DEMUXER: packet pool: %u hits, %u misses, "
+           "max %d packets / %"PRId64" bytes in use, %"PRId64" bytes cached\n",
+           pkt_pool.hits, pkt_pool.misses, pkt_pool.max_live_headers,
+           pkt_pool.max_live_bytes, pkt_pool.cached_bytes);
+    pkt_pool_unlock();
+}
+
+#if HAVE_PTHREADS
+/*
+ * Optional demux thread: it calls demux_fill_buffer() ahead of the decoders
+ * until the queues hold demuxer_thread_bytes or demuxer_thread_secs of every
+ * active stream. Only the packet queues are shared, they are protected by the
+ * mutex; anything else that touches the demuxer from the main thread
+ * (seek, control, flush) pauses the thread first.
+ */
+typedef struct demux_thread {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t fill_cond;   // the thread waits here for room or resume
+    pthread_cond_t data_cond;   // readers and pausers wait here
+    int quit;
+    int paused;                 // nesting count of demux_thread_pause()
+    int filling;                // thread is inside demux_fill_buffer()
+    int eof;                    // last demux_fill_buffer() failed
+    int overflow;               // limits hit while the wanted stream is empty
+    demux_stream_t *wanted;     // stream a reader is blocked on
+} demux_thread_t;
+
+static void demux_lock(demuxer_t *demuxer)
+{
+    if (demuxer->thread)
+        pthread_mutex_lock(&((demux_thread_t *)demuxer->thread)->mutex);
+}
+
+static void demux_unlock(demuxer_t *demuxer)
+{
+    if (demuxer->thread)
+        pthread_mutex_unlock(&((demux_thread_t *)demuxer->thread)->mutex);
+}
+
+/// Make sure the thread stays out of the demuxer until demux_thread_resume().
+static void demux_thread_pause(demuxer_t *demuxer)
+{
+    demux_thread_t *dt = demuxer->thread;
+    if (!dt)
+        return;
+    pthread_mutex_lock(&dt->mutex);
+    dt->paused++;
+    while (dt->filling)
+        pthread_cond_wait(&dt->data_cond, &dt->mutex);
+    pthread_mutex_unlock(&dt->mutex);
+}
+
+static void demux_thread_resume(demuxer_t *demuxer)
+{
+    demux_thread_t *dt = demuxer->thread;
+    if (!dt)
+        return;
+    pthread_mutex_lock(&dt->mutex);
+    dt->paused--;
+    pthread_cond_signal(&dt->fill_cond);
+    pthread_mutex_unlock(&dt->mutex);
+}
+
+static double ds_queued_secs(demux_stream_t *ds)
+{
+    if (!ds->first || ds->first->pts == MP_NOPTS_VALUE ||
+        ds->last->pts == MP_NOPTS_VALUE)
+        return 0;
+    return ds->last->pts - ds->first->pts;
+}
+
+/// \return 1 if the thread should not read more for now, called locked
+static int demux_thread_full(demuxer_t *demux, demux_thread_t *dt)
+{
+    demux_stream_t *streams[2] = { demux->video, demux->audio };
+    int limit = demux->audio->packs >= MAX_PACKS || demux->audio->bytes >= MAX_PACK_BYTES ||
+                demux->video->packs >= MAX_PACKS || demux->video->bytes >= MAX_PACK_BYTES;
+    int i, active = 0;
+    if (dt->wanted && !dt->wanted->first) {
+        // somebody is waiting, only the hard limits may stop us
+        if (limit) {
+            dt->overflow = 1;
+            pthread_cond_broadcast(&dt->data_cond);
+        }
+        return limit;
+    }
+    if (limit || demux->audio->bytes + demux->video->bytes >= demuxer_thread_bytes * 1024)
+        return 1;
+    for (i = 0; i < 2; i++) {
+        if (!streams[i]->sh)
+            continue;
+        active = 1;
+        if (ds_queued_secs(streams[i]) < demuxer_thread_secs)
+            return 0;
+    }
+    return active;
+}
+
+/// Pick the stream to ask the demuxer for, matters for non-interleaved files.
+static demux_stream_t *demux_thread_pick(demuxer_t *demux, demux_thread_t *dt)
+{
+    if (dt->wanted)
+        return dt->wanted;
+    if (!demux->video->sh)
+        return demux->audio;
+    if (!demux->audio->sh)
+        return demux->video;
+    return ds_queued_secs(demux->video) <= ds_queued_secs(demux->audio) ?
+           demux->video : demux->audio;
+}
+
+static void *demux_thread_main(void *arg)
+{
+    demuxer_t *demux = arg;
+    demux_thread_t *dt = demux->thread;
+    pthread_mutex_lock(&dt->mutex);
+    while (!dt->quit) {
+        demux_stream_t *ds;
+        int res;
+        if (dt->paused || dt->eof || demux_thread_full(demux, dt)) {
+            pthread_cond_wait(&dt->fill_cond, &dt->mutex);
+            continue;
+        }
+        ds = demux_thread_pick(demux, dt);
+        dt->filling = 1;
+        pthread_mutex_unlock(&dt->mutex);
+        res = demux_fill_buffer(demux, ds);
+        pthread_mutex_lock(&dt->mutex);
+        dt->filling = 0;
+        if (!res)
+            dt->eof = 1;
+        pthread_cond_broadcast(&dt->data_cond);
+    }
+    pthread_mutex_unlock(&dt->mutex);
+    return NULL;
+}
+
+/**
+ * \brief wait until the thread queued a packet for ds or gave up
+ *
+ * If the queue is still empty afterwards the thread is idle (EOF, limits hit
+ * or paused) and the caller continues synchronously, which reports the error
+ * or EOF just like without thread.
+ */
+static void ds_wait_packet(demux_stream_t *ds, demux_thread_t *dt)
+{
+    pthread_mutex_lock(&dt->mutex);
+    while (!ds->first && !dt->paused && !dt->eof && !dt->overflow) {
+        dt->wanted = ds;
+        pthread_cond_signal(&dt->fill_cond);
+        pthread_cond_wait(&dt->data_cond, &dt->mutex);
+    }
+    dt->wanted = NULL;
+    dt->overflow = 0;
+    pthread_mutex_unlock(&dt->mutex);
+}
+
+/**
+ * \brief demux in a separate thread from now on, see -demuxer-thread
+ * \return 1 if the thread was started
+ */
+int demux_thread_start(demuxer_t *demuxer)
+{
+    demux_thread_t *dt;
+    pthread_attr_t attr;
+    int err;
+    if (demuxer->thread)
+        return 1;
+    // sub-demuxers share their streams, dvdnav talks to the main loop
+    if (demuxer->desc->type == DEMUXER_TYPE_DEMUXERS ||
+        demuxer->stream->type == STREAMTYPE_DVDNAV)
+        return 0;
+    dt = calloc(1, sizeof(*dt));
+    if (!dt)
+        return 0;
+    pthread_mutex_init(&dt->mutex, NULL);
+    pthread_cond_init(&dt->fill_cond, NULL);
+    pthread_cond_init(&dt->data_cond, NULL);
+    demuxer->thread = dt;
+    pthread_attr_init(&attr);
+#ifdef XENON
+    pthread_attr_setrole_np(&attr, XENON_THREAD_SERVICE);
+#endif
+    err = pthread_create(&dt->thread, &attr, demux_thread_main, demuxer);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        demuxer->thread = NULL;
+        pthread_cond_destroy(&dt->data_cond);
+        pthread_cond_destroy(&dt->fill_cond);
+        pthread_mutex_destroy(&dt->mutex);
+        free(dt);
+        return 0;
+    }
+    mp_msg(MSGT_DEMUXER, MSGL_V, "DEMUXER: demuxing in a separate thread\n");
+    return 1;
+}
+
+void demux_thread_stop(demuxer_t *demuxer)
+{
+    demux_thread_t *dt = demuxer->thread;
+    if (!dt)
+        return;
+    pthread_mutex_lock(&dt->mutex);
+    dt->quit = 1;
+    pthread_cond_signal(&dt->fill_cond);
+    pthread_mutex_unlock(&dt->mutex);
+    pthread_join(dt->thread, NULL);
+    demuxer->thread = NULL;
+    pthread_cond_destroy(&dt->data_cond);
+    pthread_cond_destroy(&dt->fill_cond);
+    pthread_mutex_destroy(&dt->mutex);
+    free(dt);
+}
+#else
+#define demux_lock(d)
+#define demux_unlock(d)
+#define demux_thread_pause(d)
+#define demux_thread_resume(d)
+
+int demux_thread_start(demuxer_t *demuxer)
+{
+    return 0;
+}
+
+void demux_thread_stop(demuxer_t *demuxer)
+{
+}
+#endif
+
 void free_demuxer_stream(demux_stream_t *ds)
 {
     ds_free_packs(ds);
@@ -401,6 +773,7 @@ void free_demuxer(demuxer_t *demuxer)
     int i;
     mp_msg(MSGT_DEMUXER, MSGL_DBG2, "DEMUXER: freeing %s demuxer at %p\n",
            demuxer->desc->shortdesc, demuxer);
+    demux_thread_stop(demuxer);
     if (demuxer->desc->close)
         demuxer->desc->close(demuxer);
     // Very ugly hack to make it behave like old implementation
@@ -443,12 +816,14 @@ void free_demuxer(demuxer_t *demuxer)
     if (demuxer->teletext)
         teletext_control(demuxer->teletext, TV_VBI_CONTROL_STOP, NULL);
     free(demuxer);
+    demux_packet_pool_stats();
 }
 
 
 static void ds_add_packet_internal(demux_stream_t *ds, demux_packet_t *dp)
 {
     // append packet to DS stream:
+    demux_lock(ds->demuxer);
     ++ds->packs;
     ds->bytes += dp->len;
     if (ds->last) {
@@ -459,6 +834,7 @@ static void ds_add_packet_internal(demux_stream_t *ds, demux_packet_t *dp)
         // first packet in stream
         ds->first = ds->last = dp;
     }
+    demux_unlock(ds->demuxer);
     mp_dbg(MSGT_DEMUXER, MSGL_DBG2,
            "DEMUX: Append packet to %s, len=%d  pts=%5.3f  pos=%u  [packs: A=%d V=%d]\n",
            (ds == ds->demuxer->audio) ? "d_audio" : "d_video", dp->len,
@@ -637,7 +1013,7 @@ int demux_fill_buffer(demuxer_t *demux, demux_stream_t *ds)
 //     0 = EOF
 //     1 = successful
 #define MAX_ACCUMULATED_PACKETS 64
-int ds_fill_buffer(demux_stream_t *ds)
+static int ds_fill_buffer_locked(demux_stream_t *ds)
 {
     demuxer_t *demux = ds->demuxer;
     if (ds->current)
@@ -657,6 +1033,10 @@ int ds_fill_buffer(demux_stream_t *ds)
                    "ds_fill_buffer(unknown 0x%X) called\n", (unsigned int) ds);
     }
     while (1) {
+#if HAVE_PTHREADS
+        if (demux->thread)
+            ds_wait_packet(ds, demux->thread);
+#endif
         if (ds->packs) {
             demux_packet_t *p = ds->first;
             // obviously not yet EOF after all
@@ -687,12 +1067,19 @@ int ds_fill_buffer(demux_stream_t *ds)
                 demux->stream_pts = p->stream_pts;
             ds->flags = p->flags;
             // unlink packet:
+            demux_lock(demux);
             ds->bytes -= p->len;
             ds->current = p;
             ds->first = p->next;
             if (!ds->first)
                 ds->last = NULL;
             --ds->packs;
+#if HAVE_PTHREADS
+            // there is room for the thread again
+            if (demux->thread)
+                pthread_cond_signal(&((demux_thread_t *)demux->thread)->fill_cond);
+#endif
+            demux_unlock(demux);
             return 1;
         }
         // avoid printing the "too many ..." message over and over
@@ -740,6 +1127,18 @@ int ds_fill_buffer(demux_stream_t *ds)
     return 0;
 }
 
+int ds_fill_buffer(demux_stream_t *ds)
+{
+    int ret;
+
+    if (ds->fetch_lock)
+        ds->fetch_lock();
+    ret = ds_fill_buffer_locked(ds);
+    if (ds->fetch_unlock)
+        ds->fetch_unlock();
+    return ret;
+}
+
 int demux_read_data(demux_stream_t *ds, unsigned char *mem, int len)
 {
     int x;
@@ -801,7 +1200,13 @@ int demux_pattern_3(demux_stream_t *ds, unsigned char *mem, int maxlen,
 
 void ds_free_packs(demux_stream_t *ds)
 {
-    demux_packet_t *dp = ds->first;
+    demux_packet_t *dp;
+    demux_lock(ds->demuxer);
+    dp = ds->first;
+    ds->first = ds->last = NULL;
+    ds->packs = 0; // !!!!!
+    ds->bytes = 0;
+    demux_unlock(ds->demuxer);
     while (dp) {
         demux_packet_t *dn = dp->next;
         free_demux_packet(dp);
@@ -809,13 +1214,9 @@ void ds_free_packs(demux_stream_t *ds)
     }
     if (ds->asf_packet) {
         // free unfinished .asf fragments:
-        free(ds->asf_packet->buffer);
-        free(ds->asf_packet);
+        free_demux_packet(ds->asf_packet);
         ds->asf_packet = NULL;
     }
-    ds->first = ds->last = NULL;
-    ds->packs = 0; // !!!!!
-    ds->bytes = 0;
     if (ds->current)
         free_demux_packet(ds->current);
     ds->current = NULL;
@@ -904,6 +1305,10 @@ double ds_get_next_pts(demux_stream_t *ds)
     demuxer_t *demux = ds->demuxer;
     // if we have not read from the "current" packet, consider it
     // as the next, otherwise we never get the pts for the first packet.
+#if HAVE_PTHREADS
+    if (demux->thread && !ds->first && (!ds->current || ds->buffer_pos))
+        ds_wait_packet(ds, demux->thread);
+#endif
     while (!ds->first && (!ds->current || ds->buffer_pos)) {
         if (demux->audio->packs >= MAX_PACKS
             || demux->audio->bytes >= MAX_PACK_BYTES) {
@@ -1310,6 +1715,7 @@ static void demux_resync(demuxer_t *demuxer)
 
 void demux_flush(demuxer_t *demuxer)
 {
+    demux_thread_pause(demuxer);
 #if PARSE_ON_ADD
     ds_clear_parser(demuxer->video);
     ds_clear_parser(demuxer->audio);
@@ -1318,6 +1724,15 @@ void demux_flush(demuxer_t *demuxer)
     ds_free_packs(demuxer->video);
     ds_free_packs(demuxer->audio);
     ds_free_packs(demuxer->sub);
+#if HAVE_PTHREADS
+    if (demuxer->thread) {
+        demux_thread_t *dt = demuxer->thread;
+        demux_lock(demuxer);
+        dt->eof = dt->overflow = 0;
+        demux_unlock(demuxer);
+    }
+#endif
+    demux_thread_resume(demuxer);
 }
 
 int demux_seek(demuxer_t *demuxer, float rel_seek_secs, float audio_delay,
@@ -1338,6 +1753,7 @@ int demux_seek(demuxer_t *demuxer, float rel_seek_secs, float audio_delay,
         return 0;
     }
 
+    demux_thread_pause(demuxer);
     demux_flush(demuxer);
 
     demuxer->stream->eof = 0;
@@ -1364,6 +1780,7 @@ int demux_seek(demuxer_t *demuxer, float rel_seek_secs, float audio_delay,
     if (stream_control(demuxer->stream, STREAM_CTRL_SEEK_TO_TIME, &pts) !=
         STREAM_UNSUPPORTED) {
         demux_resync(demuxer);
+        demux_thread_resume(demuxer);
         return 1;
     }
 
@@ -1372,6 +1789,7 @@ int demux_seek(demuxer_t *demuxer, float rel_seek_secs, float audio_delay,
         demuxer->desc->seek(demuxer, rel_seek_secs, audio_delay, flags);
 
     demux_resync(demuxer);
+    demux_thread_resume(demuxer);
 
     return 1;
 }
@@ -1441,11 +1859,15 @@ char *demux_info_get(demuxer_t *demuxer, const char *opt)
 
 int demux_control(demuxer_t *demuxer, int cmd, void *arg)
 {
+    int res = DEMUXER_CTRL_NOTIMPL;
 
-    if (demuxer->desc->control)
-        return demuxer->desc->control(demuxer, cmd, arg);
+    if (demuxer->desc->control) {
+        demux_thread_pause(demuxer);
+        res = demuxer->desc->control(demuxer, cmd, arg);
+        demux_thread_resume(demuxer);
+    }
 
-    return DEMUXER_CTRL_NOTIMPL;
+    return res;
 }
 
 
@@ -1603,12 +2025,14 @@ int demuxer_seek_chapter(demuxer_t *demuxer, int chapter, int mode,
             chapter += current;
         }
 
+        demux_thread_pause(demuxer);
         demux_flush(demuxer);
 
         ris = stream_control(demuxer->stream, STREAM_CTRL_SEEK_TO_CHAPTER,
                              &chapter);
 
         demux_resync(demuxer);
+        demux_thread_resume(demuxer);
 
         // exit status may be ok, but main() doesn't have to seek itself
         // (because e.g. dvds depend on sectors, not on pts)
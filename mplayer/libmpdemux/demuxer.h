@@ -124,6 +124,7 @@ typedef struct demux_packet {
   double stream_pts;
   off_t pos;  // position in index (AVI) or file (MPG)
   unsigned char* buffer;
+  int alloc_size; // size class of buffer if it came from the packet pool, 0 otherwise
   int flags; // keyframe, etc
   int refcount;   //refcounter for the master packet, if 0, buffer can be free()d
   struct demux_packet* master; //pointer to the master packet if this one is a cloned one
@@ -151,6 +152,10 @@ typedef struct {
   demux_packet_t *current;// needed for refcounting of the buffer
   int id;                 // stream ID  (for multiple audio/video streams)
   struct demuxer *demuxer; // parent demuxer structure (stream handler)
+  // optional, held around the packet fetch of ds_fill_buffer() when the
+  // stream is read by another thread than the other streams
+  void (*fetch_lock)(void);
+  void (*fetch_unlock)(void);
 // ---- asf -----
   demux_packet_t *asf_packet;  // read asf fragments here
   int asf_seq;
@@ -185,6 +190,9 @@ extern char *demuxer_name;
 extern char *audio_demuxer_name;
 extern char *sub_demuxer_name;
 extern char *sub_stream;
+extern int demuxer_thread;
+extern int demuxer_thread_bytes;
+extern float demuxer_thread_secs;
 
 extern int rtsp_port;
 extern int rtsp_transport_http;
@@ -273,6 +281,7 @@ typedef struct demuxer {
 
   void* priv;  // fileformat-dependent data
   char** info;
+  void *thread; // background demuxing state, NULL when demuxing synchronously
 } demuxer_t;
 
 typedef struct {
@@ -280,8 +289,17 @@ typedef struct {
   int aid, vid, sid; //audio, video and subtitle id
 } demux_program_t;
 
+// packet pool, see demuxer.c
+demux_packet_t *demux_packet_alloc(void);
+void demux_packet_release(demux_packet_t *dp);
+unsigned char *demux_packet_alloc_buffer(int len, int *alloc_size);
+void demux_packet_release_buffer(unsigned char *buf, int alloc_size);
+void demux_packet_pool_stats(void);
+
 static inline demux_packet_t* new_demux_packet(int len){
-  demux_packet_t* dp=(demux_packet_t*)malloc(sizeof(demux_packet_t));
+  demux_packet_t* dp=demux_packet_alloc();
+  if (!dp)
+    return NULL;
   dp->len=len;
   dp->next=NULL;
   dp->pts=MP_NOPTS_VALUE;
@@ -292,11 +310,12 @@ static inline demux_packet_t* new_demux_packet(int len){
   dp->refcount=1;
   dp->master=NULL;
   dp->buffer=NULL;
-  if (len > 0 && (dp->buffer = (unsigned char *)malloc(len + MP_INPUT_BUFFER_PADDING_SIZE)))
+  dp->alloc_size=0;
+  if (len > 0 && (dp->buffer = demux_packet_alloc_buffer(len, &dp->alloc_size)))
     memset(dp->buffer + len, 0, MP_INPUT_BUFFER_PADDING_SIZE);
   else if (len) {
     // do not even return a valid packet if allocation failed
-    free(dp);
+    demux_packet_release(dp);
     return NULL;
   }
   return dp;
@@ -304,14 +323,22 @@ static inline demux_packet_t* new_demux_packet(int len){
 
 static inline void resize_demux_packet(demux_packet_t* dp, int len)
 {
-  if(len > 0)
+  if(len <= 0)
   {
-     dp->buffer=(unsigned char *)realloc(dp->buffer,len + MP_INPUT_BUFFER_PADDING_SIZE);
+     demux_packet_release_buffer(dp->buffer, dp->alloc_size);
+     dp->buffer=NULL;
+     dp->alloc_size=0;
   }
-  else
+  else if(len + MP_INPUT_BUFFER_PADDING_SIZE > dp->alloc_size)
   {
-     free(dp->buffer);
-     dp->buffer=NULL;
+     // does not fit into its size class (anymore), move to a bigger one
+     int alloc_size;
+     unsigned char *buf = demux_packet_alloc_buffer(len, &alloc_size);
+     if (buf && dp->buffer)
+        memcpy(buf, dp->buffer, dp->len < len ? dp->len : len);
+     demux_packet_release_buffer(dp->buffer, dp->alloc_size);
+     dp->buffer=buf;
+     dp->alloc_size=alloc_size;
   }
   dp->len=len;
   if (dp->buffer)
@@ -321,7 +348,7 @@ static inline void resize_demux_packet(demux_packet_t* dp, int len)
 }
 
 static inline demux_packet_t* clone_demux_packet(demux_packet_t* pack){
-  demux_packet_t* dp=(demux_packet_t*)malloc(sizeof(demux_packet_t));
+  demux_packet_t* dp=demux_packet_alloc();
   while(pack->master) pack=pack->master; // find the master
   memcpy(dp,pack,sizeof(demux_packet_t));
   dp->next=NULL;
@@ -335,14 +362,14 @@ static inline void free_demux_packet(demux_packet_t* dp){
   if (dp->master==NULL){  //dp is a master packet
     dp->refcount--;
     if (dp->refcount==0){
-      free(dp->buffer);
-      free(dp);
+      demux_packet_release_buffer(dp->buffer, dp->alloc_size);
+      demux_packet_release(dp);
     }
     return;
   }
   // dp is a clone:
   free_demux_packet(dp->master);
-  free(dp);
+  demux_packet_release(dp);
 }
 
 #ifndef SIZE_MAX
@@ -368,6 +395,8 @@ void ds_read_packet(demux_stream_t *ds, stream_t *stream, int len, double pts, o
 
 int demux_fill_buffer(demuxer_t *demux,demux_stream_t *ds);
 int ds_fill_buffer(demux_stream_t *ds);
+int demux_thread_start(demuxer_t *demuxer);
+void demux_thread_stop(demuxer_t *demuxer);
 
 static inline off_t ds_tell(demux_stream_t *ds){
   return (ds->dpos-ds->buffer_size)+ds->buffer_pos;
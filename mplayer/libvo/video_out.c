@@ -62,6 +62,7 @@ int vo_nomouse_input = 0;
 int vo_grabpointer = 1;
 int vo_doublebuffering = 1;
 int vo_vsync = 0;
+int vo_frame_queue = 0;
 int vo_fs = 0;
 int vo_fsmode = 0;
 float vo_panscan = 0.0f;
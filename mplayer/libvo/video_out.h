@@ -80,6 +80,17 @@
 
 #define VOCTRL_UPDATE_SCREENINFO 32
 
+/* decode-ahead queue, see -frame-queue */
+#define VOCTRL_QUEUE_MODE 33
+#define VOCTRL_QUEUE_FRAME 34
+
+/* vblank timing, see -display-sync */
+#define VOCTRL_GET_VSYNC 35
+typedef struct {
+  unsigned int period;  // usecs between two vblanks
+  unsigned int last;    // GetTimer() at the start of a recent vblank
+} mp_vsync_info_t;
+
 // Vo can be used by xover
 #define VOCTRL_XOVERLAY_SUPPORT 22
 
@@ -221,6 +232,7 @@ extern int vo_grabpointer;
 extern int vo_doublebuffering;
 extern int vo_directrendering;
 extern int vo_vsync;
+extern int vo_frame_queue;
 extern int vo_fs;
 extern int vo_fsmode;
 extern float vo_panscan;
@@ -48,12 +48,18 @@
 
 #include <debug.h>
 
+#include <pthread.h>
 
 #include "config.h"
+#include "mp_msg.h"
+#include "subopt-helper.h"
 #include "video_out.h"
 #include "video_out_internal.h"
 
 #include "fastmemcpy.h"
+#include "mp_telemetry.h"
+#include "osdep/timer.h"
+#include "libxenon_miss/xenon_pthread.h"
 
 #include "libavutil/common.h"
 #include "sub/font_load.h"
@@ -157,8 +163,27 @@ typedef struct YUVSurface {
         AVSurface Y;
         AVSurface U;
         AVSurface V;
+        uint32_t fence; /**< serial of the last flip that sampled this surface */
+        int held; /**< HELD_* flags, a held surface can't be reused */
+        int direct; /**< filled by the decoder through direct rendering */
 } YUVSurface;
 
+#define HELD_FRAME      1 /**< frame being filled, released on flip */
+#define HELD_REF        2 /**< reference frame of the decoder */
+#define HELD_QUEUED     4 /**< decoded ahead, waiting for its flip */
+#define HELD_SHOWN      8 /**< last flipped frame in queue mode, redrawn until the next one */
+
+#define MAX_BUFFERS 16
+#define DR_REFS 2 /**< reference frames held by the decoder with direct rendering */
+
+/* suboptions */
+static int num_buffers = 3;
+
+static const opt_t subopts[] = {
+        {"buffers", OPT_ARG_INT, &num_buffers, int_pos},
+        {NULL}
+};
+
 static uint32_t max_width, max_height;
 
 static uint32_t image_width, image_height;
@@ -176,7 +201,15 @@ static struct XenosShader * g_pPixelTexturedShader = NULL;
 static struct XenosShader * g_pPixeOsdShader = NULL;
 
 static struct XenosDevice _xe;
-static YUVSurface * g_pTexture = NULL;
+static YUVSurface * g_pTextures[MAX_BUFFERS];
+static YUVSurface * g_pTexture = NULL; /**< surface the decoder writes into */
+static YUVSurface * g_pShown = NULL; /**< surface of the last flipped frame */
+static int cur_buffer = 0;
+
+// direct rendering
+static YUVSurface * dr_ip[DR_REFS]; /**< surfaces referenced by the decoder */
+static int dr_ip_cur = 0;
+static YUVSurface * dr_temp = NULL; /**< last non reference surface given away */
 static struct XenosSurface * g_pOsdSurf = NULL;
 
 typedef struct verticeFormats {
@@ -186,6 +219,51 @@ typedef struct verticeFormats {
 
 static int is_osd_populated = 0;
 
+// -perf-graph, bottom left of the osd, redrawn every few flips since the
+// gpu has to be done with the osd texture first
+#define PERF_GRAPH_FRAMES 256
+#define PERF_GRAPH_X 64
+#define PERF_GRAPH_Y 64
+#define PERF_GRAPH_HEIGHT 160
+#define PERF_GRAPH_SKIP 6
+
+enum {
+        FRAME_NONE,
+        FRAME_FILLING,
+        FRAME_DROPPED
+};
+
+static int frame_state = FRAME_NONE;
+static int gui_osd_in_flight = 0;
+
+// decode-ahead queue (-frame-queue): the decoder thread fills and queues
+// surfaces, the player thread only flips them
+static int queue_mode = 0;
+static YUVSurface * queue_fifo[MAX_BUFFERS];
+static int queue_head = 0;
+static int queue_count = 0;
+
+// ring state shared by the decoder thread and flip_page()
+static pthread_mutex_t vo_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define vo_lock()   pthread_mutex_lock(&vo_mutex)
+#define vo_unlock() pthread_mutex_unlock(&vo_mutex)
+
+// gpu fences
+static uint32_t fence_submitted = 0;
+static uint32_t fence_retired = 0;
+
+// ring stats
+static unsigned int frames_flipped = 0;
+static unsigned int frames_waited = 0;
+static unsigned int frames_dropped = 0;
+static unsigned int frames_direct = 0;
+static unsigned int frames_copied = 0;
+
+// vblank timing for VOCTRL_GET_VSYNC, GetTimer() usecs
+#define VSYNC_MEASURE 4
+static unsigned int vblank_last = 0;
+static unsigned int vblank_period = 0; // 0 until measured
+
 static YUVSurface * video_create_yuvsurf(int w, int h);
 static void video_lock_yuvsurf(YUVSurface*);
 static void video_unlock_yuvsurf(YUVSurface*);
@@ -205,6 +283,10 @@ static YUVSurface * video_create_yuvsurf(int width, int height) {
         surf->U.data = surf->U.surface->base;
         surf->V.data = surf->V.surface->base;
 
+        surf->fence = 0;
+        surf->held = 0;
+        surf->direct = 0;
+
         return surf;
 }
 
@@ -241,6 +323,44 @@ static void video_unlock_yuvsurf(YUVSurface* yuv) {
         }
 }
 
+/** @brief Wait for the gpu, every submitted frame is retired afterwards
+ */
+static void video_sync_gpu(void) {
+        Xe_Sync(g_pVideoDevice);
+        fence_retired = fence_submitted;
+}
+
+/** @brief Pick the next surface of the ring for the decoder.
+ *  A surface still sampled by a queued gpu frame is reclaimed with a sync,
+ *  NULL is returned when every surface is held.
+ *  In queue mode the caller is the decoder thread, which never talks to the
+ *  gpu: unretired surfaces are skipped, the next flip retires them.
+ */
+static YUVSurface * video_acquire_yuvsurf(int held) {
+        int i;
+        for (i = 0; i < num_buffers; i++) {
+                int idx = (cur_buffer + i) % num_buffers;
+                YUVSurface * surf = g_pTextures[idx];
+
+                if (surf->held)
+                        continue;
+
+                if (surf->fence > fence_retired) {
+                        if (queue_mode)
+                                continue;
+                        video_sync_gpu();
+                        frames_waited++;
+                }
+
+                surf->held = held;
+                surf->direct = 0;
+                cur_buffer = (idx + 1) % num_buffers;
+                return surf;
+        }
+
+        return NULL;
+}
+
 static void dump_rect(struct vo_rect * rect, const char * name) {
         printf("%s.bottom %d\n", name, rect->bottom);
         printf("%s.top %d\n", name, rect->top);
@@ -263,10 +383,29 @@ static void calc_fs_rect(void) {
 
 static int draw_slice(uint8_t *src[], int stride[], int w, int h, int x, int y) {
         char *dst; /**< Pointer to the destination image */
+        unsigned int t;
 
-        if ((!g_pVideoDevice) || (g_pTexture == NULL))
+        if ((!g_pVideoDevice) || (g_pTextures[0] == NULL))
                 return 0;
 
+        // first slice of a new frame
+        if (frame_state == FRAME_NONE) {
+                vo_lock();
+                g_pTexture = video_acquire_yuvsurf(HELD_FRAME);
+                if (g_pTexture) {
+                        frame_state = FRAME_FILLING;
+                } else {
+                        frame_state = FRAME_DROPPED;
+                        frames_dropped++;
+                }
+                vo_unlock();
+        }
+
+        if (frame_state == FRAME_DROPPED)
+                return 0;
+
+        t = GetTimer();
+
         /* Copy Y */
         dst = (char *) g_pTexture->Y.data;
         dst = dst + g_pTexture->Y.pitch * y + x;
@@ -287,6 +426,7 @@ static int draw_slice(uint8_t *src[], int stride[], int w, int h, int x, int y)
         dst = dst + g_pTexture->V.pitch * y + x;
         memcpy_pic(dst, src[2], w, h, g_pTexture->V.pitch, stride[2]);
 
+        telemetry_stage_add(TELEMETRY_UPLOAD, GetTimer() - t);
 
         return 0; /* Success */
 }
@@ -328,11 +468,68 @@ static void draw_alpha(int x0, int y0, int w, int h, unsigned char *src,
         is_osd_populated = 1;
 }
 
-static void draw_osd(void) {
-        if (vo_osd_changed(0)) {
+/** @brief Stacked bar per frame of the telemetry ring, one brightness per
+ *  stage, with a line at one frame period and a tick under dropped frames.
+ */
+static void draw_perf_graph(void) {
+        static mp_telemetry_frame_t frames[PERF_GRAPH_FRAMES];
+        static const unsigned char level[TELEMETRY_STAGES] = {
+                0x60, 0xff, 0xa0, 0xd0, 0x80
+        };
+        unsigned char * dst = (unsigned char *) g_pOsdSurf->base;
+        int pitch = g_pOsdSurf->wpitch;
+        int x0 = PERF_GRAPH_X;
+        int y0 = g_pOsdSurf->height - PERF_GRAPH_Y;
+        unsigned int period = vo_fps > 0 ? 1000000 / vo_fps : 1000000 / 60;
+        int n, i, s, x, y;
+
+        n = telemetry_read(frames, PERF_GRAPH_FRAMES);
+        // newest on the right
+        x0 += (PERF_GRAPH_FRAMES - n) * 2;
+        for (i = 0; i < n; i++) {
+                x = x0 + i * 2;
+                y = y0;
+                for (s = 0; s < TELEMETRY_STAGES; s++) {
+                        // one frame period is half the height
+                        int h = frames[i].usecs[s] * (PERF_GRAPH_HEIGHT / 2) / period;
+                        for (; h > 0 && y > y0 - PERF_GRAPH_HEIGHT; h--, y--)
+                                dst[(y - 1) * pitch + x] = dst[(y - 1) * pitch + x + 1] = level[s];
+                }
+                if (frames[i].dropped) {
+                        for (y = y0 + 2; y < y0 + 6; y++)
+                                dst[y * pitch + x] = dst[y * pitch + x + 1] = 0xff;
+                }
+        }
+
+        y = y0 - PERF_GRAPH_HEIGHT / 2;
+        for (x = PERF_GRAPH_X; x < PERF_GRAPH_X + PERF_GRAPH_FRAMES * 2; x += 4)
+                dst[y * pitch + x] = dst[y * pitch + x + 1] = 0xff;
+
+        is_osd_populated = 1;
+}
+
+static void update_osd(void) {
+        static int graph_skip = 0;
+        static int graph_shown = 0;
+        int graph = 0;
+
+        if (telemetry_graph && --graph_skip <= 0) {
+                graph_skip = PERF_GRAPH_SKIP;
+                graph = 1;
+        } else if (!telemetry_graph && graph_shown)
+                graph = 1; // turned off, clear it
+
+        if (vo_osd_changed(0) || graph) {
+                // the gpu may still sample the previous osd
+                if (fence_submitted > fence_retired)
+                        video_sync_gpu();
+
                 // Clear osd
                 memset(g_pOsdSurf->base, 0, g_pOsdSurf->wpitch * g_pOsdSurf->hpitch);
 
+                graph_shown = telemetry_graph;
+                if (graph_shown)
+                        draw_perf_graph();
                 vo_draw_text(g_pOsdSurf->width, g_pOsdSurf->height, draw_alpha);
 
 /*
@@ -346,6 +543,17 @@ static void draw_osd(void) {
         }
 }
 
+static void draw_osd(void) {
+        // in queue mode this comes from the decoder thread, ahead of the
+        // frame on screen; flip_queued() updates the osd instead
+        if (queue_mode)
+                return;
+        update_osd();
+}
+
+static void video_render(YUVSurface * surf);
+static void flip_queued(void);
+
 static void ShowFPS(void) {
         static unsigned long lastTick = 0;
         static int frames = 0;
@@ -360,29 +568,192 @@ static void ShowFPS(void) {
                 lastTick = nowTick;
         }
 }
+/** @brief Wait for the vblank at low smt priority, the sibling hardware thread
+ *  gets the core meanwhile. Remembers when the vblank started if it saw it.
+ */
+static void vsync_wait(void) {
+        if (Xe_IsVBlank(g_pVideoDevice))
+                return;
+        xenon_smt_low();
+        while (!Xe_IsVBlank(g_pVideoDevice));
+        xenon_smt_medium();
+        vblank_last = GetTimer();
+}
+
+/** @brief Time a few vblanks, the refresh rate is fixed so only once. */
+static void vsync_measure(void) {
+        unsigned int start;
+        int i;
+
+        if (vblank_period)
+                return;
+
+        while (Xe_IsVBlank(g_pVideoDevice));
+        vsync_wait();
+        start = vblank_last;
+        for (i = 0; i < VSYNC_MEASURE; i++) {
+                while (Xe_IsVBlank(g_pVideoDevice));
+                vsync_wait();
+        }
+        vblank_period = (vblank_last - start) / VSYNC_MEASURE;
+        mp_msg(MSGT_VO, MSGL_V, "vo_xenon: vblank every %u us\n", vblank_period);
+}
+
 extern int osd_level;
 extern unsigned int osd_visible;
 static int last_osd_level = 0;
 extern int gui_input_use;
 
 static void flip_page(void) {
+        YUVSurface * surf;
 
-        if (g_pTexture == NULL)
+        if (queue_mode) {
+                flip_queued();
+                return;
+        }
+
+        if (frame_state == FRAME_DROPPED) {
+                frame_state = FRAME_NONE;
+                return;
+        }
+
+        if (frame_state == FRAME_FILLING) {
+                // refresh texture cache
+                video_lock_yuvsurf(g_pTexture);
+                video_unlock_yuvsurf(g_pTexture);
+
+                g_pTexture->held &= ~HELD_FRAME;
+                g_pShown = g_pTexture;
+                frame_state = FRAME_NONE;
+
+                if (g_pShown->direct)
+                        frames_direct++;
+                else
+                        frames_copied++;
+        }
+
+        surf = g_pShown;
+        if (surf == NULL)
                 return;
 
         ShowFPS();
 
-        // Sync gpu
-        Xe_Sync(g_pVideoDevice);
+        // no Xe_Sync here, the ring lets the gpu draw this frame while the next one is decoded
 
         // vsync - take care slow down video ... 
         if (vo_vsync)
-                while (!Xe_IsVBlank(g_pVideoDevice));
+                vsync_wait();
 
-        // refresh texture cache
-        video_lock_yuvsurf(g_pTexture);
-        video_unlock_yuvsurf(g_pTexture);
+        video_render(surf);
+}
+
+/** @brief Queue mode flip, shows the oldest queued frame or redraws the
+ *  last one when the decoder thread is behind.
+ */
+static void flip_queued(void) {
+        YUVSurface * surf = NULL;
 
+        // wait outside of the lock, the decoder thread keeps going
+        if (vo_vsync)
+                vsync_wait();
+
+        vo_lock();
+
+        // retire the previous frame here, so that the decoder thread never
+        // has to wait for the gpu to get a surface
+        if (fence_submitted > fence_retired)
+                video_sync_gpu();
+
+        if (queue_count) {
+                surf = queue_fifo[queue_head];
+                queue_head = (queue_head + 1) % MAX_BUFFERS;
+                queue_count--;
+
+                surf->held = (surf->held & ~HELD_QUEUED) | HELD_SHOWN;
+                if (g_pShown && g_pShown != surf)
+                        g_pShown->held &= ~HELD_SHOWN;
+                g_pShown = surf;
+        }
+
+        if (g_pShown) {
+                if (surf)
+                        ShowFPS();
+                update_osd();
+                video_render(g_pShown);
+        }
+
+        vo_unlock();
+}
+
+/** @brief Queue the frame filled since the last call for a later flip.
+ *  Called by the decoder thread, VO_FALSE if the frame was dropped.
+ */
+static int queue_frame(void) {
+        YUVSurface * surf = g_pTexture;
+
+        if (frame_state != FRAME_FILLING) {
+                frame_state = FRAME_NONE;
+                return VO_FALSE;
+        }
+
+        // refresh texture cache, the surface belongs to the decoder thread until queued
+        video_lock_yuvsurf(surf);
+        video_unlock_yuvsurf(surf);
+
+        vo_lock();
+        surf->held = (surf->held & ~HELD_FRAME) | HELD_QUEUED;
+        queue_fifo[(queue_head + queue_count) % MAX_BUFFERS] = surf;
+        queue_count++;
+        frame_state = FRAME_NONE;
+
+        if (surf->direct)
+                frames_direct++;
+        else
+                frames_copied++;
+        vo_unlock();
+
+        return VO_TRUE;
+}
+
+/** @brief Forget the queued frames, after a seek or when leaving queue mode
+ */
+static void queue_flush(void) {
+        while (queue_count) {
+                queue_fifo[queue_head]->held &= ~HELD_QUEUED;
+                queue_head = (queue_head + 1) % MAX_BUFFERS;
+                queue_count--;
+        }
+}
+
+/** @brief Enter queue mode with room for depth frames, or leave it with 0.
+ *  Called by the player thread while the decoder thread is stopped.
+ */
+static int queue_set_mode(int depth) {
+        int ret = VO_TRUE;
+
+        vo_lock();
+        if (depth > 0) {
+                // queued frames, the one taken for the next flip, the one on
+                // screen, the one being filled and two direct rendering references
+                if (frame_state != FRAME_NONE || depth + 5 > num_buffers) {
+                        ret = VO_FALSE;
+                } else {
+                        if (g_pShown)
+                                g_pShown->held |= HELD_SHOWN;
+                        queue_mode = 1;
+                }
+        } else if (queue_mode) {
+                queue_flush();
+                if (g_pShown)
+                        g_pShown->held &= ~HELD_SHOWN;
+                queue_mode = 0;
+        }
+        vo_unlock();
+
+        return ret;
+}
+
+static void video_render(YUVSurface * surf) {
         // Reset states
         Xe_InvalidateState(g_pVideoDevice);
         Xe_SetClearColor(g_pVideoDevice, 0xFF000000);
@@ -400,9 +771,9 @@ static void flip_page(void) {
         Xe_SetShader(g_pVideoDevice, SHADER_TYPE_VERTEX, g_pVertexShader, 0);
 
         // select texture
-        Xe_SetTexture(g_pVideoDevice, 0, g_pTexture->Y.surface);
-        Xe_SetTexture(g_pVideoDevice, 1, g_pTexture->U.surface);
-        Xe_SetTexture(g_pVideoDevice, 2, g_pTexture->V.surface);
+        Xe_SetTexture(g_pVideoDevice, 0, surf->Y.surface);
+        Xe_SetTexture(g_pVideoDevice, 1, surf->U.surface);
+        Xe_SetTexture(g_pVideoDevice, 2, surf->V.surface);
 
         // Draw
         Xe_DrawPrimitive(g_pVideoDevice, XE_PRIMTYPE_RECTLIST, 0, 1);
@@ -418,15 +789,21 @@ static void flip_page(void) {
                 Xe_DrawPrimitive(g_pVideoDevice, XE_PRIMTYPE_RECTLIST, 0, 1);
         }
 
-        if (osd_level) {
+        if (osd_level >= 2 || (osd_level && osd_visible)) {
+                // the gui rewrites the shared vertex buffer, wait for the previous gui frame
+                if (gui_osd_in_flight)
+                        video_sync_gpu();
+
                 // display always
                 if (osd_level >= 2)
                         mplayer_osd_draw(osd_level);
                 else {
                         // only display for a number of frame
-                        if (osd_visible)
-                                mplayer_osd_draw(2);
+                        mplayer_osd_draw(2);
                 }
+                gui_osd_in_flight = 1;
+        } else {
+                gui_osd_in_flight = 0;
         }
 
         if (osd_level == 3) {
@@ -441,6 +818,8 @@ static void flip_page(void) {
         Xe_Execute(g_pVideoDevice);
         //Xe_Sync(g_pVideoDevice);
 
+        surf->fence = ++fence_submitted;
+        frames_flipped++;
 }
 
 static int draw_frame(uint8_t *src[]) {
@@ -456,17 +835,46 @@ static int query_format(uint32_t format) {
 }
 
 static void create_xenon_texture() {
-        g_pTexture = video_create_yuvsurf(image_width, image_height);
+        int i;
+        for (i = 0; i < num_buffers; i++)
+                g_pTextures[i] = video_create_yuvsurf(image_width, image_height);
+
+        g_pTexture = NULL;
+        g_pShown = NULL;
+        cur_buffer = 0;
+        frame_state = FRAME_NONE;
+        // the queued surfaces are gone, mplayer.c drops its entries when it
+        // sees vo_config_count change
+        queue_head = queue_count = 0;
+
+        dr_ip[0] = dr_ip[1] = NULL;
+        dr_ip_cur = 0;
+        dr_temp = NULL;
         g_pOsdSurf = Xe_CreateTexture(g_pVideoDevice, osd_texture_width, osd_texture_height, 1, XE_FMT_8, 0);
 
         memset(g_pOsdSurf->base, 0, g_pOsdSurf->wpitch * g_pOsdSurf->hpitch);
 }
 
 static void destroy_xenon_texture() {
-        if (g_pTexture)
-                video_delete_yuvsurf(g_pTexture);
+        int i;
+
+        // don't free surfaces the gpu is still sampling
+        if (fence_submitted > fence_retired)
+                video_sync_gpu();
+
+        for (i = 0; i < MAX_BUFFERS; i++) {
+                if (g_pTextures[i])
+                        video_delete_yuvsurf(g_pTextures[i]);
+                g_pTextures[i] = NULL;
+        }
+        g_pTexture = NULL;
+        g_pShown = NULL;
+        dr_ip[0] = dr_ip[1] = NULL;
+        dr_temp = NULL;
+
         if (g_pOsdSurf)
                 Xe_DestroyTexture(g_pVideoDevice, g_pOsdSurf);
+        g_pOsdSurf = NULL;
 }
 
 static void vo_xenon_fullscreen() {
@@ -591,12 +999,19 @@ static void update_vb() {
         Rect[5].z = 0.0;
         Rect[5].w = 1.0;
 
+        // the gpu may still read the previous rects
+        if (fence_submitted > fence_retired)
+                video_sync_gpu();
+
         void *v = Xe_VB_Lock(g_pVideoDevice, vb, 0, 4096, XE_LOCK_WRITE);
         memcpy(v, Rect, 6 * sizeof (verticeFormats));
         Xe_VB_Unlock(g_pVideoDevice, vb);
 }
 
 static int config(uint32_t width, uint32_t height, uint32_t d_width, uint32_t d_height, uint32_t flags, char *title, uint32_t format) {
+        // a mid-stream reconfig may come from the decoder thread
+        vo_lock();
+
         image_width = width;
         image_height = height;
 
@@ -606,6 +1021,15 @@ static int config(uint32_t width, uint32_t height, uint32_t d_width, uint32_t d_
         osd_texture_width = 1280;
         osd_texture_height = 720;
         
+        // with direct rendering the references stay held, keep one surface to
+        // fill besides the one on screen so B-frames don't wait for the gpu
+        if (vo_directrendering && num_buffers < DR_REFS + 2)
+                num_buffers = DR_REFS + 2;
+
+        // room for the decode-ahead queue, see queue_set_mode()
+        if (vo_frame_queue > 0 && num_buffers < vo_frame_queue + 5)
+                num_buffers = FFMIN(vo_frame_queue + 5, MAX_BUFFERS);
+
         // Destroy surface
         destroy_xenon_texture();
 
@@ -635,10 +1059,23 @@ static int config(uint32_t width, uint32_t height, uint32_t d_width, uint32_t d_
         update_vb();
         
         mplayer_osd_open();
+
+        if (vo_vsync)
+                vsync_measure();
+
+        vo_unlock();
         return 0;
 }
 
 static void uninit(void) {
+        mp_msg(MSGT_VO, MSGL_V, "vo_xenon: %u frames flipped, %u waited for a free surface, %u dropped (%d buffers)\n",
+                frames_flipped, frames_waited, frames_dropped, num_buffers);
+        mp_msg(MSGT_VO, MSGL_V, "vo_xenon: %u frames direct rendered, %u copied\n",
+                frames_direct, frames_copied);
+
+        frames_flipped = frames_waited = frames_dropped = 0;
+        frames_direct = frames_copied = 0;
+
         mplayer_osd_close();
 }
 
@@ -661,6 +1098,20 @@ static int preinit(const char *arg) {
 
         struct XenosSurface * fb = NULL;
 
+        num_buffers = 3;
+        if (subopt_parse(arg, subopts) != 0) {
+                mp_msg(MSGT_VO, MSGL_FATAL,
+                        "\n-vo xenon command line help:\n"
+                        "Example: mplayer -vo xenon:buffers=3\n"
+                        "\nOptions:\n"
+                        "  buffers=<n>\n"
+                        "    Number of YUV surfaces in the ring (1-%d, default 3, 4 with -dr)\n"
+                        "\n", MAX_BUFFERS);
+                return -1;
+        }
+        if (num_buffers > MAX_BUFFERS)
+                num_buffers = MAX_BUFFERS;
+
         //g_pVideoDevice = &_xe;
 
         //Xe_Init(g_pVideoDevice);
@@ -704,15 +1155,132 @@ static int preinit(const char *arg) {
         return 0;
 }
 
+/** @brief Direct rendering, hand a ring surface to the decoder.
+ *  Reference frames keep their surface until two newer references have been
+ *  requested, other frames until they are flipped.
+ */
+static int get_image_locked(mp_image_t *mpi) {
+        YUVSurface * surf;
+        int ref;
+
+        if (g_pTextures[0] == NULL)
+                return VO_FALSE;
+        if (mpi->imgfmt != IMGFMT_YV12 && mpi->imgfmt != IMGFMT_I420)
+                return VO_FALSE;
+        if (mpi->type != MP_IMGTYPE_TEMP && mpi->type != MP_IMGTYPE_IP && mpi->type != MP_IMGTYPE_IPB)
+                return VO_FALSE;
+        if (!(mpi->flags & (MP_IMGFLAG_ACCEPT_STRIDE | MP_IMGFLAG_ACCEPT_ALIGNED_STRIDE | MP_IMGFLAG_ACCEPT_WIDTH)))
+                return VO_FALSE;
+
+        // surfaces are allocated with the texture pitch, check the decoder fits
+        if (mpi->width > g_pTextures[0]->Y.pitch || mpi->height > g_pTextures[0]->Y.surface->hpitch)
+                return VO_FALSE;
+        if (mpi->chroma_width > g_pTextures[0]->U.pitch || mpi->chroma_height > g_pTextures[0]->U.surface->hpitch)
+                return VO_FALSE;
+
+        // same split as vf_get_image(): readable IPB frames and IP frames are references
+        ref = mpi->type == MP_IMGTYPE_IP || (mpi->type == MP_IMGTYPE_IPB && (mpi->flags & MP_IMGFLAG_READABLE));
+
+        if (ref) {
+                // the reference from two frames ago is no longer needed
+                dr_ip_cur ^= 1;
+                if (dr_ip[dr_ip_cur])
+                        dr_ip[dr_ip_cur]->held &= ~HELD_REF;
+                dr_ip[dr_ip_cur] = NULL;
+        } else if (dr_temp) {
+                // previous frame was decoded but never displayed
+                dr_temp->held &= ~HELD_FRAME;
+                dr_temp = NULL;
+        }
+
+        surf = video_acquire_yuvsurf(ref ? HELD_REF : HELD_FRAME);
+        if (surf == NULL)
+                return VO_FALSE;
+
+        if (ref)
+                dr_ip[dr_ip_cur] = surf;
+        else
+                dr_temp = surf;
+
+        surf->direct = 1;
+
+        mpi->planes[0] = surf->Y.data;
+        mpi->planes[1] = surf->U.data;
+        mpi->planes[2] = surf->V.data;
+        mpi->stride[0] = surf->Y.pitch;
+        mpi->stride[1] = surf->U.pitch;
+        mpi->stride[2] = surf->V.pitch;
+        mpi->flags |= MP_IMGFLAG_DIRECT;
+        mpi->priv = surf;
+
+        return VO_TRUE;
+}
+
+static int get_image(mp_image_t *mpi) {
+        int ret;
+
+        vo_lock();
+        ret = get_image_locked(mpi);
+        vo_unlock();
+        return ret;
+}
+
+/** @brief Queue a direct rendered frame for the next flip
+ */
+static int draw_image(mp_image_t *mpi) {
+        YUVSurface * surf = NULL;
+        int i;
+
+        if (!(mpi->flags & MP_IMGFLAG_DIRECT))
+                return VO_FALSE;
+
+        for (i = 0; i < num_buffers; i++) {
+                if (g_pTextures[i] == mpi->priv)
+                        surf = g_pTextures[i];
+        }
+        if (surf == NULL)
+                return VO_FALSE;
+
+        vo_lock();
+        if (surf == dr_temp)
+                dr_temp = NULL;
+
+        surf->held |= HELD_FRAME;
+        g_pTexture = surf;
+        frame_state = FRAME_FILLING;
+        vo_unlock();
+
+        return VO_TRUE;
+}
+
 static int control(uint32_t request, void *data) {
         switch (request) {
-                case VOCTRL_GET_IMAGE: /* Direct Rendering. Not implemented yet. */
-                        return VO_NOTIMPL;
+                case VOCTRL_GET_IMAGE:
+                        return get_image(data);
+                case VOCTRL_DRAW_IMAGE:
+                        return draw_image(data);
                 case VOCTRL_QUERY_FORMAT:
                         return query_format(*((uint32_t*) data));
                 case VOCTRL_FULLSCREEN:
+                        vo_lock();
                         vo_xenon_fullscreen();
                         update_vb();
+                        vo_unlock();
+                        return VO_TRUE;
+                case VOCTRL_RESET:
+                        vo_lock();
+                        queue_flush();
+                        vo_unlock();
+                        return VO_TRUE;
+                case VOCTRL_QUEUE_MODE:
+                        return queue_set_mode(*((int*) data));
+                case VOCTRL_QUEUE_FRAME:
+                        return queue_frame();
+                case VOCTRL_GET_VSYNC:
+                        if (!vo_vsync || !vblank_period)
+                                return VO_FALSE;
+                        ((mp_vsync_info_t *) data)->period = vblank_period;
+                        ((mp_vsync_info_t *) data)->last = vblank_last;
                         return VO_TRUE;
         }
         return VO_NOTIMPL;
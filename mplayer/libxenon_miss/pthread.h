@@ -1,16 +1,32 @@
+#ifndef XENON_MISS_PTHREAD_H
+#define XENON_MISS_PTHREAD_H
+
+#include <stddef.h>
+#include <time.h>
+#include "xenon_pthread.h"
+
 typedef pthread_cond_t;
 typedef pthread_condattr_t;
 typedef pthread_t;
-typedef pthread_attr_t;
+typedef xenon_pthread_attr_t pthread_attr_t;
 typedef pthread_mutex_t;
 typedef pthread_mutexattr_t;
 
+#define PTHREAD_MUTEX_INITIALIZER 0
+
+
+int   pthread_attr_init(pthread_attr_t *);
+int   pthread_attr_destroy(pthread_attr_t *);
+int   pthread_attr_setstacksize(pthread_attr_t *, size_t);
+int   pthread_attr_setrole_np(pthread_attr_t *, int);
 
 int   pthread_cond_broadcast(pthread_cond_t *);
 int   pthread_cond_destroy(pthread_cond_t *);
 int   pthread_cond_init(pthread_cond_t *, const pthread_condattr_t *);
 int   pthread_cond_signal(pthread_cond_t *);
 int   pthread_cond_wait(pthread_cond_t *, pthread_mutex_t *);
+int   pthread_cond_timedwait(pthread_cond_t *, pthread_mutex_t *,
+          const struct timespec *);
 
 int   pthread_create(pthread_t *, const pthread_attr_t *,
           void *(*)(void *), void *);
@@ -21,4 +37,6 @@ int   pthread_mutex_destroy(pthread_mutex_t *);
 int   pthread_mutex_init(pthread_mutex_t *, const pthread_mutexattr_t *);
 int   pthread_mutex_lock(pthread_mutex_t *);
 int   pthread_mutex_trylock(pthread_mutex_t *);
-int   pthread_mutex_unlock(pthread_mutex_t *);
\ No newline at end of file
+int   pthread_mutex_unlock(pthread_mutex_t *);
+
+#endif /* XENON_MISS_PTHREAD_H */
@@ -2,20 +2,99 @@
 #include <stdlib.h>
 #include <debug.h>
 #include <errno.h>
+#include <time.h>
+#include <sys/time.h>
 //#include "pthread.h"
 
 #include <ppc/atomic.h>
 #include <xetypes.h>
 #include <ppc/register.h>
 #include <ppc/xenonsprs.h>
+#include <ppc/timebase.h>
+#include <time/time.h>
 
 #include <xenon_soc/xenon_power.h>
 
+#include "xenon_pthread.h"
+
 
 #define NB_THREAD 6
 
 #define DBG_TR TR
 
+int xenon_thread_policy = XENON_POLICY_SPREAD;
+
+/* spins before a waiter starts to give its core away */
+#define SPIN_COUNT 256
+
+#ifdef XENON
+#define thread_relax()	xenon_smt_low()
+#define thread_resume()	xenon_smt_medium()
+#else
+#include <sched.h>
+#define thread_relax()	sched_yield()
+#define thread_resume()
+#endif
+
+/* bounded spinning, then polling at low priority */
+static inline void backoff(int *spins){
+	if (*spins < SPIN_COUNT)
+		(*spins)++;
+	else
+		thread_relax();
+}
+
+static inline void backoff_end(int spins){
+	if (spins >= SPIN_COUNT)
+		thread_resume();
+}
+
+/*
+ * Condition variables are a sequence counter: the waiter samples it with the
+ * mutex held, releases the mutex and waits for the counter to move, signal and
+ * broadcast bump it. Every waiter wakes up on a signal, which is a spurious
+ * wakeup as far as pthread is concerned.
+ */
+static void cond_wait_seq(volatile unsigned int *seq, void *mutex){
+	unsigned int val = *seq;
+	int spins = 0;
+
+	unlock(mutex);
+	while (*seq == val)
+		backoff(&spins);
+	backoff_end(spins);
+	lock(mutex);
+}
+
+/* same as above, gives up with ETIMEDOUT once abstime (realtime clock) is past */
+static int cond_timedwait_seq(volatile unsigned int *seq, void *mutex,
+		const struct timespec *abstime){
+	unsigned int val = *seq;
+	int spins = 0;
+	int ret = 0;
+	struct timeval now;
+
+	unlock(mutex);
+	while (*seq == val) {
+		backoff(&spins);
+		if (spins < SPIN_COUNT)
+			continue;
+		gettimeofday(&now, NULL);
+		if (now.tv_sec > abstime->tv_sec ||
+		    (now.tv_sec == abstime->tv_sec && now.tv_usec * 1000 >= abstime->tv_nsec)) {
+			ret = ETIMEDOUT;
+			break;
+		}
+	}
+	backoff_end(spins);
+	lock(mutex);
+	return ret;
+}
+
+static void cond_notify_seq(volatile unsigned int *seq){
+	__sync_fetch_and_add(seq, 1);
+}
+
 //#define USE_NAT_THREAD
 
 #ifdef USE_NAT_THREAD
@@ -138,19 +217,24 @@ int pthread_cond_init(pthread_cond_t * cond, void * u){
 };
 
 int pthread_cond_broadcast(pthread_cond_t *cond){
+	cond_notify_seq(cond);
 	return 0;
 };
 
 int pthread_cond_signal(pthread_cond_t * cond){
+	cond_notify_seq(cond);
 	return 0;
 };
 
 int pthread_cond_wait(pthread_cond_t * cond, pthread_mutex_t * mutex){	
-	pthread_mutex_unlock(mutex);
-	pthread_mutex_lock(mutex);
-	
+	cond_wait_seq(cond, (void*)mutex);
 	return 0;
 };
+
+int pthread_cond_timedwait(pthread_cond_t * cond, pthread_mutex_t * mutex,
+		const struct timespec * abstime){
+	return cond_timedwait_seq(cond, (void*)mutex, abstime);
+};
 #endif
 
 static int thread_n[] = {
@@ -172,8 +256,6 @@ int pthread_create(pthread_t *thread, void *u,
 	//thread_set_priority(curThread,15);
 	thread_resume(curThread);
 	
-	printf("New thread on %d\r\n",thread_n[last_thread_id]);
-	
 	last_thread_id++;	
 		
 	*thread = curThread;
@@ -182,10 +264,18 @@ int pthread_create(pthread_t *thread, void *u,
 }
 
 int pthread_join(pthread_t thread, void **value_ptr){
-	while(!thread->ThreadTerminated);
+	int spins = 0;
+	while(!thread->ThreadTerminated)
+		backoff(&spins);
+	backoff_end(spins);
 	return 0;
 }
 
+/* the threading library time-shares, every task gets to run */
+int xenon_thread_available(int role){
+	return NB_THREAD - 1;
+}
+
 #else // CLASSIC THREAD
 
 typedef unsigned int __attribute__ ((aligned (128))) pthread_cond_t;
@@ -230,73 +320,294 @@ int pthread_cond_init(pthread_cond_t * cond, void * u){
 };
 
 int pthread_cond_broadcast(pthread_cond_t *cond){
-	//TR;
-	//unlock(cond);
+	cond_notify_seq(cond);
 	return 0;
 };
 
 int pthread_cond_signal(pthread_cond_t * cond){
-	//TR;
-	//unlock(cond);
+	cond_notify_seq(cond);
 	return 0;
 };
 
 int pthread_cond_wait(pthread_cond_t * cond, pthread_mutex_t * mutex){
-	//TR;
-	//lock(cond);
-	
-	unlock((void*)mutex);
-	lock((void*)mutex);
-	
+	cond_wait_seq(cond, (void*)mutex);
 	return 0;
 };
 
+int pthread_cond_timedwait(pthread_cond_t * cond, pthread_mutex_t * mutex,
+		const struct timespec * abstime){
+	return cond_timedwait_seq(cond, (void*)mutex, abstime);
+};
+
 typedef void *(*xenon_thread_func)(void*);
+typedef xenon_pthread_attr_t pthread_attr_t;
+
+#define MAX_TASKS 32
+#define DEFAULT_STACK_SIZE 0x10000
+
+enum {
+	TASK_FREE = 0,
+	TASK_RUNNING,
+	TASK_DONE
+};
 
-static xenon_thread_func func_stack[6];
-static void * args_stack[6];
-static unsigned char stack[6 * 0x10000];
+typedef struct {
+	xenon_thread_func func;
+	void *arg;
+	void *ret;
+	unsigned int stacksize;
+	int role;
+	volatile int state;
+} xenon_task_t;
+
+typedef struct {
+	unsigned char *stack;
+	unsigned int stacksize;
+	volatile int task;	/* task index + 1, 0 when idle */
+	volatile int running;	/* worker_loop() is on its hardware thread */
+} xenon_worker_t;
+
+/* an idle worker waits that long for another task before it parks */
+#define WORKER_LINGER_MSEC 50
+
+static xenon_task_t tasks[MAX_TASKS];
+static xenon_worker_t workers[NB_THREAD];
+static unsigned int __attribute__ ((aligned (128))) pool_lock = 0;
+static int rr_next = 0;
 
-static void thread_runner(void){
-	void *args=args_stack[mfspr(pir)];
-	xenon_thread_func func = func_stack[mfspr(pir)];	
-	func(args);	
+/*
+ * Hardware threads by preference, 0 terminated, thread 0 runs the main loop.
+ * Decoders never take more than DECODE_SLOTS workers whatever the policy, the
+ * cache, audio and frame queue threads always find one.
+ */
+#define DECODE_SLOTS 3
+static const int spread_decode[] = {2, 4, 3, 0};	/* keep off the main thread sibling */
+static const int spread_service[] = {1, 5, 3, 0};	/* 1 and 5 are never decoders */
+static const int compact_order[] = {1, 2, 3, 4, 5, 0};
+
+static const int * placement(int role){
+	if (xenon_thread_policy == XENON_POLICY_SPREAD)
+		return (role == XENON_THREAD_SERVICE) ? spread_service : spread_decode;
+	return compact_order;
 }
 
-//#define STABLE
+/* workers running a decode task, pool_lock held */
+static int decode_busy(void){
+	int hw, n = 0;
 
-int pthread_create(pthread_t *thread, void *u,
+	for (hw = 1; hw < NB_THREAD; hw++) {
+		if (workers[hw].task && tasks[workers[hw].task - 1].role == XENON_THREAD_DECODE)
+			n++;
+	}
+	return n;
+}
+
+/* a parked worker gets a new stack if needed */
+static int task_fits(xenon_task_t *t, int hw){
+	return !workers[hw].running || workers[hw].stacksize >= t->stacksize;
+}
+
+/* first idle worker allowed for the task, -1 if none */
+static int pick_worker(xenon_task_t *t){
+	const int *order = placement(t->role);
+	int i, n = 0;
+
+	while (order[n])
+		n++;
+
+	for (i = 0; i < n; i++) {
+		int hw = order[i];
+		if (xenon_thread_policy == XENON_POLICY_ROUNDROBIN)
+			hw = order[(rr_next + i) % n];
+
+		if (workers[hw].task || !task_fits(t, hw))
+			continue;
+
+		if (xenon_thread_policy == XENON_POLICY_ROUNDROBIN)
+			rr_next = (rr_next + i + 1) % n;
+		return hw;
+	}
+	return -1;
+}
+
+/* some worker of the task placement has, or can get, a large enough stack */
+static int task_can_run(xenon_task_t *t){
+	const int *order = placement(t->role);
+	for (; *order; order++) {
+		if (task_fits(t, *order))
+			return 1;
+	}
+	return 0;
+}
+
+static void worker_loop(void);
+
+static void assign_task(int hw, int idx){
+	xenon_worker_t *w = &workers[hw];
+	xenon_task_t *t = &tasks[idx];
+
+	t->state = TASK_RUNNING;
+	__sync_synchronize();
+	w->task = idx + 1;
+
+	if (!w->running) {
+		// a worker that just parked is on its way out of worker_loop()
+		while (xenon_is_thread_task_running(hw))
+			;
+		if (w->stacksize < t->stacksize || !w->stack) {
+			free(w->stack);
+			w->stacksize = (t->stacksize > DEFAULT_STACK_SIZE) ? t->stacksize : DEFAULT_STACK_SIZE;
+			w->stack = malloc(w->stacksize);
+		}
+		w->running = 1;
+		xenon_run_thread_task(hw, w->stack + w->stacksize - 0x100, worker_loop);
+	}
+}
+
+/*
+ * Worker, runs the tasks handed by pthread_create(). Once idle for
+ * WORKER_LINGER_MSEC it returns and libxenon stops the hardware thread until
+ * assign_task() runs it again, the menu and the photo viewer don't keep
+ * hardware threads polling.
+ */
+static void worker_loop(void){
+	int hw = mfspr(pir);
+	xenon_worker_t *w = &workers[hw];
+
+	for (;;) {
+		xenon_task_t *t;
+		int spins = 0;
+		u64 idle = mftb();
+
+		while (!w->task) {
+			backoff(&spins);
+			if (spins < SPIN_COUNT || tb_diff_msec(mftb(), idle) < WORKER_LINGER_MSEC)
+				continue;
+			lock(&pool_lock);
+			if (!w->task) {
+				w->running = 0;
+				unlock(&pool_lock);
+				backoff_end(spins);
+				return;
+			}
+			unlock(&pool_lock);
+		}
+		backoff_end(spins);
+		__sync_synchronize();
+
+		t = &tasks[w->task - 1];
+		t->ret = t->func(t->arg);
+
+		lock(&pool_lock);
+		t->state = TASK_DONE;
+		w->task = 0;
+		unlock(&pool_lock);
+	}
+}
+
+int pthread_attr_init(pthread_attr_t *attr){
+	attr->stacksize = DEFAULT_STACK_SIZE;
+	attr->role = XENON_THREAD_DECODE;
+	return 0;
+}
+
+int pthread_attr_destroy(pthread_attr_t *attr){
+	return 0;
+}
+
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t stacksize){
+	attr->stacksize = stacksize;
+	return 0;
+}
+
+int pthread_attr_setrole_np(pthread_attr_t *attr, int role){
+	attr->role = role;
+	return 0;
+}
+
+/* idle workers a task of this role can get */
+int xenon_thread_available(int role){
+	const int *order = placement(role);
+	int n = 0;
+
+	lock(&pool_lock);
+	for (; *order; order++) {
+		if (!workers[*order].task)
+			n++;
+	}
+	if (role == XENON_THREAD_DECODE && n > DECODE_SLOTS - decode_busy())
+		n = DECODE_SLOTS - decode_busy();
+	unlock(&pool_lock);
+	return n;
+}
+
+/*
+ * Tasks run on a pool of persistent workers, one per hardware thread.
+ * Nothing would run a task nobody waits for, ffmpeg workers and feeders live
+ * as long as the stream: when every allowed worker is busy this fails with
+ * EAGAIN and the caller does without the thread.
+ */
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
     void *(*start_routine)(void*), void *arg){
-#ifdef STABLE
-	static int last_thread_id = 2;
-	if(last_thread_id>=NB_THREAD){
-		last_thread_id = 2;
+	xenon_task_t *t;
+	int i, hw;
+
+	lock(&pool_lock);
+
+	for (i = 0; i < MAX_TASKS; i++) {
+		if (tasks[i].state == TASK_FREE)
+			break;
 	}
-#else
-	static int last_thread_id = 1;
-	if(last_thread_id>=NB_THREAD){
-		last_thread_id = 1;
+	if (i == MAX_TASKS) {
+		unlock(&pool_lock);
+		return EAGAIN;
 	}
-#endif
-	printf("New thread on %d\r\n",last_thread_id);
-	
-	args_stack[last_thread_id]=arg;
-	func_stack[last_thread_id]=start_routine;
-	
-	xenon_run_thread_task(last_thread_id,stack + (last_thread_id * 0x10000) - 0x100,thread_runner);
-	
-	thread[0]=last_thread_id;
-	
-#ifdef STABLE
-	last_thread_id+=2;
-#else
-	last_thread_id++;
-#endif
+
+	t = &tasks[i];
+	t->func = start_routine;
+	t->arg = arg;
+	t->ret = NULL;
+	t->stacksize = attr ? attr->stacksize : DEFAULT_STACK_SIZE;
+	t->role = attr ? attr->role : XENON_THREAD_DECODE;
+
+	if (!task_can_run(t) ||
+	    (t->role == XENON_THREAD_DECODE && decode_busy() >= DECODE_SLOTS)) {
+		unlock(&pool_lock);
+		return EAGAIN;
+	}
+
+	hw = pick_worker(t);
+	if (hw < 0) {
+		unlock(&pool_lock);
+		return EAGAIN;
+	}
+	assign_task(hw, i);
+
+	unlock(&pool_lock);
+
+	thread[0] = i + 1;
 	return 0;
 }
 
 int pthread_join(pthread_t thread, void **value_ptr){
-	while(xenon_is_thread_task_running(thread));
+	xenon_task_t *t;
+	int spins = 0;
+
+	if (thread < 1 || thread > MAX_TASKS)
+		return ESRCH;
+
+	t = &tasks[thread - 1];
+	while (t->state != TASK_DONE)
+		backoff(&spins);
+	backoff_end(spins);
+	__sync_synchronize();
+
+	if (value_ptr)
+		*value_ptr = t->ret;
+
+	lock(&pool_lock);
+	t->state = TASK_FREE;
+	unlock(&pool_lock);
 	return 0;
 }
 
@@ -0,0 +1,46 @@
+/* 
+ * File:   xenon_pthread.h
+ *
+ * Xenon specific thread pool settings
+ */
+
+#ifndef XENON_PTHREAD_H
+#define	XENON_PTHREAD_H
+
+/* thread roles, selected with pthread_attr_setrole_np() */
+enum {
+	XENON_THREAD_DECODE = 0,	/* cpu heavy, ffmpeg workers */
+	XENON_THREAD_SERVICE,		/* mostly waiting, cache/audio feeders */
+};
+
+/* placement policies of the worker pool */
+enum {
+	XENON_POLICY_SPREAD = 0,	/* decode on 2-4, services next to the main thread and on 5 */
+	XENON_POLICY_COMPACT,		/* first free hardware thread, 1 to 5 */
+	XENON_POLICY_ROUNDROBIN,	/* old behaviour, rotate over 1 to 5 */
+	XENON_POLICY_NB
+};
+
+#ifdef XENON
+/* smt priority hints, a low priority hardware thread leaves the issue slots of
+ * its core to the sibling thread. There is no scheduler to give the thread to. */
+#define xenon_smt_low()		asm volatile("or 1,1,1")
+#define xenon_smt_medium()	asm volatile("or 2,2,2")
+#else
+#define xenon_smt_low()
+#define xenon_smt_medium()
+#endif
+
+typedef struct {
+	unsigned int stacksize;
+	int role;
+} xenon_pthread_attr_t;
+
+/* -thread-policy */
+extern int xenon_thread_policy;
+
+/* idle hardware threads for a role, pthread_create() doesn't queue. At most 3
+ * for decoding, the others are kept for the cache, audio and frame queue. */
+int xenon_thread_available(int role);
+
+#endif	/* XENON_PTHREAD_H */
@@ -138,6 +138,28 @@ typedef struct MPContext {
 } MPContext;
 
 
+/// decode-ahead queue statistics, see -frame-queue
+typedef struct frame_queue_stats {
+    int depth;          ///< frames decoded ahead now
+    int max_depth;      ///< 0 when the decoder thread isn't running
+    int late;           ///< frames flipped more than half a frame late
+    int empty;          ///< times a frame was due and none was decoded yet
+    int decoded;        ///< decode times the percentiles are over
+    double decode_p50;  ///< decode and filter time per frame, in ms
+    double decode_p90;
+    double decode_p99;
+    double decode_max;
+} frame_queue_stats_t;
+
+/// audio refill statistics, see -audio-thread
+typedef struct audio_feeder_stats {
+    int running;        ///< the audio thread feeds the ao
+    int underruns;      ///< times the ao had less than one outburst left
+    double max_gap;     ///< longest time between two refills, in ms
+    double min_queued;  ///< least audio left in the ao at a refill, in ms
+} audio_feeder_stats_t;
+
+
 // Most of these should not be globals
 extern int abs_seek_pos;
 extern float rel_seek_secs;
@@ -156,5 +178,7 @@ void exit_player(enum exit_reason how);
 void exit_player_with_rc(enum exit_reason how, int rc);
 void add_subtitles(char *filename, float fps, int noerr);
 int reinit_video_chain(void);
+void frame_queue_get_stats(frame_queue_stats_t *stats);
+void audio_feeder_get_stats(audio_feeder_stats_t *stats);
 
 #endif /* MPLAYER_MP_CORE_H */
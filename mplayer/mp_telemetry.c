@@ -0,0 +1,139 @@
+/*
+ * This file is part of MPlayer.
+ *
+ * MPlayer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * MPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with MPlayer; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Per frame timing of the playback stages. The main loop is the only writer
+ * of the ring: it publishes a frame by moving the write count after filling
+ * its slot, readers copy what they need and drop the slots that were
+ * overwritten meanwhile.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mp_msg.h"
+#include "mp_telemetry.h"
+
+int telemetry_graph;
+char *telemetry_csv;
+
+static mp_telemetry_frame_t ring[TELEMETRY_FRAMES];
+static volatile unsigned int write_count;
+
+// owned by the thread decoding the video
+static mp_telemetry_frame_t pending;
+
+void telemetry_stage_add(int stage, unsigned int usecs)
+{
+    pending.usecs[stage] += usecs;
+}
+
+void telemetry_dropped(void)
+{
+    pending.dropped++;
+}
+
+/**
+ * \brief stages collected since the last call, for the frame just decoded
+ */
+void telemetry_stage_take(mp_telemetry_frame_t *frame)
+{
+    *frame = pending;
+    // the VO uploads from within the filter chain
+    if (frame->usecs[TELEMETRY_FILTER] > frame->usecs[TELEMETRY_UPLOAD])
+        frame->usecs[TELEMETRY_FILTER] -= frame->usecs[TELEMETRY_UPLOAD];
+    else
+        frame->usecs[TELEMETRY_FILTER] = 0;
+    memset(&pending, 0, sizeof(pending));
+}
+
+void telemetry_push(const mp_telemetry_frame_t *frame)
+{
+    unsigned int w = write_count;
+    ring[w % TELEMETRY_FRAMES] = *frame;
+    __sync_synchronize();
+    write_count = w + 1;
+}
+
+/// Start of a file, with no other thread decoding.
+void telemetry_reset(void)
+{
+    write_count = 0;
+    memset(&pending, 0, sizeof(pending));
+}
+
+/**
+ * \brief copy the last frames, oldest first
+ * \return number of frames copied
+ */
+int telemetry_read(mp_telemetry_frame_t *frames, int max)
+{
+    unsigned int w, first, lost;
+    int n, i;
+
+    w = write_count;
+    __sync_synchronize();
+    n = max;
+    if (n > TELEMETRY_FRAMES)
+        n = TELEMETRY_FRAMES;
+    if (n > w)
+        n = w;
+    first = w - n;
+    for (i = 0; i < n; i++)
+        frames[i] = ring[(first + i) % TELEMETRY_FRAMES];
+    __sync_synchronize();
+
+    // the writer went around the ring over the oldest ones
+    w = write_count;
+    if (w - first <= TELEMETRY_FRAMES)
+        return n;
+    lost = w - first - TELEMETRY_FRAMES;
+    if (lost >= n)
+        return 0;
+    memmove(frames, frames + lost, (n - lost) * sizeof(*frames));
+    return n - lost;
+}
+
+int telemetry_dump_csv(const char *filename)
+{
+    static mp_telemetry_frame_t frames[TELEMETRY_FRAMES];
+    FILE *f;
+    int n, i;
+
+    f = fopen(filename, "w");
+    if (!f) {
+        mp_msg(MSGT_CPLAYER, MSGL_ERR, "Cannot write telemetry to %s.\n", filename);
+        return -1;
+    }
+    n = telemetry_read(frames, TELEMETRY_FRAMES);
+    fprintf(f, "time_ms,pts,demux_ms,decode_ms,filter_ms,upload_ms,flip_ms,av_drift_ms,cache,dropped\n");
+    for (i = 0; i < n; i++) {
+        const mp_telemetry_frame_t *t = &frames[i];
+        fprintf(f, "%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%d,%d\n",
+                (t->time - frames[0].time) / 1000.0, t->pts,
+                t->usecs[TELEMETRY_DEMUX] / 1000.0,
+                t->usecs[TELEMETRY_DECODE] / 1000.0,
+                t->usecs[TELEMETRY_FILTER] / 1000.0,
+                t->usecs[TELEMETRY_UPLOAD] / 1000.0,
+                t->usecs[TELEMETRY_FLIP] / 1000.0,
+                t->av_drift * 1000.0, t->cache, t->dropped);
+    }
+    fclose(f);
+    mp_msg(MSGT_CPLAYER, MSGL_INFO, "Timing of %d frames written to %s.\n", n, filename);
+    return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * This file is part of MPlayer.
+ *
+ * MPlayer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * MPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with MPlayer; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPLAYER_MP_TELEMETRY_H
+#define MPLAYER_MP_TELEMETRY_H
+
+/// frames kept, the CSV holds the last ones
+#define TELEMETRY_FRAMES 4096
+
+enum {
+    TELEMETRY_DEMUX,
+    TELEMETRY_DECODE,
+    TELEMETRY_FILTER,   ///< video filters, without the upload
+    TELEMETRY_UPLOAD,   ///< copy of the picture to the VO
+    TELEMETRY_FLIP,
+    TELEMETRY_STAGES
+};
+
+/// timing of one shown frame
+typedef struct mp_telemetry_frame {
+    unsigned int time;                      ///< GetTimer() at the flip
+    double pts;
+    unsigned int usecs[TELEMETRY_STAGES];   ///< with those of the frames dropped before
+    float av_drift;                         ///< audio - video, in seconds
+    int cache;                              ///< percent, -1 without cache
+    int dropped;                            ///< frames dropped since the previous one
+} mp_telemetry_frame_t;
+
+extern int telemetry_graph;
+extern char *telemetry_csv;
+
+// thread decoding the video, collects the stages of the next frame
+void telemetry_stage_add(int stage, unsigned int usecs);
+void telemetry_dropped(void);
+void telemetry_stage_take(mp_telemetry_frame_t *frame);
+
+// single writer, the main loop
+void telemetry_push(const mp_telemetry_frame_t *frame);
+void telemetry_reset(void);
+
+// any thread, without locking
+int telemetry_read(mp_telemetry_frame_t *frames, int max);
+int telemetry_dump_csv(const char *filename);
+
+#endif /* MPLAYER_MP_TELEMETRY_H */
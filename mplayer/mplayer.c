@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <math.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -60,6 +61,10 @@
 #endif /* __linux__ */
 #endif /* HAVE_RTC */
 
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 /*
  * In Mac OS X the SDL-lib is built upon Cocoa. The easiest way to
  * make it all work is to use the builtin SDL-bootstrap code, which
@@ -112,6 +117,7 @@
 #include "mp_fifo.h"
 #include "mp_msg.h"
 #include "mp_strings.h"
+#include "mp_telemetry.h"
 #include "mpcommon.h"
 #include "mplayer.h"
 #include "osdep/getch2.h"
@@ -129,6 +135,7 @@
 #include "osdep/timer.h"
 
 #include "osdep/osdep_xenon.h"
+#include "libxenon_miss/xenon_pthread.h"
 
 #include "udp_sync.h"
 
@@ -180,6 +187,22 @@ static int total_time_usage_start;
 static int total_frame_cnt;
 static int drop_frame_cnt; // total number of dropped frames
 int benchmark;
+static int demuxer_bench = -1; // usecs of simulated decoding per packet
+static int video_stall;         // usecs of simulated decoding once per second of video
+static int audio_thread;
+#ifdef XENON
+// -thread-bench: the file is played again under each placement policy with 1
+// to THREAD_BENCH_THREADS decoding threads, the decode speeds are printed once
+// all were played
+#define THREAD_BENCH_THREADS 3
+static int thread_bench;
+static int thread_bench_run;    // policy * THREAD_BENCH_THREADS + threads - 1
+static int thread_bench_policy, thread_bench_threads; // as given, set back at the end
+static double thread_bench_fps[XENON_POLICY_NB * THREAD_BENCH_THREADS];
+static const char *const thread_policy_names[XENON_POLICY_NB] = {
+    "spread", "compact", "roundrobin"
+};
+#endif
 
 // options:
 #define DEFAULT_STARTUP_DECODE_RETRY 8
@@ -264,6 +287,7 @@ float audio_delay;
 static int ignore_start;
 
 static int softsleep;
+static int display_sync;
 
 double force_fps;
 static int force_srate;
@@ -557,10 +581,309 @@ static void mp_dvdnav_context_free(MPContext *ctx)
 
 #endif
 
+// demuxer access, the decoder and audio threads vs. the main loop
+static pthread_mutex_t demux_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void demux_lock(void)
+{
+    pthread_mutex_lock(&demux_mutex);
+}
+
+static void demux_unlock(void)
+{
+    pthread_mutex_unlock(&demux_mutex);
+}
+
+// decode-ahead queue (-frame-queue): a decoder thread runs update_video()
+// and queues the frames in the VO, the main loop only times and flips them
+#define FRAME_QUEUE_MAX   8
+#define FRAME_QUEUE_STATS 256   // decode times kept for the percentiles
+
+typedef struct frame_queue_entry {
+    double frame_time;          // since the previous queued frame
+    double pts;
+    int skip_timing;            // first frame after a seek
+    mp_telemetry_frame_t telemetry;
+} frame_queue_entry_t;
+
+static struct frame_queue {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;        // signalled on every change of the queue
+    int init;
+    int running;                // thread started and not joined yet
+    int unsupported;            // the VO refused, don't retry for this file
+    int quit;
+    int paused;                 // nesting count of frame_queue_pause()
+    int busy;                   // the thread is decoding
+    int eof;
+    int head;
+    int count;
+    double pending_time;        // frame time of decoded frames not queued
+    frame_queue_entry_t entries[FRAME_QUEUE_MAX];
+    double shown_pts;           // pts of the frame last taken by the main loop
+    // statistics, also kept without the thread for comparison
+    unsigned int decode_usecs[FRAME_QUEUE_STATS];
+    int decode_pos;
+    int decode_cnt;
+    int decoded;                // frames of the whole file
+    double decode_secs;         // and the time spent decoding them
+    int late;                   // flipped more than half a frame late
+    int empty;                  // a frame was due but none was decoded yet
+} frame_queue;
+
+static void frame_queue_init(void)
+{
+    if (frame_queue.init)
+        return;
+    pthread_mutex_init(&frame_queue.mutex, NULL);
+    pthread_cond_init(&frame_queue.cond, NULL);
+    frame_queue.init = 1;
+}
+
+/// Start of a file, the statistics are per file.
+static void frame_queue_reset_stats(void)
+{
+    frame_queue_init();
+    pthread_mutex_lock(&frame_queue.mutex);
+    frame_queue.decode_pos = 0;
+    frame_queue.decode_cnt = 0;
+    frame_queue.decoded     = 0;
+    frame_queue.decode_secs = 0;
+    frame_queue.late       = 0;
+    frame_queue.empty      = 0;
+    pthread_mutex_unlock(&frame_queue.mutex);
+}
+
+/// Make sure the decoder thread stays out of the player until frame_queue_resume().
+static void frame_queue_pause(void)
+{
+    if (!frame_queue.running)
+        return;
+    pthread_mutex_lock(&frame_queue.mutex);
+    frame_queue.paused++;
+    while (frame_queue.busy)
+        pthread_cond_wait(&frame_queue.cond, &frame_queue.mutex);
+    pthread_mutex_unlock(&frame_queue.mutex);
+}
+
+static void frame_queue_resume(void)
+{
+    if (!frame_queue.running)
+        return;
+    pthread_mutex_lock(&frame_queue.mutex);
+    if (frame_queue.paused > 0)
+        frame_queue.paused--;
+    pthread_cond_broadcast(&frame_queue.cond);
+    pthread_mutex_unlock(&frame_queue.mutex);
+}
+
+/// Drop the queued frames, with the thread paused. The VO side is dropped by VOCTRL_RESET.
+static void frame_queue_flush(void)
+{
+    if (!frame_queue.running)
+        return;
+    pthread_mutex_lock(&frame_queue.mutex);
+    frame_queue.head         = 0;
+    frame_queue.count        = 0;
+    frame_queue.pending_time = 0;
+    frame_queue.eof          = 0;
+    pthread_mutex_unlock(&frame_queue.mutex);
+}
+
+static void frame_queue_stop(void)
+{
+    int off = 0;
+    frame_queue.unsupported = 0;
+    if (!frame_queue.running)
+        return;
+    pthread_mutex_lock(&frame_queue.mutex);
+    frame_queue.quit = 1;
+    pthread_cond_broadcast(&frame_queue.cond);
+    pthread_mutex_unlock(&frame_queue.mutex);
+    pthread_join(frame_queue.thread, NULL);
+    frame_queue_flush();
+    frame_queue.running = 0;
+    frame_queue.paused  = 0;
+    if (mpctx->video_out && vo_config_count)
+        mpctx->video_out->control(VOCTRL_QUEUE_MODE, &off);
+    mp_msg(MSGT_CPLAYER, MSGL_V, "Frame queue: %d late, %d empty\n",
+           frame_queue.late, frame_queue.empty);
+}
+
+/// pts of the frame on screen, sh_video->pts is the decoder position
+static double video_shown_pts(void)
+{
+    return frame_queue.running ? frame_queue.shown_pts : mpctx->sh_video->pts;
+}
+
+static void frame_queue_add_decode_time(unsigned int usecs)
+{
+    frame_queue_init();
+    pthread_mutex_lock(&frame_queue.mutex);
+    frame_queue.decode_usecs[frame_queue.decode_pos] = usecs;
+    frame_queue.decode_pos = (frame_queue.decode_pos + 1) % FRAME_QUEUE_STATS;
+    if (frame_queue.decode_cnt < FRAME_QUEUE_STATS)
+        frame_queue.decode_cnt++;
+    frame_queue.decoded++;
+    frame_queue.decode_secs += usecs * 0.000001;
+    pthread_mutex_unlock(&frame_queue.mutex);
+}
+
+static int compare_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a;
+    unsigned int y = *(const unsigned int *)b;
+    return x < y ? -1 : x > y;
+}
+
+void frame_queue_get_stats(frame_queue_stats_t *stats)
+{
+    unsigned int usecs[FRAME_QUEUE_STATS];
+    int n;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!frame_queue.init)
+        return;
+
+    pthread_mutex_lock(&frame_queue.mutex);
+    stats->depth     = frame_queue.running ? frame_queue.count : 0;
+    stats->max_depth = frame_queue.running ? vo_frame_queue : 0;
+    stats->late      = frame_queue.late;
+    stats->empty     = frame_queue.empty;
+    n = frame_queue.decode_cnt;
+    memcpy(usecs, frame_queue.decode_usecs, n * sizeof(*usecs));
+    pthread_mutex_unlock(&frame_queue.mutex);
+
+    stats->decoded = n;
+    if (!n)
+        return;
+    qsort(usecs, n, sizeof(*usecs), compare_uint);
+    stats->decode_p50 = usecs[n * 50 / 100] / 1000.0;
+    stats->decode_p90 = usecs[n * 90 / 100] / 1000.0;
+    stats->decode_p99 = usecs[n * 99 / 100] / 1000.0;
+    stats->decode_max = usecs[n - 1] / 1000.0;
+}
+
+// audio feeder (-audio-thread): a thread decodes, filters and plays the audio
+// so that slow video frames don't starve the ao. The main loop only sees the
+// audio clock it publishes after each ao->play().
+static struct audio_feeder {
+    pthread_t thread;
+    pthread_mutex_t mutex;      // the audio clock, the counters and the flags below
+    pthread_cond_t cond;
+    int init;
+    int running;                // thread started and not joined yet
+    int quit;
+    int paused;                 // nesting count of audio_feeder_pause()
+    int busy;                   // the thread is in fill_audio_out_buffers()
+    int eof;                    // all audio written to the ao
+    int reinit;                 // format change, the main loop rebuilds the chain
+    demux_stream_t *ds;         // the stream the thread reads, see audio_feeder_start()
+    // audio clock
+    double written;             // seconds written since the last audio_feeder_sync()
+    double written_pts;         // written_audio_pts() after the last ao->play()
+    // statistics, also kept without the thread for comparison
+    int primed;                 // the ao has data, a dry buffer is an underrun
+    int starved;                // the current underrun was counted
+    unsigned int last_refill;
+    int underruns;
+    unsigned int max_gap;       // usecs between two refills
+    float min_queued;           // seconds left in the ao at a refill
+} audio_feeder;
+
+static void audio_feeder_init(void)
+{
+    if (audio_feeder.init)
+        return;
+    pthread_mutex_init(&audio_feeder.mutex, NULL);
+    pthread_cond_init(&audio_feeder.cond, NULL);
+    audio_feeder.init = 1;
+}
+
+/// Start of a file, the statistics are per file.
+static void audio_feeder_reset_stats(void)
+{
+    audio_feeder_init();
+    pthread_mutex_lock(&audio_feeder.mutex);
+    audio_feeder.primed     = 0;
+    audio_feeder.starved    = 0;
+    audio_feeder.underruns  = 0;
+    audio_feeder.max_gap    = 0;
+    audio_feeder.min_queued = -1;
+    pthread_mutex_unlock(&audio_feeder.mutex);
+}
+
+/// Make sure the audio thread stays out of the player until audio_feeder_resume().
+static void audio_feeder_pause(void)
+{
+    if (!audio_feeder.running)
+        return;
+    pthread_mutex_lock(&audio_feeder.mutex);
+    audio_feeder.paused++;
+    while (audio_feeder.busy)
+        pthread_cond_wait(&audio_feeder.cond, &audio_feeder.mutex);
+    pthread_mutex_unlock(&audio_feeder.mutex);
+}
+
+static void audio_feeder_resume(void)
+{
+    if (!audio_feeder.running)
+        return;
+    pthread_mutex_lock(&audio_feeder.mutex);
+    if (audio_feeder.paused > 0)
+        audio_feeder.paused--;
+    pthread_cond_broadcast(&audio_feeder.cond);
+    pthread_mutex_unlock(&audio_feeder.mutex);
+}
+
+static void audio_feeder_stop(void)
+{
+    if (!audio_feeder.running)
+        return;
+    pthread_mutex_lock(&audio_feeder.mutex);
+    audio_feeder.quit = 1;
+    pthread_cond_broadcast(&audio_feeder.cond);
+    pthread_mutex_unlock(&audio_feeder.mutex);
+    pthread_join(audio_feeder.thread, NULL);
+    audio_feeder.ds->fetch_lock   = NULL;
+    audio_feeder.ds->fetch_unlock = NULL;
+    // the main loop owns the clock again
+    mpctx->delay        += audio_feeder.written;
+    audio_feeder.written = 0;
+    audio_feeder.running = 0;
+    audio_feeder.paused  = 0;
+    mp_msg(MSGT_CPLAYER, MSGL_V, "Audio thread: %d underruns\n",
+           audio_feeder.underruns);
+}
+
+void audio_feeder_get_stats(audio_feeder_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!audio_feeder.init)
+        return;
+
+    pthread_mutex_lock(&audio_feeder.mutex);
+    stats->running    = audio_feeder.running;
+    stats->underruns  = audio_feeder.underruns;
+    stats->max_gap    = audio_feeder.max_gap / 1000.0;
+    stats->min_queued = audio_feeder.min_queued < 0 ? 0 : audio_feeder.min_queued * 1000.0;
+    pthread_mutex_unlock(&audio_feeder.mutex);
+}
+
 void uninit_player(unsigned int mask)
 {
     mask &= initialized_flags;
 
+    // the decoder thread uses the codec, the demuxer and the VO
+    if (mask & (INITIALIZED_VCODEC | INITIALIZED_DEMUXER | INITIALIZED_VO))
+        frame_queue_stop();
+    // and the audio thread the codec, the demuxer and the ao
+    if (mask & (INITIALIZED_ACODEC | INITIALIZED_DEMUXER | INITIALIZED_AO)) {
+        audio_feeder_stop();
+        audio_feeder.primed = 0;
+    }
+
     mp_msg(MSGT_CPLAYER, MSGL_DBG2, "\n*** uninit(0x%X)\n", mask);
 
     if (mask & INITIALIZED_ACODEC) {
@@ -1749,12 +2072,84 @@ static double written_audio_pts(sh_audio_t *sh_audio, demux_stream_t *d_audio)
     return a_pts;
 }
 
+/// Audio thread, with audio_feeder.mutex held since ao->play().
+static void audio_feeder_publish(double secs)
+{
+    audio_feeder.written    += secs;
+    audio_feeder.written_pts = written_audio_pts(mpctx->sh_audio, mpctx->d_audio);
+}
+
+/// ao delay and the audio written that mpctx->delay doesn't count yet,
+/// read together so that they match.
+static float audio_out_delay(double *pending)
+{
+    float delay;
+    if (!audio_feeder.running) {
+        *pending = 0;
+        return mpctx->audio_out->get_delay();
+    }
+    pthread_mutex_lock(&audio_feeder.mutex);
+    *pending = audio_feeder.written;
+    delay    = mpctx->audio_out->get_delay();
+    pthread_mutex_unlock(&audio_feeder.mutex);
+    return delay;
+}
+
+/// Main thread only: add the audio written by the thread to mpctx->delay,
+/// returns the ao delay at the same time.
+static float audio_feeder_sync(void)
+{
+    float delay;
+    if (!audio_feeder.running)
+        return mpctx->audio_out->get_delay();
+    pthread_mutex_lock(&audio_feeder.mutex);
+    mpctx->delay        += audio_feeder.written;
+    audio_feeder.written = 0;
+    delay = mpctx->audio_out->get_delay();
+    pthread_mutex_unlock(&audio_feeder.mutex);
+    return delay;
+}
+
+/// written_audio_pts() for the main loop, mpctx->delay is synced with it.
+static double audio_written_pts(void)
+{
+    double pts;
+    if (!audio_feeder.running)
+        return written_audio_pts(mpctx->sh_audio, mpctx->d_audio);
+    pthread_mutex_lock(&audio_feeder.mutex);
+    mpctx->delay        += audio_feeder.written;
+    audio_feeder.written = 0;
+    pts = audio_feeder.written_pts;
+    pthread_mutex_unlock(&audio_feeder.mutex);
+    return pts;
+}
+
+/// The audio was reset, with the thread paused.
+static void audio_feeder_flush(void)
+{
+    audio_feeder.primed  = 0;
+    audio_feeder.starved = 0;
+    if (!audio_feeder.running)
+        return;
+    pthread_mutex_lock(&audio_feeder.mutex);
+    audio_feeder.written     = 0;
+    audio_feeder.written_pts = written_audio_pts(mpctx->sh_audio, mpctx->d_audio);
+    audio_feeder.eof         = 0;
+    pthread_mutex_unlock(&audio_feeder.mutex);
+}
+
 // Return pts value corresponding to currently playing audio.
 double playing_audio_pts(sh_audio_t *sh_audio, demux_stream_t *d_audio,
                          const ao_functions_t *audio_out)
 {
-    return written_audio_pts(sh_audio, d_audio) - playback_speed *
-           audio_out->get_delay();
+    double pts;
+    if (!audio_feeder.running)
+        return written_audio_pts(sh_audio, d_audio) - playback_speed *
+               audio_out->get_delay();
+    pthread_mutex_lock(&audio_feeder.mutex);
+    pts = audio_feeder.written_pts - playback_speed * audio_out->get_delay();
+    pthread_mutex_unlock(&audio_feeder.mutex);
+    return pts;
 }
 
 static int is_at_end(MPContext *mpctx, m_time_size_t *end_at, double pts)
@@ -1772,8 +2167,9 @@ static int check_framedrop(double frame_time)
     current_module = "check_framedrop";
     if (mpctx->sh_audio && !mpctx->d_audio->eof) {
         static int dropped_frames;
-        float delay = playback_speed * mpctx->audio_out->get_delay();
-        float d     = delay - mpctx->delay;
+        double pending;
+        float delay = playback_speed * audio_out_delay(&pending);
+        float d     = delay - (mpctx->delay + pending);
         ++total_frame_cnt;
         // we should avoid dropping too many frames in sequence unless we
         // are too late. and we allow 100ms A-V delay here:
@@ -1781,6 +2177,8 @@ static int check_framedrop(double frame_time)
             mpctx->osd_function != OSD_PAUSE) {
             ++drop_frame_cnt;
             ++dropped_frames;
+            if (frame_dropping)
+                telemetry_dropped();
             return frame_dropping;
         } else
             dropped_frames = 0;
@@ -1793,6 +2191,8 @@ static int generate_video_frame(sh_video_t *sh_video, demux_stream_t *d_video)
     unsigned char *start;
     int in_size;
     int hit_eof = 0;
+    int filtered;
+    unsigned int t;
     double pts;
 
     while (1) {
@@ -1804,7 +2204,11 @@ static int generate_video_frame(sh_video_t *sh_video, demux_stream_t *d_video)
         if (vf_output_queued_frame(sh_video->vfilter))
             break;
         current_module = "video_read_frame";
+        t = GetTimer();
+        demux_lock();
         in_size = ds_get_packet_pts(d_video, &start, &pts);
+        demux_unlock();
+        telemetry_stage_add(TELEMETRY_DEMUX, GetTimer() - t);
         if (in_size < 0) {
             // try to extract last frames in case of decoder lag
             in_size = 0;
@@ -1814,13 +2218,21 @@ static int generate_video_frame(sh_video_t *sh_video, demux_stream_t *d_video)
         if (in_size > max_framesize)
             max_framesize = in_size;
         current_module = "decode video";
+        t = GetTimer();
         decoded_frame  = decode_video(sh_video, start, in_size, drop_frame, pts, NULL);
+        telemetry_stage_add(TELEMETRY_DECODE, GetTimer() - t);
         if (decoded_frame) {
-            update_subtitles(sh_video, sh_video->pts, mpctx->d_sub, 0);
-            update_teletext(sh_video, mpctx->demuxer, 0);
-            update_osd_msg();
+            // with the decoder thread, done when the frame is taken for display
+            if (!frame_queue.running) {
+                update_subtitles(sh_video, sh_video->pts, mpctx->d_sub, 0);
+                update_teletext(sh_video, mpctx->demuxer, 0);
+                update_osd_msg();
+            }
             current_module = "filter video";
-            if (filter_video(sh_video, decoded_frame, sh_video->pts))
+            t = GetTimer();
+            filtered = filter_video(sh_video, decoded_frame, sh_video->pts);
+            telemetry_stage_add(TELEMETRY_FILTER, GetTimer() - t);
+            if (filtered)
                 break;
         } else if (drop_frame)
             return -1;
@@ -1834,6 +2246,83 @@ static int generate_video_frame(sh_video_t *sh_video, demux_stream_t *d_video)
 int rtc_fd = -1;
 #endif
 
+// presentation timing, printed with -benchmark
+#define VSYNC_MARGIN 1000 // usecs woken up before the vblank, the VO waits for it
+
+static struct present_stats {
+    unsigned int due;           // GetTimer() when the frame should be flipped
+    int due_valid;
+    unsigned int slept;         // usecs in timing_sleep()
+    int flips;
+    double err_sum;             // flip time - due time, in ms
+    double err_sq;
+    double err_max;             // largest absolute error
+} present;
+
+static void present_reset_stats(void)
+{
+    memset(&present, 0, sizeof(present));
+}
+
+static void present_flipped(void)
+{
+    double err;
+    if (!present.due_valid)
+        return;
+    present.due_valid = 0;
+    err = (int)(GetTimer() - present.due) / 1000.0;
+    present.flips++;
+    present.err_sum += err;
+    present.err_sq  += err * err;
+    if (err < 0)
+        err = -err;
+    if (err > present.err_max)
+        present.err_max = err;
+}
+
+// stages of the frame waiting for the flip
+static mp_telemetry_frame_t telemetry_frame;
+static float telemetry_av_drift;    // last measured, the sync runs after the flip
+
+static void telemetry_flipped(unsigned int flip_usecs)
+{
+    telemetry_frame.time  = GetTimer();
+    telemetry_frame.pts   = video_shown_pts();
+    telemetry_frame.usecs[TELEMETRY_FLIP] = flip_usecs;
+    telemetry_frame.av_drift = mpctx->sh_audio ? telemetry_av_drift : 0;
+    telemetry_frame.cache = -1;
+#ifdef CONFIG_STREAM_CACHE
+    if (stream_cache_size > 0)
+        telemetry_frame.cache = cache_fill_status(mpctx->stream);
+#endif
+    telemetry_push(&telemetry_frame);
+    memset(&telemetry_frame, 0, sizeof(telemetry_frame));
+}
+
+/**
+ * \brief time to add to time_frame so that the flip falls on the vblank
+ *        nearest to the time the frame is due
+ * \return seconds, 0 when the VO doesn't report its vblanks
+ */
+static float vsync_snap(float time_frame)
+{
+    mp_vsync_info_t vsync;
+    int since, due, n;
+
+    if (!vo_config_count ||
+        mpctx->video_out->control(VOCTRL_GET_VSYNC, &vsync) != VO_TRUE ||
+        !vsync.period)
+        return 0;
+    // both relative to that vblank
+    since = GetTimer() - vsync.last;
+    due   = since + (int)(time_frame * 1000000);
+    if (since < 0 || due < 0)
+        return 0;
+    n = (due + vsync.period / 2) / vsync.period;
+    // wake up a bit early, the VO waits for the vblank itself
+    return (n * (int)vsync.period - due - VSYNC_MARGIN) * 0.000001f;
+}
+
 static float timing_sleep(float time_frame)
 {
 #ifdef HAVE_RTC
@@ -2073,11 +2562,11 @@ static void adjust_sync_and_print_status(int between_frames, float timing_error)
              * value here, even a "corrected" one, would be incompatible with
              * autosync mode.)
              */
-            a_pts = written_audio_pts(mpctx->sh_audio, mpctx->d_audio) - mpctx->delay;
+            a_pts = audio_written_pts() - mpctx->delay;
         else
             a_pts = playing_audio_pts(mpctx->sh_audio, mpctx->d_audio, mpctx->audio_out);
 
-        v_pts = mpctx->sh_video->pts;
+        v_pts = video_shown_pts();
 
         {
             static int drop_message;
@@ -2086,6 +2575,7 @@ static void adjust_sync_and_print_status(int between_frames, float timing_error)
             // not a good idea to do A-V correction with with bogus values
             if (a_pts == MP_NOPTS_VALUE || v_pts == MP_NOPTS_VALUE)
                 AV_delay = 0;
+            telemetry_av_drift = AV_delay;
             if (AV_delay > 0.5 && drop_frame_cnt > 50 && drop_message == 0) {
                 ++drop_message;
                 mp_msg(MSGT_AVSYNC, MSGL_WARN, MSGTR_SystemTooSlow);
@@ -2120,6 +2610,31 @@ static void adjust_sync_and_print_status(int between_frames, float timing_error)
     }
 }
 
+/// Before a refill: count the times the ao (nearly) ran dry while playing.
+static void audio_feeder_check(void)
+{
+    unsigned int now = GetTimer();
+    float queued;
+
+    if (audio_feeder.primed && !mpctx->d_audio->eof) {
+        queued = mpctx->audio_out->get_delay();
+        pthread_mutex_lock(&audio_feeder.mutex);
+        if (now - audio_feeder.last_refill > audio_feeder.max_gap)
+            audio_feeder.max_gap = now - audio_feeder.last_refill;
+        if (audio_feeder.min_queued < 0 || queued < audio_feeder.min_queued)
+            audio_feeder.min_queued = queued;
+        // less than one outburst left, the ao may have played silence
+        if (queued < (float)ao_data.outburst / ao_data.bps) {
+            if (!audio_feeder.starved)
+                audio_feeder.underruns++;
+            audio_feeder.starved = 1;
+        } else
+            audio_feeder.starved = 0;
+        pthread_mutex_unlock(&audio_feeder.mutex);
+    }
+    audio_feeder.last_refill = now;
+}
+
 static int fill_audio_out_buffers(void)
 {
     unsigned int t;
@@ -2157,6 +2672,8 @@ static int fill_audio_out_buffers(void)
         usec_sleep(sleep_time * 1000);
     }
 
+    audio_feeder_check();
+
     while (bytes_to_write) {
         int res;
         playsize = bytes_to_write;
@@ -2195,25 +2712,146 @@ static int fill_audio_out_buffers(void)
         // They're obviously badly broken in the way they handle av sync;
         // would not having access to this make them more broken?
         ao_data.pts = ((mpctx->sh_video ? mpctx->sh_video->timer : 0) + mpctx->delay) * 90000.0;
+        // the audio clock has to move with what the ao holds
+        if (audio_feeder.running)
+            pthread_mutex_lock(&audio_feeder.mutex);
         playsize    = mpctx->audio_out->play(sh_audio->a_out_buffer, playsize, playflags);
 
         if (playsize > 0) {
             sh_audio->a_out_buffer_len -= playsize;
             memmove(sh_audio->a_out_buffer, &sh_audio->a_out_buffer[playsize],
                     sh_audio->a_out_buffer_len);
-            mpctx->delay += playback_speed * playsize / (double)ao_data.bps;
+            if (audio_feeder.running)
+                audio_feeder_publish(playback_speed * playsize / (double)ao_data.bps);
+            else
+                mpctx->delay += playback_speed * playsize / (double)ao_data.bps;
+            audio_feeder.primed = 1;
         } else if ((format_change || audio_eof) && mpctx->audio_out->get_delay() < .04) {
             // Sanity check to avoid hanging in case current ao doesn't output
             // partial chunks and doesn't check for AOPLAY_FINAL_CHUNK
             mp_msg(MSGT_CPLAYER, MSGL_WARN, MSGTR_AudioOutputTruncated);
             sh_audio->a_out_buffer_len = 0;
         }
+        if (audio_feeder.running)
+            pthread_mutex_unlock(&audio_feeder.mutex);
     }
     if (format_change) {
+        if (audio_feeder.running) {
+            // the main loop rebuilds the chain, see audio_feeder_poll()
+            pthread_mutex_lock(&audio_feeder.mutex);
+            audio_feeder.reinit = 1;
+            pthread_mutex_unlock(&audio_feeder.mutex);
+        } else {
+            uninit_player(INITIALIZED_AO);
+            reinit_audio_chain();
+        }
+    }
+    return 1;
+}
+
+static void *audio_feeder_thread(void *arg)
+{
+    pthread_mutex_lock(&audio_feeder.mutex);
+    while (!audio_feeder.quit) {
+        struct timeval now;
+        struct timespec ts;
+        int wait_usecs;
+        int ret;
+
+        if (audio_feeder.paused || audio_feeder.eof || audio_feeder.reinit) {
+            pthread_cond_wait(&audio_feeder.cond, &audio_feeder.mutex);
+            continue;
+        }
+        audio_feeder.busy = 1;
+        pthread_mutex_unlock(&audio_feeder.mutex);
+
+        ret = fill_audio_out_buffers();
+
+        pthread_mutex_lock(&audio_feeder.mutex);
+        audio_feeder.busy = 0;
+        if (!ret)
+            audio_feeder.eof = 1;
+        pthread_cond_broadcast(&audio_feeder.cond);
+        if (audio_feeder.quit || audio_feeder.paused)
+            continue;
+
+        // back when about one outburst was played
+        wait_usecs = ao_data.bps ? ao_data.outburst * 1000000LL / ao_data.bps : 10000;
+        if (wait_usecs < 2000)
+            wait_usecs = 2000;
+        if (wait_usecs > 20000)
+            wait_usecs = 20000;
+        gettimeofday(&now, NULL);
+        ts.tv_sec  = now.tv_sec;
+        ts.tv_nsec = (now.tv_usec + wait_usecs) * 1000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&audio_feeder.cond, &audio_feeder.mutex, &ts);
+    }
+    pthread_mutex_unlock(&audio_feeder.mutex);
+    return NULL;
+}
+
+/// With video only, the audio-only loop already sleeps in fill_audio_out_buffers().
+static void audio_feeder_start(void)
+{
+    pthread_attr_t attr;
+
+    if (audio_feeder.running || !mpctx->sh_audio || !mpctx->sh_video ||
+        !(initialized_flags & INITIALIZED_AO))
+        return;
+
+    audio_feeder_init();
+    audio_feeder.quit        = 0;
+    audio_feeder.paused      = 0;
+    audio_feeder.busy        = 0;
+    audio_feeder.eof         = 0;
+    audio_feeder.reinit      = 0;
+    audio_feeder.written     = 0;
+    audio_feeder.written_pts = written_audio_pts(mpctx->sh_audio, mpctx->d_audio);
+    audio_feeder.running     = 1;
+
+    // the decoder thread and the main loop keep reading the other streams,
+    // the demuxer is locked only while d_audio fetches a packet
+    audio_feeder.ds               = mpctx->d_audio;
+    audio_feeder.ds->fetch_lock   = demux_lock;
+    audio_feeder.ds->fetch_unlock = demux_unlock;
+
+    pthread_attr_init(&attr);
+#ifdef XENON
+    pthread_attr_setrole_np(&attr, XENON_THREAD_SERVICE);
+#endif
+    if (pthread_create(&audio_feeder.thread, &attr, audio_feeder_thread, NULL)) {
+        audio_feeder.running = 0;
+        audio_feeder.ds->fetch_lock   = NULL;
+        audio_feeder.ds->fetch_unlock = NULL;
+        mp_msg(MSGT_CPLAYER, MSGL_WARN, "Cannot start the audio thread.\n");
+    } else
+        mp_msg(MSGT_CPLAYER, MSGL_V, "Audio decoded in a separate thread.\n");
+    pthread_attr_destroy(&attr);
+}
+
+/// Main loop side of the audio thread, returns 0 once all audio was written.
+static int audio_feeder_poll(void)
+{
+    int eof, reinit;
+
+    pthread_mutex_lock(&audio_feeder.mutex);
+    eof    = audio_feeder.eof;
+    reinit = audio_feeder.reinit;
+    pthread_mutex_unlock(&audio_feeder.mutex);
+
+    if (reinit) {
+        // started again by the next iteration of the main loop
+        audio_feeder_stop();
         uninit_player(INITIALIZED_AO);
+        demux_lock();
         reinit_audio_chain();
+        demux_unlock();
     }
-    return 1;
+    return !eof;
 }
 
 static void handle_udp_master(double time)
@@ -2230,6 +2868,7 @@ static void handle_udp_master(double time)
 static int sleep_until_update(float *time_frame, float *aq_sleep_time)
 {
     int frame_time_remaining = 0;
+    float vsync_offset        = 0;
     current_module = "calc_sleep_time";
 
 #ifdef CONFIG_NETWORKING
@@ -2246,7 +2885,7 @@ static int sleep_until_update(float *time_frame, float *aq_sleep_time)
     *time_frame -= GetRelativeTime(); // reset timer
 
     if (mpctx->sh_audio && !mpctx->d_audio->eof) {
-        float delay = mpctx->audio_out->get_delay();
+        float delay = audio_feeder_sync();
         mp_dbg(MSGT_AVSYNC, MSGL_DBG2, "delay=%f\n", delay);
 
         if (autosync) {
@@ -2289,9 +2928,18 @@ static int sleep_until_update(float *time_frame, float *aq_sleep_time)
 
     //============================== SLEEP: ===================================
 
+    present.due       = GetTimer() + (int)(*time_frame * 1000000);
+    present.due_valid = !frame_time_remaining;
+    // -display-sync: flip at the vblank nearest to the time the frame is due
+    if (display_sync && !frame_time_remaining)
+        vsync_offset = vsync_snap(*time_frame);
+
     // flag 256 means: libvo driver does its timing (dvb card)
-    if (*time_frame > 0.001 && !(vo_flags & 256))
-        *time_frame = timing_sleep(*time_frame);
+    if (*time_frame + vsync_offset > 0.001 && !(vo_flags & 256)) {
+        unsigned int t = GetTimer();
+        *time_frame    = timing_sleep(*time_frame + vsync_offset) - vsync_offset;
+        present.slept += GetTimer() - t;
+    }
 
     handle_udp_master(mpctx->sh_video->pts);
 
@@ -2302,6 +2950,9 @@ int reinit_video_chain(void)
 {
     sh_video_t *const sh_video = mpctx->sh_video;
     double ar = -1.0;
+    // the vblanks are only known when the VO waits for them
+    if (display_sync)
+        vo_vsync = 1;
     //================== Init VIDEO (codec & libvo) ==========================
     if (!fixed_vo || !(initialized_flags & INITIALIZED_VO)) {
         current_module = "preinit_libvo";
@@ -2420,12 +3071,17 @@ static double update_video(int *blit_frame)
         int drop_frame       = 0;
         int in_size;
         int full_frame;
+        unsigned int t;
 
         do {
             current_module = "video_read_frame";
             frame_time     = sh_video->next_frame_time;
+            t = GetTimer();
+            demux_lock();
             in_size = video_read_frame(sh_video, &sh_video->next_frame_time,
                                        &start, force_fps);
+            demux_unlock();
+            telemetry_stage_add(TELEMETRY_DEMUX, GetTimer() - t);
 #ifdef CONFIG_DVDNAV
             // wait, still frame or EOF
             if (mpctx->stream->type == STREAMTYPE_DVDNAV && in_size < 0) {
@@ -2444,6 +3100,7 @@ static double update_video(int *blit_frame)
                 max_framesize = in_size;  // stats
             drop_frame     = check_framedrop(frame_time);
             current_module = "decode_video";
+            t = GetTimer();
 #ifdef CONFIG_DVDNAV
             full_frame    = 1;
             decoded_frame = mp_dvdnav_restore_smpi(&in_size, &start, decoded_frame);
@@ -2452,8 +3109,10 @@ static double update_video(int *blit_frame)
 #endif
             decoded_frame = decode_video(sh_video, start, in_size, drop_frame,
                                          sh_video->pts, &full_frame);
+            telemetry_stage_add(TELEMETRY_DECODE, GetTimer() - t);
 
-            if (full_frame) {
+            // with the decoder thread, done when the frame is taken for display
+            if (full_frame && !frame_queue.running) {
                 sh_video->timer += frame_time;
                 if (mpctx->sh_audio)
                     mpctx->delay -= frame_time;
@@ -2470,8 +3129,10 @@ static double update_video(int *blit_frame)
         } while (!full_frame);
 
         current_module = "filter_video";
+        t = GetTimer();
         *blit_frame    = (decoded_frame && filter_video(sh_video, decoded_frame,
                                                         sh_video->pts));
+        telemetry_stage_add(TELEMETRY_FILTER, GetTimer() - t);
     } else {
         int res = generate_video_frame(sh_video, mpctx->d_video);
         if (!res)
@@ -2498,14 +3159,200 @@ static double update_video(int *blit_frame)
         if (!frame_time)
             frame_time = sh_video->frametime;
         sh_video->last_pts = sh_video->pts;
-        sh_video->timer   += frame_time;
-        if (mpctx->sh_audio)
-            mpctx->delay -= frame_time;
+        if (!frame_queue.running) {
+            sh_video->timer += frame_time;
+            if (mpctx->sh_audio)
+                mpctx->delay -= frame_time;
+        }
         *blit_frame = res > 0;
     }
+    // -video-stall, compare the audio underruns with and without -audio-thread
+    if (video_stall && *blit_frame) {
+        static int frames;
+        if (++frames >= sh_video->fps) {
+            unsigned int t = GetTimer();
+            frames = 0;
+            while (GetTimer() - t < video_stall) ;
+        }
+    }
     return frame_time;
 }
 
+static void *frame_queue_thread(void *arg)
+{
+    pthread_mutex_lock(&frame_queue.mutex);
+    while (!frame_queue.quit) {
+        frame_queue_entry_t entry;
+        int blit_frame = 0;
+        int queued     = 0;
+        int config_count;
+        unsigned int t;
+
+        if (frame_queue.paused || frame_queue.eof ||
+            frame_queue.count >= vo_frame_queue) {
+            pthread_cond_wait(&frame_queue.cond, &frame_queue.mutex);
+            continue;
+        }
+        frame_queue.busy = 1;
+        pthread_mutex_unlock(&frame_queue.mutex);
+
+        t = GetTimer();
+        config_count = vo_config_count;
+        // same startup handling as the main loop without the thread
+        entry.skip_timing = mpctx->startup_decode_retry > 0;
+        entry.frame_time  = update_video(&blit_frame);
+        while (!blit_frame && mpctx->startup_decode_retry > 0) {
+            update_video(&blit_frame);
+            mpctx->startup_decode_retry--;
+        }
+        mpctx->startup_decode_retry = 0;
+        entry.pts = mpctx->sh_video->pts;
+        if (blit_frame)
+            telemetry_stage_take(&entry.telemetry);
+        if (entry.frame_time >= 0 && blit_frame && vo_config_count)
+            queued = mpctx->video_out->control(VOCTRL_QUEUE_FRAME, NULL) == VO_TRUE;
+        t = GetTimer() - t;
+        if (blit_frame)
+            frame_queue_add_decode_time(t);
+
+        pthread_mutex_lock(&frame_queue.mutex);
+        frame_queue.busy = 0;
+        // a reconfig during the decode emptied the VO queue, the frames
+        // queued before it are gone and their time goes with the next one
+        if (vo_config_count != config_count) {
+            while (frame_queue.count) {
+                frame_queue.pending_time += frame_queue.entries[frame_queue.head].frame_time;
+                frame_queue.head = (frame_queue.head + 1) % FRAME_QUEUE_MAX;
+                frame_queue.count--;
+            }
+        }
+        if (entry.frame_time < 0 || mpctx->sh_video->vf_initialized < 0) {
+            frame_queue.eof = 1;
+        } else {
+            // time of skipped and dropped frames goes with the next one shown
+            frame_queue.pending_time += entry.frame_time;
+            if (queued) {
+                entry.frame_time = frame_queue.pending_time;
+                frame_queue.pending_time = 0;
+                frame_queue.entries[(frame_queue.head + frame_queue.count) % FRAME_QUEUE_MAX] = entry;
+                frame_queue.count++;
+            }
+        }
+        pthread_cond_broadcast(&frame_queue.cond);
+    }
+    pthread_mutex_unlock(&frame_queue.mutex);
+    return NULL;
+}
+
+/**
+ * Hand the decoding over to a thread once the VO is configured, the first
+ * frame is decoded by the main loop as usual.
+ */
+static void frame_queue_start(void)
+{
+    pthread_attr_t attr;
+    int depth = vo_frame_queue;
+
+    if (frame_queue.running || frame_queue.unsupported)
+        return;
+#ifdef CONFIG_DVDNAV
+    // still frames and menus are handled by the main loop
+    if (mpctx->stream->type == STREAMTYPE_DVDNAV) {
+        frame_queue.unsupported = 1;
+        return;
+    }
+#endif
+    if (mpctx->video_out->control(VOCTRL_QUEUE_MODE, &depth) != VO_TRUE) {
+        mp_msg(MSGT_CPLAYER, MSGL_WARN, "Frame queue: not supported by the video output.\n");
+        frame_queue.unsupported = 1;
+        return;
+    }
+
+    frame_queue_init();
+    frame_queue.quit         = 0;
+    frame_queue.paused       = 0;
+    frame_queue.busy         = 0;
+    frame_queue.eof          = 0;
+    frame_queue.head         = 0;
+    frame_queue.count        = 0;
+    frame_queue.pending_time = 0;
+    frame_queue.shown_pts    = mpctx->sh_video->pts;
+    // update_video() checks it to leave the timing to the main loop
+    frame_queue.running      = 1;
+
+    pthread_attr_init(&attr);
+#ifdef XENON
+    // with frame threads it mostly waits for the ffmpeg workers, which
+    // hold the decode slots
+    pthread_attr_setrole_np(&attr, XENON_THREAD_SERVICE);
+#endif
+    if (pthread_create(&frame_queue.thread, &attr, frame_queue_thread, NULL)) {
+        frame_queue.running     = 0;
+        frame_queue.unsupported = 1;
+        depth = 0;
+        mpctx->video_out->control(VOCTRL_QUEUE_MODE, &depth);
+        mp_msg(MSGT_CPLAYER, MSGL_WARN, "Cannot start the frame queue thread.\n");
+    } else
+        mp_msg(MSGT_CPLAYER, MSGL_V, "Frame queue: decoding up to %d frames ahead\n",
+               vo_frame_queue);
+    pthread_attr_destroy(&attr);
+}
+
+/**
+ * Take the next decoded frame for display and do the timing and subtitle
+ * updates update_video() leaves to the main loop with the decoder thread.
+ * \return 1 with a frame to flip, 0 if none is decoded yet, -1 at the end
+ */
+static int frame_queue_get(int *skip_timing)
+{
+    sh_video_t *const sh_video = mpctx->sh_video;
+    frame_queue_entry_t entry;
+
+    pthread_mutex_lock(&frame_queue.mutex);
+    if (!frame_queue.count && !frame_queue.eof) {
+        // let the decoder catch up rather than spinning the main loop
+        struct timeval now;
+        struct timespec ts;
+        gettimeofday(&now, NULL);
+        ts.tv_sec  = now.tv_sec;
+        ts.tv_nsec = (now.tv_usec + 10000) * 1000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&frame_queue.cond, &frame_queue.mutex, &ts);
+        if (!frame_queue.count && !frame_queue.eof)
+            frame_queue.empty++;
+    }
+    if (!frame_queue.count) {
+        int ret = frame_queue.eof ? -1 : 0;
+        pthread_mutex_unlock(&frame_queue.mutex);
+        return ret;
+    }
+    entry = frame_queue.entries[frame_queue.head];
+    frame_queue.head = (frame_queue.head + 1) % FRAME_QUEUE_MAX;
+    frame_queue.count--;
+    pthread_cond_broadcast(&frame_queue.cond);
+    pthread_mutex_unlock(&frame_queue.mutex);
+
+    sh_video->timer += entry.frame_time;
+    if (mpctx->sh_audio)
+        mpctx->delay -= entry.frame_time;
+    vo_fps = sh_video->fps;
+    mpctx->time_frame += entry.frame_time / playback_speed; // for nosound
+    frame_queue.shown_pts = entry.pts;
+
+    demux_lock();
+    update_subtitles(sh_video, entry.pts, mpctx->d_sub, 0);
+    update_teletext(sh_video, mpctx->demuxer, 0);
+    demux_unlock();
+    update_osd_msg();
+
+    telemetry_frame = entry.telemetry;
+    *skip_timing = entry.skip_timing;
+    return 1;
+}
+
 static void pause_loop(void)
 {
     mp_cmd_t *cmd;
@@ -2687,8 +3534,14 @@ static void edl_update(MPContext *mpctx)
 static int seek(MPContext *mpctx, double amount, int style)
 {
     current_module = "seek";
-    if (demux_seek(mpctx->demuxer, amount, audio_delay, style) == 0)
+    frame_queue_pause();
+    audio_feeder_pause();
+    if (demux_seek(mpctx->demuxer, amount, audio_delay, style) == 0) {
+        audio_feeder_resume();
+        frame_queue_resume();
         return -1;
+    }
+    frame_queue_flush();
 
     mpctx->startup_decode_retry = DEFAULT_STARTUP_DECODE_RETRY;
     if (mpctx->sh_video) {
@@ -2702,6 +3555,7 @@ static int seek(MPContext *mpctx, double amount, int style)
         // (which is used by at least vobsub and edl code below) may
         // be completely wrong (probably 0).
         mpctx->sh_video->pts = mpctx->d_video->pts;
+        frame_queue.shown_pts = mpctx->sh_video->pts;
         update_subtitles(mpctx->sh_video, mpctx->sh_video->pts, mpctx->d_sub, 1);
         update_teletext(mpctx->sh_video, mpctx->demuxer, 1);
     }
@@ -2709,6 +3563,7 @@ static int seek(MPContext *mpctx, double amount, int style)
     if (mpctx->sh_audio) {
         current_module = "seek_audio_reset";
         mpctx->audio_out->reset(); // stop audio, throwing away buffered data
+        audio_feeder_flush();
         if (!mpctx->sh_video)
             update_subtitles(NULL, mpctx->sh_audio->pts, mpctx->d_sub, 1);
     }
@@ -2735,6 +3590,8 @@ static int seek(MPContext *mpctx, double amount, int style)
     vout_time_usage    = 0;
     drop_frame_cnt     = 0;
 
+    audio_feeder_resume();
+    frame_queue_resume();
     current_module = NULL;
     return 0;
 }
@@ -3071,6 +3928,15 @@ play_next_file:
     if (audio_driver_list)
         load_per_output_config(mconfig, PROFILE_CFG_AO, audio_driver_list[0]);
 #ifdef XENON
+    // after the profiles, they may set -lavdopts
+    if (thread_bench) {
+        if (!thread_bench_run) {
+            thread_bench_policy  = xenon_thread_policy;
+            thread_bench_threads = lavc_param_threads;
+        }
+        xenon_thread_policy = thread_bench_run / THREAD_BENCH_THREADS;
+        lavc_param_threads  = thread_bench_run % THREAD_BENCH_THREADS + 1;
+    }
     // We must enable getch2 here to be able to interrupt network connection
     // or cache filling
     if (!noconsolecontrols && !slave_mode) {
@@ -3489,6 +4355,47 @@ goto_enable_cache:
         exit_player_with_rc(EXIT_EOF, 0);
     }
 
+    // demuxer throughput, compare with and without -demuxer-thread
+    if (demuxer_bench >= 0) {
+        demux_stream_t *d_video = mpctx->d_video->sh ? mpctx->d_video : NULL;
+        demux_stream_t *d_audio = mpctx->d_audio->sh ? mpctx->d_audio : NULL;
+        unsigned int start, elapsed;
+        int64_t bytes = 0;
+        int packets   = 0;
+        current_module = "demuxer_bench";
+        if (demuxer_thread)
+            demux_thread_start(mpctx->demuxer);
+        start = GetTimer();
+        while (d_video || d_audio) {
+            demux_stream_t *ds = d_video;
+            unsigned char *packet;
+            int in_size;
+            unsigned int t;
+            // interleave like playback does, by timestamp
+            if (!ds || (d_audio && ds_get_next_pts(d_audio) < ds_get_next_pts(d_video)))
+                ds = d_audio;
+            in_size = ds_get_packet(ds, &packet);
+            if (in_size < 0 || ds->eof) {
+                if (ds == d_video)
+                    d_video = NULL;
+                else
+                    d_audio = NULL;
+                continue;
+            }
+            packets++;
+            bytes += in_size;
+            // busy wait, a decoder keeps the CPU busy as well
+            t = GetTimer();
+            while (GetTimer() - t < demuxer_bench) ;
+        }
+        elapsed = GetTimer() - start;
+        mp_msg(MSGT_CPLAYER, MSGL_INFO,
+               "DEMUXER BENCH (%s thread): %d packets, %"PRId64" bytes in %.3fs, %.1f packets/s\n",
+               mpctx->demuxer->thread ? "with" : "without", packets, bytes,
+               elapsed / 1000000.0, elapsed ? packets * 1000000.0 / elapsed : 0.0);
+        exit_player_with_rc(EXIT_EOF, 0);
+    }
+
     mpctx->sh_audio = mpctx->d_audio->sh;
     mpctx->sh_video = mpctx->d_video->sh;
 
@@ -3713,6 +4620,14 @@ goto_enable_cache:
         }
 #endif
 
+        if (demuxer_thread)
+            demux_thread_start(mpctx->demuxer);
+
+        frame_queue_reset_stats();
+        audio_feeder_reset_stats();
+        present_reset_stats();
+        telemetry_reset();
+
         while (!mpctx->eof) {
             float aq_sleep_time = 0;
 
@@ -3725,16 +4640,29 @@ goto_enable_cache:
             if (!mpctx->sh_audio && mpctx->d_audio->sh) {
                 mpctx->sh_audio     = mpctx->d_audio->sh;
                 mpctx->sh_audio->ds = mpctx->d_audio;
+                demux_lock();
                 reinit_audio_chain();
+                demux_unlock();
             }
 
 /*========================== PLAY AUDIO ============================*/
 
-            if (mpctx->sh_audio)
-                if (!fill_audio_out_buffers())
+            if (mpctx->sh_audio) {
+                int audio_left;
+                if (audio_thread)
+                    audio_feeder_start();
+                if (audio_feeder.running)
+                    audio_left = audio_feeder_poll();
+                else {
+                    demux_lock();
+                    audio_left = fill_audio_out_buffers();
+                    demux_unlock();
+                }
+                if (!audio_left)
                     // at eof, all audio at least written to ao
                     if (!mpctx->sh_video)
                         mpctx->eof = PT_NEXT_ENTRY;
+            }
 
             if (!mpctx->sh_video) {
                 // handle audio-only case:
@@ -3762,7 +4690,32 @@ goto_enable_cache:
                 vo_pts = mpctx->sh_video->timer * 90000.0;
                 vo_fps = mpctx->sh_video->fps;
 
-                if (!mpctx->num_buffered_frames) {
+                if (vo_frame_queue && !mpctx->num_buffered_frames && vo_config_count)
+                    frame_queue_start();
+
+                if (frame_queue.running) {
+                    if (!mpctx->num_buffered_frames) {
+                        int ret = frame_queue_get(&skip_timing);
+                        if (ret < 0) {
+                            blit_frame = 0;
+                            if (mpctx->sh_video->vf_initialized < 0) {
+                                mp_msg(MSGT_CPLAYER, MSGL_FATAL, MSGTR_NotInitializeVOPorVO);
+                                mpctx->eof = 1;
+                                goto goto_next_file;
+                            }
+                            // only stop playing when audio is at end as well
+                            if (!mpctx->sh_audio || mpctx->d_audio->eof)
+                                mpctx->eof = 1;
+                        } else if (ret == 0) {
+                            // nothing to show yet, don't touch the timing
+                            blit_frame           = 0;
+                            skip_timing          = 1;
+                            frame_time_remaining = 1;
+                        } else
+                            mpctx->num_buffered_frames++;
+                    }
+                } else if (!mpctx->num_buffered_frames) {
+                    unsigned int t = GetTimer();
                     double frame_time = update_video(&blit_frame);
                     while (!blit_frame && mpctx->startup_decode_retry > 0) {
                         double delay = mpctx->delay;
@@ -3773,6 +4726,10 @@ goto_enable_cache:
                         mpctx->startup_decode_retry--;
                     }
                     mpctx->startup_decode_retry = 0;
+                    if (blit_frame) {
+                        frame_queue_add_decode_time(GetTimer() - t);
+                        telemetry_stage_take(&telemetry_frame);
+                    }
                     mp_dbg(MSGT_AVSYNC, MSGL_DBG2, "*** ftime=%5.3f ***\n", frame_time);
                     if (mpctx->sh_video->vf_initialized < 0) {
                         mp_msg(MSGT_CPLAYER, MSGL_FATAL, MSGTR_NotInitializeVOPorVO);
@@ -3821,8 +4778,13 @@ goto_enable_cache:
                     }
                 }
 
-                if (!skip_timing)
+                if (!skip_timing) {
                     frame_time_remaining = sleep_until_update(&mpctx->time_frame, &aq_sleep_time);
+                    // time_frame is left negative when the frame is already due
+                    if (!frame_time_remaining && blit_frame &&
+                        mpctx->time_frame < -0.5 * mpctx->sh_video->frametime)
+                        frame_queue.late++;
+                }
 
 //====================== FLIP PAGE (VIDEO BLT): =========================
 
@@ -3834,6 +4796,8 @@ goto_enable_cache:
                         if (vo_config_count)
                             mpctx->video_out->flip_page();
                         mpctx->num_buffered_frames--;
+                        present_flipped();
+                        telemetry_flipped(GetTimer() - t2);
 
                         vout_time_usage += (GetTimer() - t2) * 0.000001;
                     }
@@ -3868,7 +4832,7 @@ goto_enable_cache:
                 }
 
                 if (!frame_time_remaining && is_at_end(mpctx, &end_at,
-                                                       mpctx->sh_video->pts))
+                                                       video_shown_pts()))
                     mpctx->eof = PT_NEXT_ENTRY;
             } // end if(mpctx->sh_video)
 
@@ -3902,7 +4866,13 @@ goto_enable_cache:
 
             if (mpctx->osd_function == OSD_PAUSE) {
                 mpctx->was_paused = 1;
+                frame_queue_pause();
+                audio_feeder_pause();
                 pause_loop();
+                // the ao was paused, no refill gap
+                audio_feeder.primed = 0;
+                audio_feeder_resume();
+                frame_queue_resume();
             }
 
             // handle -sstep
@@ -3921,7 +4891,11 @@ goto_enable_cache:
                 mp_cmd_t *cmd;
                 int brk_cmd = 0;
                 while (!brk_cmd && (cmd = mp_input_get_cmd(0, 0, 0)) != NULL) {
+                    frame_queue_pause();
+                    audio_feeder_pause();
                     brk_cmd = run_command(mpctx, cmd);
+                    audio_feeder_resume();
+                    frame_queue_resume();
                     if (cmd->id == MP_CMD_EDL_LOADFILE) {
                         free(edl_filename);
                         edl_filename = strdup(cmd->args[0].v.s);
@@ -3932,8 +4906,11 @@ goto_enable_cache:
                                    cmd->args[0].v.s);
                     }
                     mp_cmd_free(cmd);
-                    if (brk_cmd == 2)
+                    if (brk_cmd == 2) {
+                        frame_queue_stop();
+                        audio_feeder_stop();
                         goto goto_enable_cache;
+                    }
                 }
             }
             mpctx->was_paused = 0;
@@ -4040,11 +5017,60 @@ goto_next_file:  // don't jump here after ao/vo/getch initialization!
                    100 * drop_frame_cnt / total_frame_cnt,
                    total_frame_cnt,
                    (total_time_usage > 0.5) ? (total_frame_cnt / total_time_usage) : 0);
+        if (present.flips) {
+            double mean = present.err_sum / present.flips;
+            double var  = present.err_sq / present.flips - mean * mean;
+            mp_msg(MSGT_CPLAYER, MSGL_INFO, "BENCHMARKp: %s: slept %.3fs at low priority (%.1f%%), flip vs. due mean %.2f ms, jitter %.2f ms, max %.2f ms\n",
+                   display_sync ? "display sync" : "timer", present.slept * 0.000001,
+                   total_time_usage > 0.0 ? 100.0 * present.slept * 0.000001 / total_time_usage : 0.0,
+                   mean, var > 0 ? sqrt(var) : 0.0, present.err_max);
+        }
+#ifdef XENON
+        if (mpctx->sh_video) {
+            double fps = frame_queue.decode_secs > 0 ? frame_queue.decoded / frame_queue.decode_secs : 0;
+            mp_msg(MSGT_CPLAYER, MSGL_INFO, "BENCHMARKt: thread policy %s, %d decoding threads: %d frames decoded at %.2f fps\n",
+                   thread_policy_names[xenon_thread_policy], lavc_param_threads,
+                   frame_queue.decoded, fps);
+            if (thread_bench)
+                thread_bench_fps[thread_bench_run] = fps;
+        }
+#endif
+    }
+
+    if (mpctx->sh_audio && (benchmark || video_stall)) {
+        audio_feeder_stats_t stats;
+        audio_feeder_get_stats(&stats);
+        mp_msg(MSGT_CPLAYER, MSGL_INFO, "BENCHMARKa: audio %s thread, %d underruns, refill gap max %.1f ms, ao min %.1f ms\n",
+               stats.running ? "with" : "without", stats.underruns,
+               stats.max_gap, stats.min_queued);
     }
 
+    // rewritten for every file, what's left is the last one played
+    if (telemetry_csv && mpctx->sh_video)
+        telemetry_dump_csv(telemetry_csv);
+
     // time to uninit all, except global stuff:
     uninit_player(INITIALIZED_ALL - (INITIALIZED_GUI + INITIALIZED_INPUT + (fixed_vo ? INITIALIZED_VO : 0)));
 
+#ifdef XENON
+    if (thread_bench && mpctx->eof == PT_NEXT_ENTRY) {
+        if (++thread_bench_run < XENON_POLICY_NB * THREAD_BENCH_THREADS) {
+            // same file, next policy or thread count
+            mpctx->eof = 0;
+            goto play_next_file;
+        }
+        mp_msg(MSGT_CPLAYER, MSGL_INFO, "BENCHMARKt: decode fps   threads=1  threads=2  threads=3\n");
+        for (i = 0; i < XENON_POLICY_NB; i++) {
+            double *fps = thread_bench_fps + i * THREAD_BENCH_THREADS;
+            mp_msg(MSGT_CPLAYER, MSGL_INFO, "BENCHMARKt: %-10s %10.2f %10.2f %10.2f\n",
+                   thread_policy_names[i], fps[0], fps[1], fps[2]);
+        }
+        thread_bench_run    = 0;
+        xenon_thread_policy = thread_bench_policy;
+        lavc_param_threads  = thread_bench_threads;
+    }
+#endif
+
     if (mpctx->eof == PT_NEXT_ENTRY || mpctx->eof == PT_PREV_ENTRY) {
         mpctx->eof = mpctx->eof == PT_NEXT_ENTRY ? 1 : -1;
         if (play_tree_iter_step(mpctx->playtree_iter, mpctx->play_tree_step, 0) == PLAY_TREE_ITER_ENTRY) {
@@ -4,6 +4,8 @@
 #include <math.h>
 #include <time/time.h>
 
+#include "timer.h"
+
 long long llrint(double x) {
 
 	union {
@@ -47,8 +49,8 @@ void waitpid() {
 
 }
 
+// udelay() spins at full priority, see usec_sleep()
 int usleep(useconds_t __useconds) {
-	udelay(__useconds);
-	return 0;
+	return usec_sleep(__useconds);
 }
 
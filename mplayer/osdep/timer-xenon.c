@@ -21,95 +21,49 @@
 
 #include <unistd.h>
 #include <stdlib.h>
-#include <time.h>
-#include <sys/time.h>
+#include <stdint.h>
 #include "config.h"
 #include "timer.h"
+#include "libxenon_miss/xenon_pthread.h"
 
 #include <ppc/timebase.h>
-#include <time/time.h>
-#if 0
-const char timer_name[] = "Xenon native";
 
-int usec_sleep(int usec_delay)
-{
-	udelay(usec_delay);
-	return 0;
-}
-
-static inline uint64_t xenon_time(){
-	return mftb()/PPC_TIMEBASE_FREQ;
-}
-
-// Returns current time in microseconds
-unsigned int GetTimer(void)
-{
-	return mftb()/(PPC_TIMEBASE_FREQ/1000000);
-}
-
-// Returns current time in milliseconds
-unsigned int GetTimerMS(void)
-{
-	return mftb()/(PPC_TIMEBASE_FREQ/1000);
-}
-
-static unsigned int RelativeTime = 0;
-
-// Returns time spent between now and last call in seconds
-float GetRelativeTime(void)
-{
-    unsigned int t,r;
-    t = GetTimer();
-    //t *= 16; printf("time = %ud\n", t);
-    r = t - RelativeTime;
-    RelativeTime = t;
-    return (float) r * 0.000001F;
-}
+const char timer_name[] = "Xenon timebase";
 
-// Initialize timer, must be called at least once at start
-void InitTimer(void)
+// The timebase counts from boot and never goes back, unlike the time of day.
+static unsigned int tb_to_usec(uint64_t tb)
 {
-    GetRelativeTime();
+    return tb / PPC_TIMEBASE_FREQ * 1000000 +
+           tb % PPC_TIMEBASE_FREQ * 1000000 / PPC_TIMEBASE_FREQ;
 }
-#else
-
-const char timer_name[] =
-#ifdef HAVE_NANOSLEEP
-    "nanosleep()";
-#else
-    "usleep()";
-#endif
 
+// Waits at low smt priority, the core is left to the sibling hardware thread
+// (decoder or audio workers) instead of spinning in udelay().
 int usec_sleep(int usec_delay)
 {
-#ifdef HAVE_NANOSLEEP
-    struct timespec ts;
-    ts.tv_sec  =  usec_delay / 1000000;
-    ts.tv_nsec = (usec_delay % 1000000) * 1000;
-    return nanosleep(&ts, NULL);
-#else
-    return usleep(usec_delay);
-#endif
+    uint64_t end;
+    if (usec_delay <= 0)
+        return 0;
+    end = mftb() + (uint64_t)usec_delay * PPC_TIMEBASE_FREQ / 1000000;
+    xenon_smt_low();
+    while ((int64_t)(mftb() - end) < 0)
+        ;
+    xenon_smt_medium();
+    return 0;
 }
 
 // Returns current time in microseconds
 unsigned int GetTimer(void)
 {
-    struct timeval tv;
-    //float s;
-    gettimeofday(&tv,NULL);
-    //s = tv.tv_usec; s *= 0.000001; s += tv.tv_sec;
-    return tv.tv_sec * 1000000 + tv.tv_usec;
+    return tb_to_usec(mftb());
 }
 
 // Returns current time in milliseconds
 unsigned int GetTimerMS(void)
 {
-    struct timeval tv;
-    //float s;
-    gettimeofday(&tv,NULL);
-    //s = tv.tv_usec; s *= 0.000001; s += tv.tv_sec;
-    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    uint64_t tb = mftb();
+    return tb / PPC_TIMEBASE_FREQ * 1000 +
+           tb % PPC_TIMEBASE_FREQ * 1000 / PPC_TIMEBASE_FREQ;
 }
 
 static unsigned int RelativeTime = 0;
@@ -119,7 +73,6 @@ float GetRelativeTime(void)
 {
     unsigned int t,r;
     t = GetTimer();
-    //t *= 16; printf("time = %ud\n", t);
     r = t - RelativeTime;
     RelativeTime = t;
     return (float) r * 0.000001F;
@@ -130,5 +83,3 @@ void InitTimer(void)
 {
     GetRelativeTime();
 }
-
-#endif
\ No newline at end of file
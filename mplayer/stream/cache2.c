@@ -30,6 +30,12 @@
 #define FILL_USLEEP_TIME 50000
 #define PREFILL_SLEEP_TIME 200
 #define CONTROL_SLEEP_TIME 0
+// Data dropped by a far seek is kept in blocks of this size so that jumping
+// back (e.g. to mdat after reading a trailing moov) does not re-read it.
+#define SEG_BLOCK_SIZE (64 * 1024)
+#define MAX_SEGS 64
+// disjoint ranges remembered to account for bytes read twice
+#define MAX_READ_RANGES 32
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,7 +57,10 @@ static void ThreadProc( void *s );
 static void ThreadProc( void *s );
 #elif defined(PTHREAD_CACHE)
 #include <pthread.h>
+#include <sys/time.h>
 static void *ThreadProc(void *s);
+// reader and filler wake each other instead of polling
+#define COND_CACHE 1
 #else
 #include <sys/wait.h>
 #define FORKED_CACHE 1
@@ -59,6 +68,9 @@ static void *ThreadProc(void *s);
 #ifndef FORKED_CACHE
 #define FORKED_CACHE 0
 #endif
+#ifndef COND_CACHE
+#define COND_CACHE 0
+#endif
 
 #include "mp_msg.h"
 #include "help_mp.h"
@@ -67,6 +79,12 @@ static void *ThreadProc(void *s);
 #include "cache2.h"
 #include "mp_global.h"
 
+typedef struct {
+  int64_t pos;         // file position of the first byte, -1 if unused
+  int len;
+  unsigned last_use;
+} cache_seg_t;
+
 typedef struct {
   // constats:
   unsigned char *buffer;      // base pointer of the allocated buffer memory
@@ -97,13 +115,75 @@ typedef struct {
   volatile int control_res;
   volatile double stream_time_length;
   volatile double stream_time_pos;
+  // retained ranges, only touched by the filler:
+  unsigned char *seg_buffer;   // num_segs blocks of SEG_BLOCK_SIZE
+  int num_segs;
+  cache_seg_t segs[MAX_SEGS];
+  unsigned seg_tick;
+  int seg_resync;              // stream pos is behind after a copy from a segment
+  int64_t last_read;           // reader position seen by the previous fill
+  int64_t read_ranges[MAX_READ_RANGES][2];
+  int num_read_ranges;
+  // statistics:
+  unsigned stat_seeks;         // fills outside the buffered range
+  unsigned stat_seek_hits;     // ... which found their data in a retained segment
+  int64_t stat_bytes_read;     // bytes read from the stream
+  int64_t stat_bytes_reread;   // ... which had been read before
+  int64_t stat_bytes_retained; // bytes filled from retained segments
+#if COND_CACHE
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t fill_cond;    // filler waits here for read_seq to change
+  pthread_cond_t read_cond;    // reader waits here for fill_seq to change
+  volatile unsigned read_seq;  // bumped when data was consumed, on seek and control
+  volatile unsigned fill_seq;  // bumped when data arrived or a control finished
+#endif
 } cache_vars_t;
 
+#if COND_CACHE
+/**
+ * Bump *seq and wake up the other side.
+ * Waiters compare against a sequence value sampled before they checked
+ * their condition, so a notification can never get lost in between.
+ */
+static void cache_notify(cache_vars_t *s, pthread_cond_t *cond, volatile unsigned *seq)
+{
+  pthread_mutex_lock(&s->mutex);
+  (*seq)++;
+  pthread_cond_broadcast(cond);
+  pthread_mutex_unlock(&s->mutex);
+}
+
+/**
+ * Wait until *seq differs from seen, at most ms milliseconds.
+ */
+static void cache_wait(cache_vars_t *s, pthread_cond_t *cond, volatile unsigned *seq,
+                       unsigned seen, int ms)
+{
+  struct timeval now;
+  struct timespec abstime;
+  gettimeofday(&now, NULL);
+  abstime.tv_sec  = now.tv_sec + ms / 1000;
+  abstime.tv_nsec = (now.tv_usec + (ms % 1000) * 1000) * 1000;
+  if (abstime.tv_nsec >= 1000000000) {
+    abstime.tv_sec++;
+    abstime.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&s->mutex);
+  if (*seq == seen)
+    pthread_cond_timedwait(cond, &s->mutex, &abstime);
+  pthread_mutex_unlock(&s->mutex);
+}
+#endif
+
 static void cache_wakeup(stream_t *s)
 {
 #if FORKED_CACHE
   // signal process to wake up immediately
 //  kill(s->cache_pid, SIGUSR1);
+#elif COND_CACHE
+  cache_vars_t *c = s->cache_data;
+  cache_notify(c, &c->fill_cond, &c->read_seq);
 #endif
 }
 
@@ -113,6 +193,103 @@ static void cache_flush(cache_vars_t *s)
   s->min_filepos=s->max_filepos=s->read_filepos; // drop cache content :(
 }
 
+/**
+ * Copy len bytes starting at filepos out of the ring buffer,
+ * the range must be inside [min_filepos, max_filepos].
+ */
+static void ring_get(cache_vars_t *s, unsigned char *dst, int64_t filepos, int len)
+{
+  int64_t pos = filepos - s->offset;
+  int first;
+  if (pos < 0) pos += s->buffer_size; else
+  if (pos >= s->buffer_size) pos -= s->buffer_size;
+  first = FFMIN(len, s->buffer_size - pos);
+  memcpy(dst, &s->buffer[pos], first);
+  memcpy(dst + first, s->buffer, len - first);
+}
+
+static int seg_find(cache_vars_t *s, int64_t filepos)
+{
+  int i;
+  for (i = 0; i < s->num_segs; i++)
+    if (s->segs[i].pos >= 0 && filepos >= s->segs[i].pos &&
+        filepos < s->segs[i].pos + s->segs[i].len)
+      return i;
+  return -1;
+}
+
+static void seg_drop_all(cache_vars_t *s)
+{
+  int i;
+  for (i = 0; i < s->num_segs; i++)
+    s->segs[i].pos = -1;
+}
+
+/**
+ * Keep [from, max_filepos) in the least recently used segments before the
+ * ring gets flushed. At most half the segments are taken per call so that
+ * the previous jump target (typically the file header) survives.
+ */
+static void seg_retain(cache_vars_t *s, int64_t from)
+{
+  int i, n;
+  int64_t end;
+  if (!s->num_segs) return;
+  if (from < s->min_filepos) from = s->min_filepos;
+  end = FFMIN(s->max_filepos, from + (int64_t)(s->num_segs / 2) * SEG_BLOCK_SIZE);
+  if (from >= end) return;
+  // anything overlapping is stale now
+  for (i = 0; i < s->num_segs; i++)
+    if (s->segs[i].pos >= 0 && s->segs[i].pos < end &&
+        s->segs[i].pos + s->segs[i].len > from)
+      s->segs[i].pos = -1;
+  for (n = 0; from < end; n++) {
+    int len = FFMIN(end - from, SEG_BLOCK_SIZE);
+    int lru = 0;
+    for (i = 1; i < s->num_segs; i++) {
+      if (s->segs[lru].pos < 0) break;
+      if (s->segs[i].pos < 0 || s->segs[i].last_use < s->segs[lru].last_use)
+        lru = i;
+    }
+    ring_get(s, s->seg_buffer + (int64_t)lru * SEG_BLOCK_SIZE, from, len);
+    s->segs[lru].pos = from;
+    s->segs[lru].len = len;
+    s->segs[lru].last_use = ++s->seg_tick;
+    from += len;
+  }
+}
+
+/**
+ * Remember that [pos, pos+len) was read from the stream.
+ * \return number of those bytes that had already been read before
+ */
+static int64_t note_read(cache_vars_t *s, int64_t pos, int len)
+{
+  int64_t start = pos, end = pos + len, overlap = 0;
+  int i, n = 0;
+  for (i = 0; i < s->num_read_ranges; i++) {
+    int64_t r0 = s->read_ranges[i][0], r1 = s->read_ranges[i][1];
+    if (r1 < start || r0 > end) {
+      s->read_ranges[n][0] = r0;
+      s->read_ranges[n][1] = r1;
+      n++;
+      continue;
+    }
+    overlap += FFMAX(0, FFMIN(r1, pos + len) - FFMAX(r0, pos));
+    start = FFMIN(start, r0);
+    end = FFMAX(end, r1);
+  }
+  // out of slots, sacrifice the oldest one
+  if (n == MAX_READ_RANGES) {
+    memmove(s->read_ranges[0], s->read_ranges[1], (n - 1) * sizeof(s->read_ranges[0]));
+    n--;
+  }
+  s->read_ranges[n][0] = start;
+  s->read_ranges[n][1] = end;
+  s->num_read_ranges = n + 1;
+  return overlap;
+}
+
 static int cache_read(cache_vars_t *s, unsigned char *buf, int size)
 {
   int total=0;
@@ -120,6 +297,9 @@ static int cache_read(cache_vars_t *s, unsigned char *buf, int size)
   int64_t last_max = s->max_filepos;
   while(size>0){
     int64_t pos,newb,len;
+#if COND_CACHE
+    unsigned seen = s->fill_seq;
+#endif
 
   //printf("CACHE2_READ: 0x%X <= 0x%X <= 0x%X  \n",s->min_filepos,s->read_filepos,s->max_filepos);
 
@@ -134,7 +314,12 @@ static int cache_read(cache_vars_t *s, unsigned char *buf, int size)
 	    sleep_count = 0;
 	}
 	// waiting for buffer fill...
+#if COND_CACHE
+	cache_wait(s, &s->read_cond, &s->fill_seq, seen, READ_SLEEP_TIME);
+	if (stream_check_interrupt(0)) {
+#else
 	if (stream_check_interrupt(READ_SLEEP_TIME)) {
+#endif
 	    s->eof = 1;
 	    break;
 	}
@@ -168,6 +353,11 @@ static int cache_read(cache_vars_t *s, unsigned char *buf, int size)
     total+=len;
 
   }
+#if COND_CACHE
+  // there is room for the filler again
+  if (total)
+    cache_notify(s, &s->fill_cond, &s->read_seq);
+#endif
   return total;
 }
 
@@ -177,22 +367,35 @@ static int cache_fill(cache_vars_t *s)
   int64_t read=s->read_filepos;
   int read_chunk;
   int wraparound_copy = 0;
+  int seg;
 
   if(read<s->min_filepos || read>s->max_filepos){
       // seek...
       mp_msg(MSGT_CACHE,MSGL_DBG2,"Out of boundaries... seeking to 0x%"PRIX64"  \n",read);
       // drop cache contents only if seeking backward or too much fwd.
-      // This is also done for on-disk files, since it loses the backseek cache.
-      // That in turn can cause major bandwidth increase and performance
-      // issues with e.g. mov or badly interleaved files
+      // The part the reader was at is kept in the retained segments
+      // so that mov files with a trailing index or badly interleaved
+      // files do not throw the backseek cache away on every jump.
       if(read<s->min_filepos || read>=s->max_filepos+s->seek_limit)
       {
+        int hit = seg_find(s, read) >= 0;
+        s->stat_seeks++;
+        s->stat_seek_hits += hit;
+        seg_retain(s, s->last_read);
         cache_flush(s);
         if(s->stream->eof) stream_reset(s->stream);
-        stream_seek_internal(s->stream,read);
+        // the fill copies from the segment, the stream only gets
+        // sought once the reader runs past it
+        if (hit)
+          s->seg_resync = 1;
+        else {
+          stream_seek_internal(s->stream,read);
+          s->seg_resync = 0;
+        }
         mp_msg(MSGT_CACHE,MSGL_DBG2,"Seek done. new pos: 0x%"PRIX64"  \n",(int64_t)stream_tell(s->stream));
       }
   }
+  s->last_read = read;
 
   // calc number of back-bytes:
   back=read - s->min_filepos;
@@ -241,14 +444,35 @@ static int cache_fill(cache_vars_t *s)
   s->min_filepos=read-back; // avoid seeking-back to temp area...
 #endif
 
-  if (wraparound_copy) {
+  seg = seg_find(s, s->max_filepos);
+  if (seg >= 0) {
+    cache_seg_t *sg = &s->segs[seg];
+    const unsigned char *src = s->seg_buffer + (int64_t)seg * SEG_BLOCK_SIZE +
+                               (s->max_filepos - sg->pos);
     int to_copy;
-    len = stream_read_internal(s->stream, s->stream->buffer, space);
+    len = FFMIN(space, sg->pos + sg->len - s->max_filepos);
     to_copy = FFMIN(len, s->buffer_size-pos);
-    memcpy(s->buffer + pos, s->stream->buffer, to_copy);
-    memcpy(s->buffer, s->stream->buffer + to_copy, len - to_copy);
-  } else
-  len = stream_read_internal(s->stream, &s->buffer[pos], space);
+    memcpy(s->buffer + pos, src, to_copy);
+    memcpy(s->buffer, src + to_copy, len - to_copy);
+    sg->last_use = ++s->seg_tick;
+    s->stat_bytes_retained += len;
+    s->seg_resync = 1;
+  } else {
+    if (s->seg_resync) {
+      stream_seek_internal(s->stream, s->max_filepos);
+      s->seg_resync = 0;
+    }
+    if (wraparound_copy) {
+      int to_copy;
+      len = stream_read_internal(s->stream, s->stream->buffer, space);
+      to_copy = FFMIN(len, s->buffer_size-pos);
+      memcpy(s->buffer + pos, s->stream->buffer, to_copy);
+      memcpy(s->buffer, s->stream->buffer + to_copy, len - to_copy);
+    } else
+      len = stream_read_internal(s->stream, &s->buffer[pos], space);
+    s->stat_bytes_read += len;
+    s->stat_bytes_reread += note_read(s, s->max_filepos, len);
+  }
   s->eof= !len;
 
   s->max_filepos+=len;
@@ -274,6 +498,9 @@ static int cache_execute_control(cache_vars_t *s) {
     s->stream_time_pos = MP_NOPTS_VALUE;
     s->control_res = STREAM_UNSUPPORTED;
     s->control = -1;
+#if COND_CACHE
+    cache_notify(s, &s->read_cond, &s->fill_seq);
+#endif
     return !quit;
   }
   if (GetTimerMS() - last > 99) {
@@ -327,10 +554,16 @@ static int cache_execute_control(cache_vars_t *s) {
     s->read_filepos = s->stream->pos;
     s->eof = s->stream->eof;
     cache_flush(s);
+    // positions may mean something else now (title/chapter change)
+    seg_drop_all(s);
+    s->seg_resync = 0;
   } else if (needs_flush &&
              (old_pos != s->stream->pos || old_eof != s->stream->eof))
     mp_msg(MSGT_STREAM, MSGL_ERR, "STREAM_CTRL changed stream pos but returned error, this is not allowed!\n");
   s->control = -1;
+#if COND_CACHE
+  cache_notify(s, &s->read_cond, &s->fill_seq);
+#endif
   return 1;
 }
 
@@ -373,6 +606,11 @@ static cache_vars_t* cache_init(int64_t size,int sector){
   s->back_size=s->buffer_size/2;
 #if FORKED_CACHE
   s->ppid = getpid();
+#endif
+#if COND_CACHE
+  pthread_mutex_init(&s->mutex, NULL);
+  pthread_cond_init(&s->fill_cond, NULL);
+  pthread_cond_init(&s->read_cond, NULL);
 #endif
   return s;
 }
@@ -382,6 +620,9 @@ void cache_uninit(stream_t *s) {
   if(s->cache_pid) {
 #if !FORKED_CACHE
     cache_do_control(s, -2, NULL);
+#if COND_CACHE
+    pthread_join(c->thread, NULL);
+#endif
 #else
 //    kill(s->cache_pid,SIGKILL);
     waitpid(s->cache_pid,NULL,0);
@@ -389,6 +630,18 @@ void cache_uninit(stream_t *s) {
     s->cache_pid = 0;
   }
   if(!c) return;
+  mp_msg(MSGT_CACHE, MSGL_V, "Cache: %u far seeks, %u hit retained data (%.1f%%), "
+         "%"PRId64" bytes read, %"PRId64" re-read, %"PRId64" from retained data\n",
+         c->stat_seeks, c->stat_seek_hits,
+         c->stat_seeks ? 100.0 * c->stat_seek_hits / c->stat_seeks : 0.0,
+         c->stat_bytes_read, c->stat_bytes_reread, c->stat_bytes_retained);
+  if (c->seg_buffer)
+    shared_free(c->seg_buffer, (int64_t)c->num_segs * SEG_BLOCK_SIZE);
+#if COND_CACHE
+  pthread_cond_destroy(&c->read_cond);
+  pthread_cond_destroy(&c->fill_cond);
+  pthread_mutex_destroy(&c->mutex);
+#endif
   shared_free(c->buffer, c->buffer_size);
   c->buffer = NULL;
   c->stream = NULL;
@@ -410,6 +663,20 @@ static void dummy_sighandler(int x) {
  * Main loop of the cache process or thread.
  */
 static void cache_mainloop(cache_vars_t *s) {
+#if COND_CACHE
+    do {
+        unsigned seen = s->read_seq;
+        if (!cache_fill(s)) {
+            // let a reader waiting at the end of the stream see eof at once
+            if (s->eof)
+                cache_notify(s, &s->read_cond, &s->fill_seq);
+            // idle until the reader consumes, seeks or sends a control,
+            // the timeout keeps the time/eof polling going
+            cache_wait(s, &s->fill_cond, &s->read_seq, seen, FILL_USLEEP_TIME / 1000);
+        } else
+            cache_notify(s, &s->read_cond, &s->fill_seq);
+    } while (cache_execute_control(s));
+#else
     int sleep_count = 0;
 #if FORKED_CACHE
     struct sigaction sa = { .sa_handler = SIG_IGN };
@@ -436,6 +703,7 @@ static void cache_mainloop(cache_vars_t *s) {
         } else
             sleep_count = 0;
     } while (cache_execute_control(s));
+#endif
 }
 
 /**
@@ -461,6 +729,16 @@ int stream_enable_cache(stream_t *stream,int64_t size,int64_t min,int64_t seek_l
   s->stream=stream; // callback
   s->seek_limit=seek_limit;
 
+  // retained segments need byte addressing and real seeks
+  if (!stream->sector_size && (stream->flags & MP_STREAM_SEEK) == MP_STREAM_SEEK) {
+    int n = FFMIN(s->buffer_size / 4 / SEG_BLOCK_SIZE, MAX_SEGS);
+    if (n >= 4)
+      s->seg_buffer = shared_alloc((int64_t)n * SEG_BLOCK_SIZE);
+    if (s->seg_buffer)
+      s->num_segs = n;
+    seg_drop_all(s);
+  }
+
 
   //make sure that we won't wait from cache_fill
   //more data than it is allowed to fill
@@ -490,9 +768,14 @@ int stream_enable_cache(stream_t *stream,int64_t size,int64_t min,int64_t seek_l
     stream->cache_pid = _beginthread( ThreadProc, NULL, 256 * 1024, s );
 #else
     {
-    pthread_t tid;
-    pthread_create(&tid, NULL, ThreadProc, s);
-    stream->cache_pid = 1;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+#ifdef XENON
+    pthread_attr_setrole_np(&attr, XENON_THREAD_SERVICE);
+#endif
+    if (!pthread_create(&s->thread, &attr, ThreadProc, s))
+      stream->cache_pid = 1;
+    pthread_attr_destroy(&attr);
     }
 #endif
 #endif
@@ -505,12 +788,20 @@ int stream_enable_cache(stream_t *stream,int64_t size,int64_t min,int64_t seek_l
     mp_msg(MSGT_CACHE,MSGL_V,"CACHE_PRE_INIT: %"PRId64" [%"PRId64"] %"PRId64"  pre:%"PRId64"  eof:%d  \n",
 	s->min_filepos,s->read_filepos,s->max_filepos,min,s->eof);
     while(s->read_filepos<s->min_filepos || s->max_filepos-s->read_filepos<min){
+#if COND_CACHE
+	unsigned seen = s->fill_seq;
+#endif
 	mp_msg(MSGT_CACHE,MSGL_STATUS,MSGTR_CacheFill,
 	    100.0*(float)(s->max_filepos-s->read_filepos)/(float)(s->buffer_size),
 	    s->max_filepos-s->read_filepos
 	);
 	if(s->eof) break; // file is smaller than prefill size
+#if COND_CACHE
+	cache_wait(s, &s->read_cond, &s->fill_seq, seen, PREFILL_SLEEP_TIME);
+	if(stream_check_interrupt(0)) {
+#else
 	if(stream_check_interrupt(PREFILL_SLEEP_TIME)) {
+#endif
 	  res = 0;
 	  goto err_out;
         }
@@ -648,8 +939,16 @@ int cache_do_control(stream_t *stream, int cmd, void *arg) {
   }
   cache_wakeup(stream);
   while (s->control != -1) {
+#if COND_CACHE
+    unsigned seen = s->fill_seq;
+    if (s->control == -1)
+      break;
+#endif
     if (sleep_count++ == 1000)
       mp_msg(MSGT_CACHE, MSGL_WARN, "Cache not responding! [performance issue]\n");
+#if COND_CACHE
+    cache_wait(s, &s->read_cond, &s->fill_seq, seen, READ_SLEEP_TIME);
+#endif
     if (stream_check_interrupt(CONTROL_SLEEP_TIME)) {
       s->eof = 1;
       return STREAM_UNSUPPORTED;
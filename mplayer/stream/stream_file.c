@@ -19,6 +19,8 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -32,6 +34,14 @@
 #include "help_mp.h"
 #include "m_option.h"
 #include "m_struct.h"
+#include "libavutil/common.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+/// size of the read-ahead window in kBytes, 0 disables it
+int stream_file_readahead = 0;
 
 static struct stream_priv_s {
   char* filename;
@@ -54,6 +64,216 @@ static const struct m_struct_st stream_opts = {
   stream_opts_fields
 };
 
+#if HAVE_PTHREADS
+// Read-ahead for local files: a thread reads RA_BLOCK_SIZE blocks at
+// block aligned offsets ahead of the reader through its own descriptor,
+// fill_buffer() then copies out of the block covering s->pos instead of
+// doing a small read() itself.
+#define RA_BLOCK_SIZE (256 * 1024)
+#define RA_MAX_BLOCKS 64
+
+enum { RA_EMPTY, RA_READING, RA_READY };
+
+typedef struct {
+  int fd;
+  int num_blocks;
+  unsigned char *mem;
+  struct {
+    off_t pos;
+    int len;
+    int state;
+    unsigned gen;
+  } blk[RA_MAX_BLOCKS];
+  off_t next_pos;      // where the next block is read from
+  off_t read_pos;      // reader position, blocks fully before it may be reused
+  off_t eof_pos;       // end of file seen by the thread, -1 if not yet
+  unsigned gen;        // bumped when the reader jumps, stale reads are dropped
+  int quit;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t fill_cond;
+  pthread_cond_t data_cond;
+} readahead_t;
+
+/// slot for the next block: a free one or the lowest one already consumed
+static int ra_free_block(readahead_t *ra)
+{
+  int i, best = -1;
+  for (i = 0; i < ra->num_blocks; i++) {
+    if (ra->blk[i].state == RA_EMPTY)
+      return i;
+    if (ra->blk[i].state == RA_READY &&
+        ra->blk[i].pos + ra->blk[i].len <= ra->read_pos &&
+        (best < 0 || ra->blk[i].pos < ra->blk[best].pos))
+      best = i;
+  }
+  return best;
+}
+
+static void *ra_thread(void *arg)
+{
+  readahead_t *ra = arg;
+  pthread_mutex_lock(&ra->mutex);
+  while (!ra->quit) {
+    int i = ra->eof_pos < 0 ? ra_free_block(ra) : -1;
+    off_t pos;
+    unsigned gen;
+    int len;
+    if (i < 0) {
+      pthread_cond_wait(&ra->fill_cond, &ra->mutex);
+      continue;
+    }
+    pos = ra->next_pos;
+    gen = ra->gen;
+    ra->next_pos += RA_BLOCK_SIZE;
+    ra->blk[i].state = RA_READING;
+    ra->blk[i].pos = pos;
+    ra->blk[i].gen = gen;
+    pthread_mutex_unlock(&ra->mutex);
+
+    len = -1;
+    if (lseek(ra->fd, pos, SEEK_SET) >= 0)
+      len = read(ra->fd, ra->mem + (int64_t)i * RA_BLOCK_SIZE, RA_BLOCK_SIZE);
+
+    pthread_mutex_lock(&ra->mutex);
+    if (ra->blk[i].gen != ra->gen) {
+      ra->blk[i].state = RA_EMPTY;
+      continue;
+    }
+    if (len <= 0) {
+      ra->blk[i].state = RA_EMPTY;
+      ra->eof_pos = pos;
+    } else {
+      ra->blk[i].state = RA_READY;
+      ra->blk[i].len = len;
+      if (len < RA_BLOCK_SIZE)
+        ra->eof_pos = pos + len;
+    }
+    pthread_cond_broadcast(&ra->data_cond);
+  }
+  pthread_mutex_unlock(&ra->mutex);
+  return NULL;
+}
+
+static int ra_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+  readahead_t *ra = s->priv;
+  off_t pos = s->pos;
+  int i, len = -1;
+
+  pthread_mutex_lock(&ra->mutex);
+  ra->read_pos = pos;
+  for (;;) {
+    int reading = 0;
+    for (i = 0; i < ra->num_blocks; i++) {
+      if (ra->blk[i].state == RA_EMPTY || ra->blk[i].gen != ra->gen ||
+          pos < ra->blk[i].pos || pos >= ra->blk[i].pos + RA_BLOCK_SIZE)
+        continue;
+      if (ra->blk[i].state == RA_READING)
+        reading = 1;
+      else if (pos < ra->blk[i].pos + ra->blk[i].len)
+        break;
+    }
+    if (i < ra->num_blocks) {
+      len = FFMIN(max_len, ra->blk[i].pos + ra->blk[i].len - pos);
+      memcpy(buffer, ra->mem + (int64_t)i * RA_BLOCK_SIZE + (pos - ra->blk[i].pos), len);
+      break;
+    }
+    if (ra->eof_pos >= 0 && pos >= ra->eof_pos)
+      break;
+    // not in the window and not the block the thread reads next
+    if (!reading && (pos < ra->next_pos || pos >= ra->next_pos + RA_BLOCK_SIZE)) {
+      // jumped outside the window, restart it at the new position
+      for (i = 0; i < ra->num_blocks; i++)
+        if (ra->blk[i].state == RA_READY)
+          ra->blk[i].state = RA_EMPTY;
+      ra->gen++;
+      ra->next_pos = pos - pos % RA_BLOCK_SIZE;
+      ra->eof_pos = -1;
+    }
+    pthread_cond_signal(&ra->fill_cond);
+    pthread_cond_wait(&ra->data_cond, &ra->mutex);
+  }
+  // the reader moved on, wake up the thread to reuse consumed blocks
+  pthread_cond_signal(&ra->fill_cond);
+  pthread_mutex_unlock(&ra->mutex);
+  return len;
+}
+
+static int ra_seek(stream_t *s, off_t newpos)
+{
+  // the window is moved by the next ra_fill_buffer()
+  s->pos = newpos;
+  return 1;
+}
+
+static void ra_close(stream_t *s)
+{
+  readahead_t *ra = s->priv;
+  pthread_mutex_lock(&ra->mutex);
+  ra->quit = 1;
+  pthread_cond_signal(&ra->fill_cond);
+  pthread_mutex_unlock(&ra->mutex);
+  pthread_join(ra->thread, NULL);
+  pthread_cond_destroy(&ra->data_cond);
+  pthread_cond_destroy(&ra->fill_cond);
+  pthread_mutex_destroy(&ra->mutex);
+  close(ra->fd);
+  free(ra->mem);
+  free(ra);
+  s->priv = NULL;
+}
+
+/// \return 1 if read-ahead was set up on stream, 0 to use plain reads
+static int ra_open(stream_t *stream, const char *filename)
+{
+  pthread_attr_t attr;
+  readahead_t *ra;
+  int n = stream_file_readahead * 1024LL / RA_BLOCK_SIZE;
+  if (n < 2)
+    return 0;
+  if (n > RA_MAX_BLOCKS)
+    n = RA_MAX_BLOCKS;
+  ra = calloc(1, sizeof(*ra));
+  if (!ra)
+    return 0;
+  ra->mem = malloc((int64_t)n * RA_BLOCK_SIZE);
+  ra->fd = open(filename, O_RDONLY|O_BINARY);
+  if (!ra->mem || ra->fd < 0)
+    goto err;
+  ra->num_blocks = n;
+  ra->eof_pos = -1;
+  pthread_mutex_init(&ra->mutex, NULL);
+  pthread_cond_init(&ra->fill_cond, NULL);
+  pthread_cond_init(&ra->data_cond, NULL);
+  pthread_attr_init(&attr);
+#ifdef XENON
+  pthread_attr_setrole_np(&attr, XENON_THREAD_SERVICE);
+#endif
+  if (pthread_create(&ra->thread, &attr, ra_thread, ra)) {
+    pthread_attr_destroy(&attr);
+    pthread_cond_destroy(&ra->data_cond);
+    pthread_cond_destroy(&ra->fill_cond);
+    pthread_mutex_destroy(&ra->mutex);
+    goto err;
+  }
+  pthread_attr_destroy(&attr);
+  stream->priv = ra;
+  stream->fill_buffer = ra_fill_buffer;
+  stream->seek = ra_seek;
+  stream->close = ra_close;
+  mp_msg(MSGT_OPEN, MSGL_V, "[file] Read-ahead window %d kB\n", n * RA_BLOCK_SIZE / 1024);
+  return 1;
+
+err:
+  if (ra->fd >= 0)
+    close(ra->fd);
+  free(ra->mem);
+  free(ra);
+  return 0;
+}
+#endif
+
 static int fill_buffer(stream_t *s, char* buffer, int max_len){
   int r = read(s->fd,buffer,max_len);
   return (r <= 0) ? -1 : r;
@@ -204,6 +424,10 @@ static int open_f(stream_t *stream,int mode, void* opts, int* file_format) {
   stream->write_buffer = write_buffer;
   stream->control = control;
   stream->read_chunk = 64*1024;
+#if HAVE_PTHREADS
+  if (mode == STREAM_READ && stream->type == STREAMTYPE_FILE && stream_file_readahead > 0)
+    ra_open(stream, (const char *)filename);
+#endif
 
   m_struct_free(&stream_opts,opts);
   return STREAM_OK;
@@ -30,9 +30,151 @@ extern "C" struct XenosDevice * g_pVideoDevice;
 static FT_Library ftLibrary; /**< FreeType FT_Library instance. */
 static FT_Face ftFace; /**< FreeType reusable FT_Face typographic object. */
 static FT_GlyphSlot ftSlot; /**< FreeType reusable FT_GlyphSlot glyph container object. */
+static FT_UInt faceSize; /**< Pixel size ftFace is set to. */
 
 FreeTypeGX *fontSystem[MAX_FONT_SIZE + 1];
 
+/*
+ * Glyph atlas shared by all font sizes.
+ *
+ * Glyph bitmaps are shelf packed into a few 8 bit pages so consecutive glyphs
+ * use the same texture and the menu batcher draws a string with one call.
+ * When every page is full the least recently drawn page is cleared, glyphs
+ * stored there are rendered again on their next use.
+ */
+#define ATLAS_SIZE 512
+#define ATLAS_MAX_PAGES 8
+#define ATLAS_MAX_SHELVES 64
+#define ATLAS_PADDING 1
+
+typedef struct {
+	uint16_t y;
+	uint16_t height;
+	uint16_t x; /**< First free column. */
+} ftgxShelf;
+
+typedef struct {
+	XenosSurface * texture;
+	uint32_t gen; /**< Bumped each time the page is cleared. */
+	uint32_t lastUse; /**< FrameTimer of the last draw from this page. */
+	uint16_t freeY; /**< Top of the unused area below the shelves. */
+	int numShelves;
+	ftgxShelf shelves[ATLAS_MAX_SHELVES];
+} ftgxAtlasPage;
+
+static ftgxAtlasPage atlasPage[ATLAS_MAX_PAGES];
+static int atlasPages = 0;
+
+// laid out strings kept per font size
+#define LAYOUT_CACHE_MAX 256
+
+static uint32_t layoutHits = 0;
+static uint32_t layoutMisses = 0;
+
+void GetTextCacheStats(uint32_t *hits, uint32_t *misses) {
+	*hits = layoutHits;
+	*misses = layoutMisses;
+}
+
+static void atlasResetPage(ftgxAtlasPage *page) {
+	page->gen++;
+	page->freeY = 0;
+	page->numShelves = 0;
+
+	uint8_t * surfbuf = (uint8_t*) Xe_Surface_LockRect(g_pVideoDevice, page->texture, 0, 0, 0, 0, XE_LOCK_WRITE);
+	memset(surfbuf, 0, page->texture->hpitch * page->texture->wpitch);
+	Xe_Surface_Unlock(g_pVideoDevice, page->texture);
+}
+
+static bool atlasShelfAlloc(ftgxAtlasPage *page, int w, int h, uint16_t *x, uint16_t *y) {
+	ftgxShelf *best = NULL;
+
+	// tightest existing shelf with room left
+	for (int i = 0; i < page->numShelves; i++) {
+		ftgxShelf *shelf = &page->shelves[i];
+		if (shelf->height < h || shelf->height > h + (h >> 2) + 2 || shelf->x + w > ATLAS_SIZE)
+			continue;
+		if (!best || shelf->height < best->height)
+			best = shelf;
+	}
+
+	if (!best) {
+		if (page->numShelves == ATLAS_MAX_SHELVES || page->freeY + h > ATLAS_SIZE)
+			return false;
+		best = &page->shelves[page->numShelves++];
+		best->y = page->freeY;
+		best->height = h;
+		best->x = 0;
+		page->freeY += h;
+	}
+
+	*x = best->x;
+	*y = best->y;
+	best->x += w;
+	return true;
+}
+
+/**
+ * Finds room for a w x h bitmap, adding or evicting a page when needed.
+ *
+ * @return The page index or -1 if every page is in use by the current frame.
+ */
+static int atlasAlloc(int w, int h, uint16_t *x, uint16_t *y) {
+	int i, lru = -1;
+
+	w += ATLAS_PADDING;
+	h += ATLAS_PADDING;
+
+	if (w > ATLAS_SIZE || h > ATLAS_SIZE)
+		return -1;
+
+	for (i = 0; i < atlasPages; i++) {
+		if (atlasShelfAlloc(&atlasPage[i], w, h, x, y))
+			return i;
+	}
+
+	if (atlasPages < ATLAS_MAX_PAGES) {
+		XenosSurface * texture = Xe_CreateTexture(g_pVideoDevice, ATLAS_SIZE, ATLAS_SIZE, 0, XE_FMT_8, 0);
+		if (texture) {
+			texture->use_filtering = 0;
+			texture->u_addressing = XE_TEXADDR_CLAMP;
+			texture->v_addressing = XE_TEXADDR_CLAMP;
+
+			i = atlasPages++;
+			atlasPage[i].texture = texture;
+			atlasResetPage(&atlasPage[i]);
+			atlasShelfAlloc(&atlasPage[i], w, h, x, y);
+			return i;
+		}
+	}
+
+	// quads of the current frame still read from the pages they were batched with
+	for (i = 0; i < atlasPages; i++) {
+		if (atlasPage[i].lastUse == FrameTimer)
+			continue;
+		if (lru < 0 || atlasPage[i].lastUse < atlasPage[lru].lastUse)
+			lru = i;
+	}
+	if (lru < 0)
+		return -1;
+
+	atlasResetPage(&atlasPage[lru]);
+	atlasShelfAlloc(&atlasPage[lru], w, h, x, y);
+	return lru;
+}
+
+static bool atlasHasGlyph(ftgxCharData *charData) {
+	return charData->atlasPage >= 0 && atlasPage[charData->atlasPage].gen == charData->atlasGen;
+}
+
+/**
+ * Forgets every glyph bitmap, the fonts using the atlas have to be gone.
+ */
+static void atlasClear() {
+	for (int i = 0; i < atlasPages; i++)
+		atlasResetPage(&atlasPage[i]);
+}
+
 void InitFreeType(uint8_t* fontBuffer, FT_Long bufferSize) {
 	FT_Init_FreeType(&ftLibrary);
 	FT_New_Memory_Face(ftLibrary, (FT_Byte *) fontBuffer, bufferSize, 0, &ftFace);
@@ -49,6 +191,7 @@ void DeinitFreeType() {
 }
 
 void ChangeFontSize(FT_UInt pixelSize) {
+	faceSize = pixelSize;
 	FT_Set_Pixel_Sizes(ftFace, 0, pixelSize);
 }
 
@@ -58,6 +201,7 @@ void ClearFontData() {
 			delete fontSystem[i];
 		fontSystem[i] = NULL;
 	}
+	atlasClear();
 }
 
 static wchar_t *UTF8_to_UNICODE(wchar_t *unicode, const char *utf8, int len) {
@@ -98,8 +242,6 @@ wchar_t* charToWideChar(const char* strChar) {
         return strWChar;
 }
 
-uint8_t * glyphData = NULL; //tmp buffer
-
 /**
  * Default constructor for the FreeTypeGX class.
  *
@@ -109,9 +251,6 @@ FreeTypeGX::FreeTypeGX(FT_UInt pixelSize, uint8_t vertexIndex) {
 	this->ftPointSize = pixelSize;
 	this->ftKerningEnabled = FT_HAS_KERNING(ftFace);
 
-	if (glyphData == NULL)
-		glyphData = (uint8_t *) malloc(256 * 256 * 4);
-
 	this->vertexIndex = vertexIndex;
 }
 
@@ -120,7 +259,6 @@ FreeTypeGX::FreeTypeGX(FT_UInt pixelSize, uint8_t vertexIndex) {
  */
 FreeTypeGX::~FreeTypeGX() {
 	this->unloadFont();
-	//    free(glyphData);
 }
 
 /**
@@ -129,13 +267,8 @@ FreeTypeGX::~FreeTypeGX() {
  * This routine clears all members of the font map structure and frees all allocated memory back to the system.
  */
 void FreeTypeGX::unloadFont() {
-	if (this->fontData.size() == 0)
-		return;
-	for (std::map<wchar_t, ftgxCharData>::iterator i = this->fontData.begin(), iEnd = this->fontData.end(); i != iEnd; ++i)
-		//free(i->second.glyphDataTexture);
-		if (i->second.glyphDataTexture) {
-			Xe_DestroyTexture(g_pVideoDevice, i->second.glyphDataTexture);
-		}
+	// the atlas space is reclaimed when its page gets evicted
+	this->layoutCache.clear();
 	this->fontData.clear();
 }
 
@@ -202,7 +335,10 @@ ftgxCharData *FreeTypeGX::cacheGlyphData(wchar_t charCode) {
 				ftSlot->bitmap_top,
 				ftSlot->bitmap_top,
 				glyphBitmap->rows - ftSlot->bitmap_top,
-				NULL,
+				-1,
+				0,
+				0,
+				0,
 				ftSlot->metrics,
 				ftSlot->bitmap_top,
 			};
@@ -232,98 +368,70 @@ uint16_t FreeTypeGX::cacheGlyphDataComplete() {
 }
 
 /**
- * Loads the rendered bitmap into the relevant structure's data buffer.
+ * Loads the rendered bitmap into the glyph atlas.
  *
- * This routine does a simple byte-wise copy of the glyph's rendered 8-bit grayscale bitmap into the structure's buffer.
- * Each byte is converted from the bitmap's intensity value into the a uint32_t RGBA value.
+ * This routine does a simple byte-wise copy of the glyph's rendered 8-bit grayscale bitmap into a free spot of an
+ * atlas page and records the spot in the structure.
  *
  * @param bmp	A pointer to the most recently rendered glyph's bitmap.
  * @param charData	A pointer to an allocated ftgxCharData structure whose data represent that of the last rendered glyph.
- *
- * Optimized for RGBA8 use by Dimok.
  */
 void FreeTypeGX::loadGlyphData(FT_Bitmap *bmp, ftgxCharData *charData) {
-	int w, h, length;
+	uint16_t x, y;
+	int page;
+
+	charData->atlasPage = -1;
 
 	if ((charData->textureWidth == 0) || (charData->textureHeight == 0))
 		return;
 
-	if (!glyphData)
+	page = atlasAlloc(charData->textureWidth, charData->textureHeight, &x, &y);
+	if (page < 0)
 		return;
 
-	//    w = (charData->textureWidth < 32) ? 32 : charData->textureWidth;
-	//    h = (charData->textureHeight < 32) ? 32 : charData->textureHeight;
-
-	w = charData->textureWidth;
-	h = charData->textureHeight;
+	XenosSurface * texture = atlasPage[page].texture;
+	uint8_t * surfbuf = (uint8_t*) Xe_Surface_LockRect(g_pVideoDevice, texture, 0, 0, 0, 0, XE_LOCK_WRITE);
 
-	length = w * h * 4;
+	// never past the slot, the bitmap can differ from the cached metrics
+	int rows = (bmp->rows < charData->textureHeight) ? bmp->rows : charData->textureHeight;
+	int width = (bmp->width < charData->textureWidth) ? bmp->width : charData->textureWidth;
 
-	if (charData->glyphDataTexture) {
-		Xe_DestroyTexture(g_pVideoDevice, charData->glyphDataTexture);
+	for (int row = 0; row < rows; row++) {
+		uint8_t *src = (uint8_t *) bmp->buffer + row * bmp->pitch;
+		uint8_t *dst = surfbuf + (y + row) * texture->wpitch + x;
+		memcpy(dst, src, width);
 	}
 
-	charData->glyphDataTexture = Xe_CreateTexture(g_pVideoDevice, (w + 31) &~31, (h + 31) &~31, 0, XE_FMT_8, 0);
-	charData->glyphDataTexture->use_filtering = 0;
-	charData->glyphDataTexture->u_addressing = XE_TEXADDR_CLAMP;
-	charData->glyphDataTexture->v_addressing = XE_TEXADDR_CLAMP;
-
-	memset(glyphData, 0x00, length);
-
-	uint8_t *src = (uint8_t *) bmp->buffer;
-
-	uint8_t * surfbuf = (uint8_t*) Xe_Surface_LockRect(g_pVideoDevice, charData->glyphDataTexture, 0, 0, 0, 0, XE_LOCK_WRITE);
-	memset(surfbuf, 0, charData->glyphDataTexture->hpitch * charData->glyphDataTexture->wpitch);
-
-	//    uint32_t * surfbuf = (uint32_t *)glyphData;
-	//    uint32_t * dst = (uint32_t *) surfbuf;
-
-	uint8_t * dst = (uint8_t *) surfbuf;
-
-	uint8_t * dst_limit = (uint8_t *) surfbuf + ((charData->glyphDataTexture->hpitch) * (charData->glyphDataTexture->wpitch));
-	int hpitch = 0;
-	int wpitch = 0;
-	//int y_offset = (h-(charData->textureHeight-charData->renderOffsetY));
-	//    int y_offset = 0;
-
-
-	//    for (hpitch = 0; hpitch < charData->glyphDataTexture->hpitch; hpitch += charData->glyphDataTexture->height) {
-	//        //        for (int y = 0; y < bmp->rows; y++)
-	//        int y = 0;
-	//        int y_offset = 0;
-	//        int dsty = 0;
-	//        for (y = 0, dsty = y_offset; y < (bmp->rows); y++, dsty++) {
-	//            for (wpitch = 0; wpitch < charData->glyphDataTexture->wpitch; wpitch += charData->glyphDataTexture->width) {
-	//                src = (uint8_t *) bmp->buffer + ((y) * bmp->pitch);
-	//                dst = (uint8_t *) surfbuf + ((dsty + hpitch) * (charData->glyphDataTexture->wpitch)) + wpitch;
-	//                for (int x = 0; x < bmp->width; x++) {
-	//                    if (dst < dst_limit)
-	//                        *dst++ = *src++;
-	//                }
-	//            }
-	//        }
-	//    }
-
-	for (hpitch = 0; hpitch < charData->glyphDataTexture->hpitch; hpitch += charData->glyphDataTexture->height) {
-		//        for (int y = 0; y < bmp->rows; y++)
-		int y, dsty = 0;
-		//        int y_offset = charData->glyphDataTexture->height;
-		int y_offset = 0;
-
-		for (y = 0, dsty = y_offset; y < (bmp->rows); y++, dsty++) {
-			//        for (y = 0, dsty = y_offset; y < (bmp->rows); y++, dsty--) {
-			for (wpitch = 0; wpitch < charData->glyphDataTexture->wpitch; wpitch += charData->glyphDataTexture->width) {
-				src = (uint8_t *) bmp->buffer + ((y) * bmp->pitch);
-				dst = (uint8_t *) surfbuf + ((dsty + hpitch) * (charData->glyphDataTexture->wpitch)) + wpitch;
-				for (int x = 0; x < bmp->width; x++) {
-					if (dst < dst_limit)
-						*dst++ = *src++;
-				}
-			}
-		}
-	}
+	Xe_Surface_Unlock(g_pVideoDevice, texture);
+
+	charData->atlasPage = page;
+	charData->atlasX = x;
+	charData->atlasY = y;
+	charData->atlasGen = atlasPage[page].gen;
+}
+
+/**
+ * Renders a cached glyph again after its atlas page was evicted.
+ *
+ * @param charData	The glyph, its metrics are kept.
+ * @return true if the bitmap is back in the atlas.
+ */
+bool FreeTypeGX::reloadGlyphData(ftgxCharData *charData) {
+	// the face is shared, it may be set to another size by now
+	FT_UInt prevSize = faceSize;
+	bool loaded;
+
+	if (prevSize != ftPointSize)
+		FT_Set_Pixel_Sizes(ftFace, 0, ftPointSize);
+
+	loaded = !FT_Load_Glyph(ftFace, charData->glyphIndex, FT_LOAD_DEFAULT | FT_LOAD_RENDER) && ftSlot->format == FT_GLYPH_FORMAT_BITMAP;
+	if (loaded)
+		this->loadGlyphData(&ftSlot->bitmap, charData);
 
-	Xe_Surface_Unlock(g_pVideoDevice, charData->glyphDataTexture);
+	if (prevSize != ftPointSize && prevSize)
+		FT_Set_Pixel_Sizes(ftFace, 0, prevSize);
+
+	return loaded && atlasHasGlyph(charData);
 }
 
 /**
@@ -393,12 +501,61 @@ int16_t FreeTypeGX::getStyleOffsetHeight(ftgxDataOffset *offset, uint16_t format
  * @return The number of characters printed.
  */
 uint16_t FreeTypeGX::drawText(int16_t x, int16_t y, wchar_t *text, XeColor color, uint16_t textStyle) {
-	//printf("Disabled !!\r\n");
-	//return 0;
-	uint16_t x_pos = x, printed = 0;
+	ftgxTextLayout *layout = this->layoutText(text, textStyle);
+
+	for (std::vector<ftgxLayoutGlyph>::iterator i = layout->glyphs.begin(), iEnd = layout->glyphs.end(); i != iEnd; ++i) {
+		ftgxCharData *glyphData = i->glyph;
+
+		if (atlasHasGlyph(glyphData) || this->reloadGlyphData(glyphData)) {
+			ftgxAtlasPage *page = &atlasPage[glyphData->atlasPage];
+
+			page->lastUse = FrameTimer;
+			Menu_TSub(page->texture, glyphData->atlasX, glyphData->atlasY, glyphData->textureWidth, glyphData->textureHeight, x + i->x, y + i->y, color);
+		}
+	}
+
+	return layout->printed;
+}
+
+/**
+ * Positions the glyphs of a string, or returns the cached result.
+ *
+ * The glyph positions only depend on the font size, the text and the style, so menus redrawing the same labels every
+ * frame skip the glyph lookups, kerning and measuring passes. Colors are applied when drawing.
+ *
+ * @param text	NULL terminated string to lay out.
+ * @param textStyle	Flags which specify any styling which should be applied to the rendered string.
+ * @return The layout, valid until the next call.
+ */
+ftgxTextLayout *FreeTypeGX::layoutText(wchar_t *text, uint16_t textStyle) {
+	std::wstring key(1, (wchar_t) textStyle);
+	key += text;
+
+	std::map<std::wstring, ftgxTextLayout>::iterator it = this->layoutCache.find(key);
+	if (it != this->layoutCache.end()) {
+		layoutHits++;
+		it->second.lastUse = FrameTimer;
+		return &it->second;
+	}
+	layoutMisses++;
+
+	if (this->layoutCache.size() >= LAYOUT_CACHE_MAX) {
+		// drop the least recently drawn string
+		std::map<std::wstring, ftgxTextLayout>::iterator lru = this->layoutCache.begin();
+		for (it = this->layoutCache.begin(); it != this->layoutCache.end(); ++it) {
+			if (it->second.lastUse < lru->second.lastUse)
+				lru = it;
+		}
+		this->layoutCache.erase(lru);
+	}
+
+	ftgxTextLayout *layout = &this->layoutCache[key];
+	layout->printed = 0;
+	layout->lastUse = FrameTimer;
+
+	uint16_t x_pos = 0;
 	uint16_t x_offset = 0, y_offset = 0;
 
-	//GXTexObj glyphTexture;
 	FT_Vector pairDelta;
 	ftgxDataOffset offset;
 
@@ -424,24 +581,23 @@ uint16_t FreeTypeGX::drawText(int16_t x, int16_t y, wchar_t *text, XeColor color
 				FT_Get_Kerning(ftFace, this->fontData[text[i - 1]].glyphIndex, glyphData->glyphIndex, FT_KERNING_DEFAULT, &pairDelta);
 				x_pos += pairDelta.x >> 6;
 			}
-			if (glyphData->glyphDataTexture) {
+			if (glyphData->textureWidth && glyphData->textureHeight) {
 				int RenderOffsetY = (glyphData->be.horiBearingY >> 6);
 				int RenderOffsetX = glyphData->renderOffsetX; // - dx;
-
-				Menu_T(glyphData->glyphDataTexture, glyphData->glyphDataTexture->width, glyphData->glyphDataTexture->height, x_pos + RenderOffsetX + x_offset, y - RenderOffsetY + y_offset, color);
-
+				ftgxLayoutGlyph g = {
+					glyphData,
+					(int16_t) (x_pos + RenderOffsetX + x_offset),
+					(int16_t) (y_offset - RenderOffsetY)
+				};
+				layout->glyphs.push_back(g);
 			}
 			x_pos += (glyphData->glyphAdvanceX);
-			++printed;
+			++layout->printed;
 		}
 		++i;
 	}
 
-	if (textStyle & FTGX_STYLE_MASK) {
-		this->getOffset(text, &offset);
-	}
-
-	return printed;
+	return layout;
 }
 
 /**
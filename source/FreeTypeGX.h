@@ -32,6 +32,8 @@
 #include <string.h>
 #include <wchar.h>
 #include <map>
+#include <string>
+#include <vector>
 
 #define MAX_FONT_SIZE 100
 
@@ -51,8 +53,10 @@ typedef struct ftgxCharData_ {
     int16_t renderOffsetMax; /**< Texture Y axis bearing maximum value. */
     int16_t renderOffsetMin; /**< Texture Y axis bearing minimum value. */
 
-    //uint32_t* glyphDataTexture; /**< Glyph texture bitmap data buffer. */
-    XenosSurface * glyphDataTexture;
+    int16_t atlasPage; /**< Glyph atlas page holding the bitmap, -1 if not loaded. */
+    uint16_t atlasX; /**< X position of the bitmap in the atlas page. */
+    uint16_t atlasY; /**< Y position of the bitmap in the atlas page. */
+    uint32_t atlasGen; /**< Page generation, the bitmap is gone when the page was evicted since. */
     
     FT_Glyph_Metrics be;
     uint16_t bitmap_top;
@@ -72,6 +76,24 @@ typedef struct ftgxDataOffset_ {
 typedef struct ftgxCharData_ ftgxCharData;
 typedef struct ftgxDataOffset_ ftgxDataOffset;
 
+/*! \struct ftgxLayoutGlyph_
+ * Glyph of a laid out string, positioned relative to the string origin.
+ */
+typedef struct ftgxLayoutGlyph_ {
+    ftgxCharData *glyph; /**< Glyph data, owned by the font map. */
+    int16_t x; /**< X offset of the glyph quad including kerning and justification. */
+    int16_t y; /**< Y offset of the glyph quad including alignment. */
+} ftgxLayoutGlyph;
+
+/*! \struct ftgxTextLayout_
+ * Laid out string, cached per font size for a string and style.
+ */
+typedef struct ftgxTextLayout_ {
+    std::vector<ftgxLayoutGlyph> glyphs; /**< Glyphs with a bitmap, in drawing order. */
+    uint16_t printed; /**< Number of characters found in the font. */
+    uint32_t lastUse; /**< FrameTimer of the last draw. */
+} ftgxTextLayout;
+
 #define _TEXT(t) L ## t /**< Unicode helper macro. */
 
 #define FTGX_NULL				0x0000
@@ -98,6 +120,7 @@ void DeinitFreeType();
 void ChangeFontSize(FT_UInt pixelSize);
 wchar_t* charToWideChar(const char* p);
 void ClearFontData();
+void GetTextCacheStats(uint32_t *hits, uint32_t *misses);
 
 /*! \class FreeTypeGX
  * \brief Wrapper class for the libFreeType library with GX rendering.
@@ -116,6 +139,7 @@ private:
     uint8_t vertexIndex; /**< Vertex format descriptor index. */
     uint32_t compatibilityMode; /**< Compatibility mode for default tev operations and vertex descriptors. */
     std::map<wchar_t, ftgxCharData> fontData; /**< Map which holds the glyph data structures for the corresponding characters. */
+    std::map<std::wstring, ftgxTextLayout> layoutCache; /**< Laid out strings, keyed by style and text. */
 
     static uint16_t adjustTextureWidth(uint16_t textureWidth);
     static uint16_t adjustTextureHeight(uint16_t textureHeight);
@@ -127,6 +151,8 @@ private:
     ftgxCharData *cacheGlyphData(wchar_t charCode);
     uint16_t cacheGlyphDataComplete();
     void loadGlyphData(FT_Bitmap *bmp, ftgxCharData *charData);
+    bool reloadGlyphData(ftgxCharData *charData);
+    ftgxTextLayout *layoutText(wchar_t *text, uint16_t textStyle);
 
 public:
     FreeTypeGX(FT_UInt pixelSize, uint8_t vertexIndex = 0);
@@ -0,0 +1,160 @@
+/****************************************************************************
+ * dirscan.c
+ *
+ * Directory listing in a background thread
+ *
+ * readdir() on large folders of slow drives takes seconds, the thread
+ * queues the names so the browser can show and sort them while the rest
+ * is still being read.
+ ***************************************************************************/
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mplayer/libxenon_miss/pthread.h"
+#include "dirscan.h"
+
+// entries read before handing them over
+#define DIRSCAN_CHUNK 64
+
+struct dirscan {
+	DIR * dir;
+	pthread_t thread;
+	int threaded;
+	volatile int cancel;
+
+	// under mutex
+	pthread_mutex_t mutex;
+	DIRSCANENTRY * entries;
+	int first; // next entry to hand over
+	int num;
+	int size;
+	int done;
+};
+
+static void DirScanPush(DIRSCAN * scan, DIRSCANENTRY * chunk, int n) {
+	pthread_mutex_lock(&scan->mutex);
+
+	// drop what was already taken before growing
+	if (scan->first) {
+		memmove(scan->entries, scan->entries + scan->first, (scan->num - scan->first) * sizeof (DIRSCANENTRY));
+		scan->num -= scan->first;
+		scan->first = 0;
+	}
+
+	if (scan->num + n > scan->size) {
+		int size = scan->size ? scan->size * 2 : 4 * DIRSCAN_CHUNK;
+		DIRSCANENTRY * entries;
+
+		while (size < scan->num + n)
+			size *= 2;
+
+		entries = (DIRSCANENTRY *) realloc(scan->entries, size * sizeof (DIRSCANENTRY));
+		if (entries == NULL) {
+			scan->cancel = 1;
+			pthread_mutex_unlock(&scan->mutex);
+			return;
+		}
+		scan->entries = entries;
+		scan->size = size;
+	}
+
+	memcpy(scan->entries + scan->num, chunk, n * sizeof (DIRSCANENTRY));
+	scan->num += n;
+
+	pthread_mutex_unlock(&scan->mutex);
+}
+
+static void * DirScanThread(void * arg) {
+	DIRSCAN * scan = (DIRSCAN *) arg;
+	DIRSCANENTRY chunk[DIRSCAN_CHUNK];
+	struct dirent * entry;
+	int n = 0;
+
+	while (!scan->cancel && (entry = readdir(scan->dir))) {
+		if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0))
+			continue;
+
+		chunk[n].isdir = (entry->d_type == DT_DIR);
+		strncpy(chunk[n].name, entry->d_name, DIRSCAN_NAME_MAX);
+		chunk[n].name[DIRSCAN_NAME_MAX] = 0;
+
+		if (++n == DIRSCAN_CHUNK) {
+			DirScanPush(scan, chunk, n);
+			n = 0;
+		}
+	}
+
+	if (n)
+		DirScanPush(scan, chunk, n);
+
+	closedir(scan->dir);
+	scan->dir = NULL;
+
+	pthread_mutex_lock(&scan->mutex);
+	scan->done = 1;
+	pthread_mutex_unlock(&scan->mutex);
+
+	return NULL;
+}
+
+DIRSCAN * DirScanStart(const char * path) {
+	DIRSCAN * scan;
+	pthread_attr_t attr;
+
+	scan = (DIRSCAN *) calloc(1, sizeof (DIRSCAN));
+	if (scan == NULL)
+		return NULL;
+
+	scan->dir = opendir(path);
+	if (scan->dir == NULL) {
+		free(scan);
+		return NULL;
+	}
+
+	pthread_mutex_init(&scan->mutex, NULL);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setrole_np(&attr, XENON_THREAD_SERVICE);
+	scan->threaded = (pthread_create(&scan->thread, &attr, DirScanThread, scan) == 0);
+	pthread_attr_destroy(&attr);
+
+	// no thread left, list it now
+	if (!scan->threaded)
+		DirScanThread(scan);
+
+	return scan;
+}
+
+int DirScanRead(DIRSCAN * scan, DIRSCANENTRY * entries, int max, int * done) {
+	int n;
+
+	pthread_mutex_lock(&scan->mutex);
+
+	n = scan->num - scan->first;
+	if (n > max)
+		n = max;
+
+	memcpy(entries, scan->entries + scan->first, n * sizeof (DIRSCANENTRY));
+	scan->first += n;
+
+	*done = scan->done && scan->first == scan->num;
+
+	pthread_mutex_unlock(&scan->mutex);
+
+	return n;
+}
+
+void DirScanClose(DIRSCAN * scan) {
+	if (scan == NULL)
+		return;
+
+	scan->cancel = 1;
+	if (scan->threaded)
+		pthread_join(scan->thread, NULL);
+
+	pthread_mutex_destroy(&scan->mutex);
+	free(scan->entries);
+	free(scan);
+}
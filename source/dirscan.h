@@ -0,0 +1,34 @@
+/****************************************************************************
+ * dirscan.h
+ *
+ * Directory listing in a background thread
+ ***************************************************************************/
+
+#ifndef _DIRSCAN_H_
+#define _DIRSCAN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DIRSCAN_NAME_MAX 255
+
+typedef struct {
+	char isdir;
+	char name[DIRSCAN_NAME_MAX + 1];
+} DIRSCANENTRY;
+
+typedef struct dirscan DIRSCAN;
+
+// NULL if the directory can't be opened
+DIRSCAN * DirScanStart(const char * path);
+// take up to max scanned entries, *done is set once everything was taken
+int DirScanRead(DIRSCAN * scan, DIRSCANENTRY * entries, int max, int * done);
+// stop the scan if still running and free it
+void DirScanClose(DIRSCAN * scan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -16,12 +16,77 @@
 //#include <sys/dir.h>
 #include <malloc.h>
 #include <debug.h>
+#include <ppc/timebase.h>
+#include <time/time.h>
 
 #include "filebrowser.h"
+#include "dirscan.h"
 
 BROWSERINFO browser;
 BROWSERENTRY * browserList = NULL; // list of files/folders in browser
 
+static int browserListSize = 0; // allocated entries of browserList
+static int browserListCount = 0; // used entries of browserList
+static int browserListSorted = 0; // entries merged into the displayed list
+static DIRSCAN * browserScan = NULL; // directory being listed
+
+// entries taken from the scanner per BrowserUpdate() call
+#define SCAN_ENTRIES_PER_UPDATE 1024
+// merge right away until this many entries are displayed
+#define FIRST_PAGE_ENTRIES 32
+
+/**
+ * Directory index cache
+ *
+ * Sorted listings of the directories visited in this session, so going
+ * back to a folder (or to the browser after playback) doesn't read and
+ * classify it again. A listing is reused only if:
+ *  - it was made with the same extension filter
+ *  - no BrowserFlushCache() happened since (devices mounted, files written)
+ *  - the directory still stats with the same mtime
+ * The least recently used listings are dropped past BROWSER_CACHE_BYTES.
+ * Some filesystems (iso9660, fat) don't update a directory mtime, that's why
+ * anything writing files must call BrowserFlushCache().
+ ***************************************************************************/
+#define BROWSER_CACHE_DIRS 32
+#define BROWSER_CACHE_BYTES (4 * 1024 * 1024)
+
+typedef struct {
+	char isdir;
+	char type; // BROWSER_TYPE
+	unsigned short len; // filename length, names follow each other in names
+} BROWSERCACHEITEM;
+
+typedef struct {
+	char path[MAXPATHLEN]; // device + directory, empty if the slot is free
+	int (*filter)(char * ext); // extValid used for the listing
+	time_t mtime;
+	unsigned int gen;
+	unsigned int lastUse;
+	int numEntries;
+	int bytes;
+	BROWSERCACHEITEM * items;
+	char * names;
+} BROWSERCACHEDIR;
+
+static BROWSERCACHEDIR browserCache[BROWSER_CACHE_DIRS];
+static int browserCacheBytes = 0;
+static unsigned int browserCacheGen = 0;
+static unsigned int browserCacheUse = 0;
+static int browserCacheHits = 0;
+static int browserCacheMisses = 0;
+
+// listing in progress, stored in the cache once complete
+static char browserScanPath[MAXPATHLEN];
+static time_t browserScanMtime = 0;
+static int browserScanCacheable = 0;
+static unsigned int browserScanGen = 0;
+static u64 browserScanStart = 0;
+
+// time taken by the last complete listing
+static int browserLastMsec = 0;
+static int browserLastCached = 0;
+
 char rootdir[10];
 
 /****************************************************************************
@@ -49,6 +114,8 @@ void CleanupPath(char * path) {
  * Clears the file browser memory, and allocates one initial entry
  ***************************************************************************/
 void ResetBrowser() {
+    BrowserCancelScan();
+
     browser.numEntries = 0;
     browser.selIndex = 0;
     browser.pageIndex = 0;
@@ -61,6 +128,9 @@ void ResetBrowser() {
     // set aside space for 1 entry
     browserList = (BROWSERENTRY *) malloc(sizeof (BROWSERENTRY));
     memset(browserList, 0, sizeof (BROWSERENTRY));
+    browserListSize = 1;
+    browserListCount = 0;
+    browserListSorted = 0;
 }
 
 /****************************************************************************
@@ -219,97 +289,399 @@ int extAlwaysValid(char *ext) {
 
 int (*extValid)(char * ext) = NULL;
 
-/***************************************************************************
- * Browse subdirectories
- **************************************************************************/
-int ParseDirectory() {
-	DIR *dir = NULL;
-	char fulldir[MAXPATHLEN];
-	struct dirent *entry;
-	char * ext = NULL;
+/****************************************************************************
+ * AddBrowserEntry
+ *
+ * Appends a cleared entry, growing browserList geometrically
+ ***************************************************************************/
+static BROWSERENTRY * AddBrowserEntry() {
+	int entryNum = browserListCount;
 
-	if (extValid == NULL)
-		extValid = extAlwaysValid;
+	if (entryNum >= browserListSize) {
+		int size = browserListSize ? browserListSize * 2 : 64;
+		BROWSERENTRY * newBrowserList = (BROWSERENTRY *) realloc(browserList, size * sizeof (BROWSERENTRY));
 
-	// reset browser
-	ResetBrowser();
+		if (!newBrowserList) // failed to allocate required memory
+			return NULL;
 
-	// open the directory
-	sprintf(fulldir, "%s%s", rootdir, browser.dir); // add currentDevice to path
-	dir = opendir(fulldir);
+		browserList = newBrowserList;
+		browserListSize = size;
+	}
 
-	// if we can't open the dir, try opening the root dir
-	if (dir == NULL) {
-		sprintf(browser.dir, "/");
-		dir = opendir(rootdir);
-		if (dir == NULL) {
-			return -1;
+	memset(&(browserList[entryNum]), 0, sizeof (BROWSERENTRY)); // clear the new entry
+	browserListCount++;
+	return &browserList[entryNum];
+}
+
+/****************************************************************************
+ * MergeBrowserEntries
+ *
+ * Sorts the entries after the displayed ones and merges them in. The
+ * selected entry is followed, the page moves along with it so that a click
+ * on its row still opens it.
+ ***************************************************************************/
+static void MergeBrowserEntries() {
+	int entryNum = browserListCount;
+	int tail = entryNum - browserListSorted;
+	int sel = browser.selIndex;
+	int newSel = sel;
+
+	if (tail <= 0)
+		return;
+
+	qsort(&browserList[browserListSorted], tail, sizeof (BROWSERENTRY), FileSortCallback);
+
+	BROWSERENTRY * tmp = (BROWSERENTRY *) malloc(tail * sizeof (BROWSERENTRY));
+	if (tmp == NULL) {
+		char selName[MAXJOLIET + 1];
+
+		strcpy(selName, browserList[sel].filename);
+		qsort(browserList, entryNum, sizeof (BROWSERENTRY), FileSortCallback);
+		browserListSorted = entryNum;
+
+		while (newSel < entryNum - 1 && strcmp(browserList[newSel].filename, selName))
+			newSel++;
+		browser.selIndex = newSel;
+		browser.pageIndex += newSel - sel;
+		return;
+	}
+	memcpy(tmp, &browserList[browserListSorted], tail * sizeof (BROWSERENTRY));
+
+	// merge from the end, the sorted part only moves up
+	int i = browserListSorted - 1;
+	int j = tail - 1;
+	int k = entryNum - 1;
+	while (j >= 0) {
+		if (i >= 0 && FileSortCallback(&browserList[i], &tmp[j]) > 0) {
+			if (i == sel)
+				newSel = k;
+			browserList[k--] = browserList[i--];
+		} else
+			browserList[k--] = tmp[j--];
+	}
+
+	free(tmp);
+	browserListSorted = entryNum;
+
+	browser.selIndex = newSel;
+	browser.pageIndex += newSel - sel;
+}
+
+/****************************************************************************
+ * BrowserCacheFree
+ ***************************************************************************/
+static void BrowserCacheFree(BROWSERCACHEDIR * dir) {
+	free(dir->items);
+	free(dir->names);
+	browserCacheBytes -= dir->bytes;
+	memset(dir, 0, sizeof (BROWSERCACHEDIR));
+}
+
+/****************************************************************************
+ * BrowserFlushCache
+ *
+ * Forgets every cached listing, to be called when devices are mounted or
+ * files are written
+ ***************************************************************************/
+extern "C" void BrowserFlushCache() {
+	for (int i = 0; i < BROWSER_CACHE_DIRS; i++) {
+		if (browserCache[i].path[0])
+			BrowserCacheFree(&browserCache[i]);
+	}
+	browserCacheGen++;
+}
+
+/****************************************************************************
+ * BrowserCacheFind
+ *
+ * Returns the valid listing of path, stale ones are freed
+ ***************************************************************************/
+static BROWSERCACHEDIR * BrowserCacheFind(const char * path, time_t mtime) {
+	for (int i = 0; i < BROWSER_CACHE_DIRS; i++) {
+		BROWSERCACHEDIR * dir = &browserCache[i];
+
+		if (dir->path[0] == 0 || dir->filter != extValid || strcmp(dir->path, path))
+			continue;
+
+		if (dir->gen != browserCacheGen || dir->mtime != mtime) {
+			BrowserCacheFree(dir);
+			return NULL;
 		}
+
+		dir->lastUse = ++browserCacheUse;
+		return dir;
 	}
+	return NULL;
+}
 
-	// index files/folders
-	int entryNum = 0;
+/****************************************************************************
+ * BrowserCacheStore
+ *
+ * Keeps a copy of the complete, sorted browserList for the scanned directory
+ ***************************************************************************/
+static void BrowserCacheStore() {
+	int numEntries = 0;
+	int nameBytes = 0;
+	int i;
 
-	// always add an .. entry
-	if (strcmp(browser.dir, "/")) {
+	for (i = 0; i < browserListCount; i++) {
+		if (strcmp(browserList[i].filename, "..") == 0)
+			continue;
+		numEntries++;
+		nameBytes += strlen(browserList[i].filename);
+	}
 
-		BROWSERENTRY * newBrowserList = (BROWSERENTRY *) realloc(browserList, (entryNum + 1) * sizeof (BROWSERENTRY));
+	int bytes = numEntries * sizeof (BROWSERCACHEITEM) + nameBytes;
+
+	// too big, or flushed while scanning
+	if (bytes > BROWSER_CACHE_BYTES || browserScanGen != browserCacheGen)
+		return;
+
+	// same directory with another mtime
+	BROWSERCACHEDIR * dir = BrowserCacheFind(browserScanPath, browserScanMtime);
+	if (dir)
+		BrowserCacheFree(dir);
+
+	// make room, dropping the least recently used listings
+	for (;;) {
+		BROWSERCACHEDIR * lru = NULL;
+		dir = NULL;
+
+		for (i = 0; i < BROWSER_CACHE_DIRS; i++) {
+			if (browserCache[i].path[0] == 0) {
+				if (dir == NULL)
+					dir = &browserCache[i];
+			} else if (lru == NULL || browserCache[i].lastUse < lru->lastUse) {
+				lru = &browserCache[i];
+			}
+		}
 
-		browserList = newBrowserList;
+		if (dir && browserCacheBytes + bytes <= BROWSER_CACHE_BYTES)
+			break;
 
-		memset(&(browserList[entryNum]), 0, sizeof (BROWSERENTRY)); // clear the new entry
+		BrowserCacheFree(lru);
+	}
 
-		strncpy(browserList[entryNum].filename, "..", MAXJOLIET);
+	dir->items = (BROWSERCACHEITEM *) malloc(numEntries * sizeof (BROWSERCACHEITEM) + 1);
+	dir->names = (char *) malloc(nameBytes + 1);
 
-		sprintf(browserList[entryNum].displayname, "Up One Level");
-		browserList[entryNum].isdir = 1; // flag this as a dir
-		entryNum++;
+	if (dir->items == NULL || dir->names == NULL) {
+		BrowserCacheFree(dir);
+		return;
 	}
 
-	while ((entry = readdir(dir))) {
-		if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0))
+	char * name = dir->names;
+	BROWSERCACHEITEM * item = dir->items;
+
+	for (i = 0; i < browserListCount; i++) {
+		if (strcmp(browserList[i].filename, "..") == 0)
 			continue;
+		item->isdir = browserList[i].isdir;
+		item->type = browserList[i].type;
+		item->len = strlen(browserList[i].filename);
+		memcpy(name, browserList[i].filename, item->len);
+		name += item->len;
+		item++;
+	}
 
-		BROWSERENTRY * newBrowserList = (BROWSERENTRY *) realloc(browserList, (entryNum + 1) * sizeof (BROWSERENTRY));
+	strcpy(dir->path, browserScanPath);
+	dir->filter = extValid;
+	dir->mtime = browserScanMtime;
+	dir->gen = browserScanGen;
+	dir->lastUse = ++browserCacheUse;
+	dir->numEntries = numEntries;
+	dir->bytes = bytes;
+	browserCacheBytes += bytes;
+}
 
-		if (!newBrowserList) // failed to allocate required memory
-		{
-			ResetBrowser();
-			entryNum = -1;
+/****************************************************************************
+ * BrowserCacheRestore
+ *
+ * Appends a cached listing to browserList, already sorted
+ ***************************************************************************/
+static int BrowserCacheRestore(BROWSERCACHEDIR * dir) {
+	const char * name = dir->names;
+
+	for (int i = 0; i < dir->numEntries; i++) {
+		BROWSERCACHEITEM * item = &dir->items[i];
+		BROWSERENTRY * entry = AddBrowserEntry();
+
+		if (!entry)
+			return -1;
+
+		memcpy(entry->filename, name, item->len);
+		entry->filename[item->len] = 0;
+		snprintf(entry->displayname, sizeof(entry->displayname), "%.*s", MAXDISPLAY, entry->filename); // crop name for display
+		entry->isdir = item->isdir;
+		entry->type = (BROWSER_TYPE) item->type;
+		name += item->len;
+	}
+
+	browserListSorted = browserListCount;
+	browser.numEntries = browserListCount;
+	return 0;
+}
+
+/****************************************************************************
+ * BrowserListDone
+ *
+ * Records how long the current listing took, shown by the debug overlay
+ ***************************************************************************/
+static void BrowserListDone(int cached) {
+	browserLastMsec = tb_diff_msec(mftb(), browserScanStart);
+	browserLastCached = cached;
+}
+
+void BrowserGetCacheStats(int * hits, int * misses, int * last_msec, int * last_cached) {
+	*hits = browserCacheHits;
+	*misses = browserCacheMisses;
+	*last_msec = browserLastMsec;
+	*last_cached = browserLastCached;
+}
+
+/****************************************************************************
+ * BrowserUpdate
+ *
+ * Takes the entries found by the directory scan since the last call.
+ * New entries are merged into the displayed list once they are as many as
+ * the displayed ones (or the scan is over), so the first page shows up right
+ * away and the sorting cost stays O(n log n) over the whole scan.
+ * Returns 1 if browser.numEntries changed
+ ***************************************************************************/
+int BrowserUpdate() {
+	static DIRSCANENTRY entries[SCAN_ENTRIES_PER_UPDATE];
+	int done = 0;
+	int complete = 1;
+	int n, i;
+	char * ext = NULL;
+
+	if (browserScan == NULL)
+		return 0;
+
+	n = DirScanRead(browserScan, entries, SCAN_ENTRIES_PER_UPDATE, &done);
+
+	for (i = 0; i < n; i++) {
+		ext = strrchr(entries[i].name, '.');
+		if (!extValid(ext) && !entries[i].isdir)
+			continue;
+
+		BROWSERENTRY * entry = AddBrowserEntry();
+		if (!entry) {
+			done = 1;
+			complete = 0;
 			break;
-		} else {
-			browserList = newBrowserList;
 		}
-		memset(&(browserList[entryNum]), 0, sizeof (BROWSERENTRY)); // clear the new entry
 
-		strncpy(browserList[entryNum].filename, entry->d_name, MAXJOLIET);
+		strncpy(entry->filename, entries[i].name, MAXJOLIET);
 
-		//
-		ext = strrchr(entry->d_name, '.');
-		if (extValid(ext) || entry->d_type == DT_DIR) {
+		if (!entries[i].isdir)
+			entry->type = file_type(entries[i].name);
 
-			if (entry->d_type != DT_DIR)
-				browserList[entryNum].type = file_type(entry->d_name);
+		strncpy(entry->displayname, entries[i].name, MAXDISPLAY); // crop name for display
 
-			strncpy(browserList[entryNum].displayname, entry->d_name, MAXDISPLAY); // crop name for display
+		if (entries[i].isdir)
+			entry->isdir = 1; // flag this as a dir
+	}
 
-			if (entry->d_type == DT_DIR)
-				browserList[entryNum].isdir = 1; // flag this as a dir
-		} else {
-			continue;
+	if (done)
+		BrowserCancelScan();
+
+	if (done || browserListCount - browserListSorted >= browserListSorted || browserListSorted < FIRST_PAGE_ENTRIES)
+		MergeBrowserEntries();
+
+	if (done) {
+		browser.numEntries = browserListSorted;
+		if (complete && browserScanCacheable)
+			BrowserCacheStore();
+		BrowserListDone(0);
+		return 1;
+	}
+
+	if (browser.numEntries == browserListSorted)
+		return 0;
+
+	browser.numEntries = browserListSorted;
+	return 1;
+}
+
+/****************************************************************************
+ * BrowserCancelScan
+ *
+ * Stops listing the current directory, entries not taken yet are lost
+ ***************************************************************************/
+void BrowserCancelScan() {
+	if (browserScan == NULL)
+		return;
+
+	DirScanClose(browserScan);
+	browserScan = NULL;
+}
+
+/***************************************************************************
+ * Browse subdirectories
+ **************************************************************************/
+int ParseDirectory() {
+	char fulldir[MAXPATHLEN];
+	struct stat st;
+	BROWSERCACHEDIR * cached = NULL;
+
+	if (extValid == NULL)
+		extValid = extAlwaysValid;
+
+	// reset browser
+	ResetBrowser();
+
+	browserScanStart = mftb();
+
+	// open the directory
+	sprintf(fulldir, "%s%s", rootdir, browser.dir); // add currentDevice to path
+	strcpy(browserScanPath, fulldir);
+	browserScanCacheable = (stat(fulldir, &st) == 0);
+	browserScanMtime = browserScanCacheable ? st.st_mtime : 0;
+	browserScanGen = browserCacheGen;
+
+	if (browserScanCacheable)
+		cached = BrowserCacheFind(fulldir, browserScanMtime);
+
+	if (cached) {
+		browserCacheHits++;
+	} else {
+		browserCacheMisses++;
+		browserScan = DirScanStart(fulldir);
+	}
+
+	// if we can't open the dir, try opening the root dir
+	if (cached == NULL && browserScan == NULL) {
+		sprintf(browser.dir, "/");
+		browserScanCacheable = 0;
+		browserScan = DirScanStart(rootdir);
+		if (browserScan == NULL) {
+			return -1;
 		}
+	}
 
-		entryNum++;
+	// always add an .. entry
+	if (strcmp(browser.dir, "/")) {
+		BROWSERENTRY * entry = AddBrowserEntry();
+
+		strncpy(entry->filename, "..", MAXJOLIET);
+
+		sprintf(entry->displayname, "Up One Level");
+		entry->isdir = 1; // flag this as a dir
+		browserListSorted = 1;
+		browser.numEntries = 1;
 	}
 
-	// close directory
-	closedir(dir);
+	if (cached) {
+		BrowserCacheRestore(cached);
+		BrowserListDone(1);
+		return browser.numEntries;
+	}
 
-	// Sort the file list
-	qsort(browserList, entryNum, sizeof (BROWSERENTRY), FileSortCallback);
+	// the rest comes from BrowserUpdate()
+	BrowserUpdate();
 
-	browser.numEntries = entryNum;
-	return entryNum;
+	return browser.numEntries;
 }
 
 /****************************************************************************
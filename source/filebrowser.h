@@ -50,6 +50,10 @@ extern char rootdir[10];
 int UpdateDirName(int method);
 int FileSortCallback(const void *f1, const void *f2);
 void ResetBrowser();
+int BrowserUpdate();
+void BrowserCancelScan();
+void BrowserGetCacheStats(int * hits, int * misses, int * last_msec, int * last_cached);
+extern "C" void BrowserFlushCache();
 int BrowserChangeFolder();
 int BrowseDevice();
 int BrowseDevice(const char * dir, const char * root);
@@ -0,0 +1,159 @@
+/****************************************************************************
+ * image_loader.c
+ *
+ * The worker only lives while there are jobs queued, it doesn't keep a
+ * hardware thread of the pool busy during playback.
+ ***************************************************************************/
+
+#include <stdlib.h>
+
+#include "../mplayer/libxenon_miss/pthread.h"
+#include "image_loader.h"
+
+static int loader_init = 0;
+static pthread_mutex_t loader_mutex;
+static pthread_cond_t loader_done;
+static pthread_t loader_thread;
+static int loader_running = 0; // worker still taking jobs
+static int loader_joinable = 0; // worker started and not joined yet
+
+// under loader_mutex
+static IMAGEJOB * queue_head = NULL;
+static IMAGEJOB * queue_tail = NULL;
+
+static void ImageLoaderInit() {
+	if (loader_init)
+		return;
+
+	pthread_mutex_init(&loader_mutex, NULL);
+	pthread_cond_init(&loader_done, NULL);
+	loader_init = 1;
+}
+
+static void ImageJobDecode(IMAGEJOB * job) {
+	job->pixels = decodePNG(job->png, &job->width, &job->height);
+}
+
+// remove a queued job, called with loader_mutex held
+static void ImageJobUnlink(IMAGEJOB * job) {
+	IMAGEJOB ** prev = &queue_head;
+	IMAGEJOB * last = NULL;
+
+	while (*prev && *prev != job) {
+		last = *prev;
+		prev = &(*prev)->next;
+	}
+
+	if (*prev == NULL)
+		return;
+
+	*prev = job->next;
+	if (queue_tail == job)
+		queue_tail = last;
+	job->next = NULL;
+}
+
+static void * ImageLoaderThread(void * arg) {
+	IMAGEJOB * job;
+
+	pthread_mutex_lock(&loader_mutex);
+	while ((job = queue_head) != NULL) {
+		ImageJobUnlink(job);
+		job->state = IMAGEJOB_DECODING;
+		pthread_mutex_unlock(&loader_mutex);
+
+		ImageJobDecode(job);
+
+		pthread_mutex_lock(&loader_mutex);
+		job->state = IMAGEJOB_DONE;
+		pthread_cond_broadcast(&loader_done);
+	}
+	loader_running = 0;
+	pthread_mutex_unlock(&loader_mutex);
+
+	return NULL;
+}
+
+void ImageJobQueue(IMAGEJOB * job) {
+	pthread_attr_t attr;
+	int start;
+
+	if (job->state != IMAGEJOB_IDLE)
+		return;
+
+	ImageLoaderInit();
+
+	pthread_mutex_lock(&loader_mutex);
+	job->state = IMAGEJOB_QUEUED;
+	job->next = NULL;
+	if (queue_tail)
+		queue_tail->next = job;
+	else
+		queue_head = job;
+	queue_tail = job;
+
+	start = !loader_running;
+	loader_running = 1;
+	pthread_mutex_unlock(&loader_mutex);
+
+	if (!start)
+		return;
+
+	// the previous worker ran out of jobs
+	if (loader_joinable)
+		pthread_join(loader_thread, NULL);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setrole_np(&attr, XENON_THREAD_DECODE);
+	loader_joinable = (pthread_create(&loader_thread, &attr, ImageLoaderThread, NULL) == 0);
+	pthread_attr_destroy(&attr);
+
+	// no thread left, the jobs get decoded by ImageJobFinish()
+	if (!loader_joinable) {
+		pthread_mutex_lock(&loader_mutex);
+		loader_running = 0;
+		pthread_mutex_unlock(&loader_mutex);
+	}
+}
+
+void ImageJobFinish(IMAGEJOB * job) {
+	// never queued, only the main thread knows about it
+	if (job->state == IMAGEJOB_IDLE) {
+		ImageJobDecode(job);
+		job->state = IMAGEJOB_DONE;
+		return;
+	}
+
+	pthread_mutex_lock(&loader_mutex);
+	if (job->state == IMAGEJOB_QUEUED) {
+		// needed now, don't wait for the worker to get there
+		ImageJobUnlink(job);
+		job->state = IMAGEJOB_DECODING;
+		pthread_mutex_unlock(&loader_mutex);
+
+		ImageJobDecode(job);
+		job->state = IMAGEJOB_DONE;
+		return;
+	}
+
+	while (job->state != IMAGEJOB_DONE)
+		pthread_cond_wait(&loader_done, &loader_mutex);
+	pthread_mutex_unlock(&loader_mutex);
+}
+
+void ImageJobCancel(IMAGEJOB * job) {
+	if (job->state != IMAGEJOB_IDLE) {
+		pthread_mutex_lock(&loader_mutex);
+		if (job->state == IMAGEJOB_QUEUED)
+			ImageJobUnlink(job);
+		else {
+			while (job->state != IMAGEJOB_DONE)
+				pthread_cond_wait(&loader_done, &loader_mutex);
+		}
+		pthread_mutex_unlock(&loader_mutex);
+	}
+
+	free(job->pixels);
+	job->pixels = NULL;
+	job->state = IMAGEJOB_IDLE;
+}
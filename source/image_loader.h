@@ -0,0 +1,46 @@
+/****************************************************************************
+ * image_loader.h
+ *
+ * PNG decoding in a background thread, the texture upload is left to the
+ * caller since only the main thread talks to the gpu.
+ ***************************************************************************/
+
+#ifndef _IMAGE_LOADER_H_
+#define _IMAGE_LOADER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+	IMAGEJOB_IDLE,
+	IMAGEJOB_QUEUED,
+	IMAGEJOB_DECODING,
+	IMAGEJOB_DONE,
+};
+
+typedef struct imagejob {
+	const unsigned char * png;
+	unsigned char * pixels; // ARGB, width * height * 4, NULL if decoding failed
+	int width;
+	int height;
+	volatile int state;
+	struct imagejob * next;
+} IMAGEJOB;
+
+// decode job->png in the background
+void ImageJobQueue(IMAGEJOB * job);
+// make sure the job is decoded, the worker is not waited for if it didn't start it
+void ImageJobFinish(IMAGEJOB * job);
+// forget the job and its pixels
+void ImageJobCancel(IMAGEJOB * job);
+
+// utils.c
+unsigned char * decodePNG(const unsigned char * PNGdata, int * width, int * height);
+struct XenosSurface * loadTextureFromPixels(unsigned char * pixels, int width, int height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
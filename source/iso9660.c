@@ -6,11 +6,15 @@
  ****************************************************************************/
 
 #include <errno.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <malloc.h>
+#include <stdint.h>
 #include <sys/param.h>
 #include <sys/iosupport.h>
+#include <ppc/atomic.h>
 
 #include "iso9660.h"
 
@@ -24,8 +28,21 @@
 #define SECTOR_SIZE			0x800
 #define BUFFER_SIZE			0x8000
 
+// metadata cache, BUFFER_SIZE aligned blocks
+#define CACHE_BLOCKS		16
+#define BLOCK_SECTORS		(BUFFER_SIZE / SECTOR_SIZE)
+// window filled when reads are sequential
+#define READAHEAD_SIZE		0x40000
+#define READAHEAD_SECTORS	(READAHEAD_SIZE / SECTOR_SIZE)
+// reads at least this big go straight to the caller's buffer
+#define DIRECT_MIN			BUFFER_SIZE
+#define DIRECT_MAX_SECTORS	READAHEAD_SECTORS
+
 #define DIR_SEPARATOR		'/'
 
+// name lookup buckets per mounted image
+#define HASH_SIZE			4096
+
 #define FLAG_DIR 2
 
 struct pvd_s
@@ -55,12 +72,17 @@ typedef struct
 	char name[ISO_MAXPATHLEN];
 }__attribute__((packed)) PATHTABLE_ENTRY;
 
+struct dentry_s;
+struct hnode_s;
+
 typedef struct pentry_s
 {
 	u16 index;
 	u32 childCount;
 	PATHTABLE_ENTRY table_entry;
 	struct pentry_s *children;
+	struct dentry_s *listing; // directory records, read on first use
+	struct hnode_s *listing_nodes;
 } PATH_ENTRY;
 
 typedef struct dentry_s
@@ -74,16 +96,41 @@ typedef struct dentry_s
 	struct dentry_s *children;
 } DIR_ENTRY;
 
+// (directory index, name) -> entry, names are matched case insensitively
+typedef struct hnode_s
+{
+	u32 hash;
+	u16 parent;
+	PATH_ENTRY *dir; // directory from the path table
+	DIR_ENTRY *file; // or record from a directory listing
+	struct hnode_s *next;
+} HASH_NODE;
+
+typedef struct
+{
+	u8 data[BUFFER_SIZE] __attribute__((aligned(32)));
+	u32 start;
+	u32 last_use; // 0 if the block is empty
+} CACHE_BLOCK;
+
 typedef struct iso9660mount_s
 {
 	const DISC_INTERFACE *disc_interface;
-	u8 read_buffer[BUFFER_SIZE] __attribute__((aligned(32)));
+	// taken by _read() and entry_from_path(), the dir scan, the stream
+	// and the photo loader use the same mount from their own threads
+	unsigned int lock;
+	CACHE_BLOCK cache[CACHE_BLOCKS];
+	u32 cache_use;
+	u8 readahead_buffer[READAHEAD_SIZE] __attribute__((aligned(32)));
+	u32 readahead_start;
+	u32 readahead_sectors;
+	u32 next_sector; // sector after the last one read from the disc
 	u8 cluster_buffer[BUFFER_SIZE] __attribute__((aligned(32)));
-	u32 cache_start;
-	u32 cache_sectors;
 	bool iso_unicode;
 	PATH_ENTRY *iso_rootentry;
 	PATH_ENTRY *iso_currententry;
+	HASH_NODE *hash[HASH_SIZE];
+	HASH_NODE *dir_nodes;
 	char volume_id[32];
 } MOUNT_DESCR;
 
@@ -109,31 +156,116 @@ static __inline__ bool is_dir(DIR_ENTRY *entry)
 	return entry->flags & FLAG_DIR;
 }
 
+static CACHE_BLOCK *cache_find(MOUNT_DESCR *mdescr, u32 sector)
+{
+	u32 start = sector & ~(BLOCK_SECTORS - 1);
+	int i;
+
+	for (i = 0; i < CACHE_BLOCKS; i++)
+	{
+		CACHE_BLOCK *block = &mdescr->cache[i];
+		if (block->last_use && block->start == start)
+		{
+			block->last_use = ++mdescr->cache_use;
+			return block;
+		}
+	}
+	return NULL;
+}
+
+static CACHE_BLOCK *cache_fill(MOUNT_DESCR *mdescr, u32 sector)
+{
+	u32 start = sector & ~(BLOCK_SECTORS - 1);
+	CACHE_BLOCK *lru = &mdescr->cache[0];
+	int i;
+
+	for (i = 1; i < CACHE_BLOCKS; i++)
+	{
+		if (mdescr->cache[i].last_use < lru->last_use)
+			lru = &mdescr->cache[i];
+	}
+
+	if (!mdescr->disc_interface->readSectors(start, BLOCK_SECTORS, lru->data))
+	{
+		lru->last_use = 0;
+		return NULL;
+	}
+
+	lru->start = start;
+	lru->last_use = ++mdescr->cache_use;
+	mdescr->next_sector = start + BLOCK_SECTORS;
+	return lru;
+}
+
+static bool readahead_fill(MOUNT_DESCR *mdescr, u32 sector)
+{
+	if (!mdescr->disc_interface->readSectors(sector, READAHEAD_SECTORS, mdescr->readahead_buffer))
+	{
+		// probably past the end of the disc, the block cache will do
+		mdescr->readahead_sectors = 0;
+		return false;
+	}
+
+	mdescr->readahead_start = sector;
+	mdescr->readahead_sectors = READAHEAD_SECTORS;
+	mdescr->next_sector = sector + READAHEAD_SECTORS;
+	return true;
+}
+
+static __inline__ bool in_readahead(MOUNT_DESCR *mdescr, u32 sector)
+{
+	return mdescr->readahead_sectors && sector >= mdescr->readahead_start && sector < mdescr->readahead_start + mdescr->readahead_sectors;
+}
+
+/**
+ * Reads up to len bytes at offset, returns how many were read.
+ * Big sector aligned reads go straight to the caller's buffer. Small reads
+ * continuing the last disc access fill the read-ahead window, so streaming
+ * a file doesn't evict the directory sectors kept in the block cache.
+ * mdescr->lock must be held.
+ */
 static int __read(MOUNT_DESCR *mdescr, void *ptr, u64 offset, size_t len)
 {
 	u32 sector = offset / SECTOR_SIZE;
-	u32 end_sector = (offset + len - 1) / SECTOR_SIZE;
-	u32 sectors = MIN(BUFFER_SIZE / SECTOR_SIZE, end_sector - sector + 1);
 	u32 sector_offset = offset % SECTOR_SIZE;
 	const DISC_INTERFACE *disc = mdescr->disc_interface;
+	CACHE_BLOCK *block = NULL;
+	u8 *data;
+	u32 start, sectors;
 
-	len = MIN(BUFFER_SIZE - sector_offset, len);
-	if (mdescr->cache_sectors && sector >= mdescr->cache_start && (sector + sectors) <= (mdescr->cache_start + mdescr->cache_sectors))
+	if (sector_offset == 0 && len >= DIRECT_MIN && !((uintptr_t) ptr & 31))
 	{
-		memcpy(ptr, mdescr->read_buffer + (sector - mdescr->cache_start) * SECTOR_SIZE + sector_offset, len);
-		return len;
+		sectors = MIN(len / SECTOR_SIZE, DIRECT_MAX_SECTORS);
+		if (!disc->readSectors(sector, sectors, ptr))
+			return -1;
+		mdescr->next_sector = sector + sectors;
+		return sectors * SECTOR_SIZE;
 	}
 
-	if (!disc->readSectors(sector, BUFFER_SIZE / SECTOR_SIZE, mdescr->read_buffer))
+	if (!in_readahead(mdescr, sector))
 	{
-		mdescr->cache_sectors = 0;
-		return -1;
+		block = cache_find(mdescr, sector);
+		if (!block && (sector != mdescr->next_sector || !readahead_fill(mdescr, sector)))
+			block = cache_fill(mdescr, sector);
+		if (!block && !in_readahead(mdescr, sector))
+			return -1;
 	}
 
-	mdescr->cache_start = sector;
-	mdescr->cache_sectors = BUFFER_SIZE / SECTOR_SIZE;
-	memcpy(ptr, mdescr->read_buffer + sector_offset, len);
+	if (block)
+	{
+		data = block->data;
+		start = block->start;
+		sectors = BLOCK_SECTORS;
+	}
+	else
+	{
+		data = mdescr->readahead_buffer;
+		start = mdescr->readahead_start;
+		sectors = mdescr->readahead_sectors;
+	}
 
+	len = MIN((start + sectors - sector) * SECTOR_SIZE - sector_offset, len);
+	memcpy(ptr, data + (sector - start) * SECTOR_SIZE + sector_offset, len);
 	return len;
 }
 
@@ -141,6 +273,8 @@ static int _read(MOUNT_DESCR *mdescr, void *ptr, u64 offset, size_t len)
 {
 	int ret, read = 0;
 	char *cptr = ptr;
+
+	lock(&mdescr->lock);
 	while (read < len)
 	{
 		ret = __read(mdescr, cptr + read, offset + read, len - read);
@@ -149,8 +283,12 @@ static int _read(MOUNT_DESCR *mdescr, void *ptr, u64 offset, size_t len)
 		else if (ret == 0)
 			break;
 		else
-			return -1;
+		{
+			read = -1;
+			break;
+		}
 	}
+	unlock(&mdescr->lock);
 	return read;
 }
 
@@ -296,98 +434,187 @@ static bool read_directory(MOUNT_DESCR *mdescr, DIR_ENTRY *dir_entry, PATH_ENTRY
 	return true;
 }
 
-static bool path_entry_from_path(MOUNT_DESCR *mdescr, PATH_ENTRY *path_entry, const char *path)
+static u32 name_hash(u16 parent, const char *name, size_t len)
 {
-	bool found = false;
-	bool notFound = false;
+	u32 hash = 2166136261U ^ parent;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		hash = (hash ^ (u8) tolower((u8) name[i])) * 16777619U;
+	return hash;
+}
 
-	const char *pathPosition = path;
-	const char *pathEnd = strchr(path, '\0');
+static void hash_insert(MOUNT_DESCR *mdescr, HASH_NODE *node, u16 parent, const char *name)
+{
+	u32 bucket;
+
+	node->hash = name_hash(parent, name, strnlen(name, ISO_MAXPATHLEN - 1));
+	node->parent = parent;
+	bucket = node->hash & (HASH_SIZE - 1);
+	node->next = mdescr->hash[bucket];
+	mdescr->hash[bucket] = node;
+}
 
-	PATH_ENTRY *entry = mdescr->iso_rootentry;
-	while (pathPosition[0] == DIR_SEPARATOR)
-		pathPosition++;
-	if (pathPosition >= pathEnd)
-		found = true;
+static HASH_NODE *hash_find(MOUNT_DESCR *mdescr, u16 parent, const char *name, size_t len)
+{
+	u32 hash = name_hash(parent, name, len);
+	HASH_NODE *node;
 
-	PATH_ENTRY *dir = entry;
-	while (!found && !notFound)
+	for (node = mdescr->hash[hash & (HASH_SIZE - 1)]; node; node = node->next)
 	{
-		const char *nextPathPosition = strchr(pathPosition, DIR_SEPARATOR);
-		size_t dirnameLength;
-		if (nextPathPosition != NULL)
-			dirnameLength = nextPathPosition - pathPosition;
-		else
-			dirnameLength = strlen(pathPosition);
-		if (dirnameLength >= ISO_MAXPATHLEN)
-			return false;
+		const char *node_name = node->dir ? node->dir->table_entry.name : node->file->name;
+		if (node->hash == hash && node->parent == parent && len == strnlen(node_name, ISO_MAXPATHLEN - 1) && !strncasecmp(name, node_name, len))
+			return node;
+	}
+	return NULL;
+}
 
-		u32 childIndex = 0;
-		while (childIndex < dir->childCount && !found && !notFound)
-		{
-			entry = &dir->children[childIndex];
-			if (dirnameLength == strnlen(entry->table_entry.name, ISO_MAXPATHLEN - 1) && !strncasecmp(pathPosition, entry->table_entry.name, dirnameLength))
-				found = true;
-			if (!found)
-				childIndex++;
-		}
+static u32 count_directories(PATH_ENTRY *dir)
+{
+	u32 i, count = dir->childCount;
 
-		if (childIndex >= dir->childCount)
-		{
-			notFound = true;
-			found = false;
-		}
-		else if (!nextPathPosition || nextPathPosition >= pathEnd)
-		{
-			found = true;
-		}
-		else
-		{
-			dir = entry;
-			pathPosition = nextPathPosition;
-			while (pathPosition[0] == DIR_SEPARATOR)
-				pathPosition++;
-			if (pathPosition >= pathEnd)
-				found = true;
-			else
-				found = false;
-		}
+	for (i = 0; i < dir->childCount; i++)
+		count += count_directories(&dir->children[i]);
+	return count;
+}
+
+static HASH_NODE *hash_directories_recursive(MOUNT_DESCR *mdescr, PATH_ENTRY *dir, HASH_NODE *node)
+{
+	u32 i;
+
+	for (i = 0; i < dir->childCount; i++)
+	{
+		PATH_ENTRY *child = &dir->children[i];
+		node->dir = child;
+		node->file = NULL;
+		hash_insert(mdescr, node++, dir->index, child->table_entry.name);
+		node = hash_directories_recursive(mdescr, child, node);
 	}
+	return node;
+}
 
-	if (found)
-		memcpy(path_entry, entry, sizeof(PATH_ENTRY));
-	return found;
+/**
+ * Index every directory of the path table, it's already in memory so
+ * this costs no disc access
+ */
+static bool hash_directories(MOUNT_DESCR *mdescr)
+{
+	u32 count = count_directories(mdescr->iso_rootentry);
+
+	if (!count)
+		return true;
+
+	if (!(mdescr->dir_nodes = malloc(count * sizeof(HASH_NODE))))
+		return false;
+
+	hash_directories_recursive(mdescr, mdescr->iso_rootentry, mdescr->dir_nodes);
+	return true;
+}
+
+/**
+ * Records of a directory, read from the disc the first time and kept (with
+ * their names hashed) until the image is unmounted
+ */
+static DIR_ENTRY *directory_listing(MOUNT_DESCR *mdescr, PATH_ENTRY *path_entry)
+{
+	DIR_ENTRY *listing;
+	HASH_NODE *node;
+	u32 i;
+
+	if (path_entry->listing)
+		return path_entry->listing;
+
+	if (!(listing = malloc(sizeof(DIR_ENTRY))))
+		return NULL;
+	memset(listing, 0, sizeof(DIR_ENTRY));
+
+	if (!read_directory(mdescr, listing, path_entry) || (listing->fileCount && !(path_entry->listing_nodes = malloc(listing->fileCount * sizeof(HASH_NODE)))))
+	{
+		free(listing->children);
+		free(listing);
+		return NULL;
+	}
+
+	node = path_entry->listing_nodes;
+	for (i = 0; i < listing->fileCount; i++)
+	{
+		DIR_ENTRY *child = &listing->children[i];
+
+		// directories are already there from the path table
+		if (hash_find(mdescr, path_entry->index, child->name, strnlen(child->name, ISO_MAXPATHLEN - 1)))
+			continue;
+
+		node->dir = NULL;
+		node->file = child;
+		hash_insert(mdescr, node++, path_entry->index, child->name);
+	}
+
+	path_entry->listing = listing;
+	return listing;
+}
+
+static PATH_ENTRY *path_entry_from_path(MOUNT_DESCR *mdescr, const char *path)
+{
+	PATH_ENTRY *dir = mdescr->iso_rootentry;
+	const char *next;
+	size_t len;
+	HASH_NODE *node;
+
+	for (;;)
+	{
+		while (path[0] == DIR_SEPARATOR)
+			path++;
+		if (!path[0])
+			return dir;
+
+		next = strchr(path, DIR_SEPARATOR);
+		len = next ? (size_t) (next - path) : strlen(path);
+		if (len >= ISO_MAXPATHLEN)
+			return NULL;
+
+		node = hash_find(mdescr, dir->index, path, len);
+		if (!node || !node->dir)
+			return NULL;
+
+		dir = node->dir;
+		path += len;
+	}
 }
 
+/**
+ * entry->children points to the cached listing, it must not be freed
+ */
 static bool find_in_directory(MOUNT_DESCR *mdescr, DIR_ENTRY *entry, PATH_ENTRY *parent, const char *base)
 {
-	u32 childIdx;
+	DIR_ENTRY *listing;
+	HASH_NODE *node;
 	u32 nl = strlen(base);
 
-	if (!nl)
-		return read_directory(mdescr, entry, parent);
-
-	for (childIdx = 0; childIdx < parent->childCount; childIdx++)
+	if (nl)
 	{
-		PATH_ENTRY *child = parent->children + childIdx;
-		if (nl == strnlen(child->table_entry.name, ISO_MAXPATHLEN - 1) && !strncasecmp(base, child->table_entry.name, nl))
+		node = hash_find(mdescr, parent->index, base, nl);
+		if (!node)
 		{
-			return read_directory(mdescr, entry, child);
+			// a file, its directory may not be listed yet
+			if (!directory_listing(mdescr, parent))
+				return false;
+			node = hash_find(mdescr, parent->index, base, nl);
 		}
-	}
+		if (!node)
+			return false;
 
-	if (!read_directory(mdescr, entry, parent))
-		return false;
-	for (childIdx = 0; childIdx < entry->fileCount; childIdx++)
-	{
-		DIR_ENTRY *child = entry->children + childIdx;
-		if (nl == strnlen(child->name, ISO_MAXPATHLEN - 1) && !strncasecmp(base, child->name, nl))
+		if (node->file)
 		{
-			memcpy(entry, child, sizeof(DIR_ENTRY));
+			memcpy(entry, node->file, sizeof(DIR_ENTRY));
 			return true;
 		}
+		parent = node->dir;
 	}
-	return false;
+
+	if (!(listing = directory_listing(mdescr, parent)))
+		return false;
+	memcpy(entry, listing, sizeof(DIR_ENTRY));
+	return true;
 }
 
 static bool entry_from_path(MOUNT_DESCR *mdescr, DIR_ENTRY *entry, const char *const_path)
@@ -395,7 +622,7 @@ static bool entry_from_path(MOUNT_DESCR *mdescr, DIR_ENTRY *entry, const char *c
 	u32 len;
 	bool found = false;
 	char *path, *dir, *base;
-	PATH_ENTRY parent_entry;
+	PATH_ENTRY *parent_entry;
 
 	memset(entry, 0, sizeof(DIR_ENTRY));
 
@@ -409,14 +636,13 @@ static bool entry_from_path(MOUNT_DESCR *mdescr, DIR_ENTRY *entry, const char *c
 
 	dir = dirname(path);
 	base = basename(path);
-	if (!path_entry_from_path(mdescr, &parent_entry, dir))
-		goto done;
 
-	found = find_in_directory(mdescr, entry, &parent_entry, base);
-	if (!found && entry->children)
-		free(entry->children);
+	// listings are read and hashed on first use
+	lock(&mdescr->lock);
+	if ((parent_entry = path_entry_from_path(mdescr, dir)))
+		found = find_in_directory(mdescr, entry, parent_entry, base);
+	unlock(&mdescr->lock);
 
-done:
 	free(path);
 	free(dir);
 	return found;
@@ -461,8 +687,6 @@ static int _ISO9660_open_r(struct _reent *r, void *fileStruct, const char *path,
 	}
 	else if (is_dir(&entry))
 	{
-		if (entry.children)
-			free(entry.children);
 		r->_errno = EISDIR;
 		return -1;
 	}
@@ -604,9 +828,6 @@ static int _ISO9660_stat_r(struct _reent *r, const char *path, struct stat *st)
 	}
 
 	stat_entry(&entry, st);
-	if (entry.children)
-		free(entry.children);
-
 	return 0;
 }
 
@@ -634,8 +855,6 @@ static int _ISO9660_chdir_r(struct _reent *r, const char *path)
 	}
 
 	mdescr->iso_currententry = entry.path_entry;
-	if (entry.children)
-		free(entry.children);
 
 	return 0;
 }
@@ -716,8 +935,6 @@ static int _ISO9660_dirclose_r(struct _reent *r, DIR_ITER *dirState)
 	}
 
 	state->inUse = false;
-	if (state->entry.children)
-		free(state->entry.children);
 	return 0;
 }
 
@@ -835,6 +1052,12 @@ static void cleanup_recursive(PATH_ENTRY *entry)
 		cleanup_recursive(&entry->children[i]);
 	if (entry->children)
 		free(entry->children);
+	if (entry->listing)
+	{
+		free(entry->listing->children);
+		free(entry->listing);
+	}
+	free(entry->listing_nodes);
 }
 
 static struct pvd_s* read_volume_descriptor(MOUNT_DESCR *mdescr, u8 descriptor)
@@ -844,13 +1067,13 @@ static struct pvd_s* read_volume_descriptor(MOUNT_DESCR *mdescr, u8 descriptor)
 
 	for (sector = 16; sector < 32; sector++)
 	{
-		if (!disc->readSectors(sector, 1, mdescr->read_buffer))
+		if (!disc->readSectors(sector, 1, mdescr->cluster_buffer))
 			return NULL;
-		if (!memcmp(mdescr->read_buffer + 1, "CD001\1", 6))
+		if (!memcmp(mdescr->cluster_buffer + 1, "CD001\1", 6))
 		{
-			if (*mdescr->read_buffer == descriptor)
-				return (struct pvd_s*) mdescr->read_buffer;
-			else if (*mdescr->read_buffer == 0xff)
+			if (*mdescr->cluster_buffer == descriptor)
+				return (struct pvd_s*) mdescr->cluster_buffer;
+			else if (*mdescr->cluster_buffer == 0xff)
 				return NULL;
 		}
 	}
@@ -888,7 +1111,7 @@ static bool read_directories(MOUNT_DESCR *mdescr)
 	while (i < 0xffff && offset < path_table_len)
 	{
 		PATHTABLE_ENTRY entry;
-		if (__read(mdescr, &entry, (u64) path_table * SECTOR_SIZE + offset, sizeof(PATHTABLE_ENTRY)) != sizeof(PATHTABLE_ENTRY))
+		if (_read(mdescr, &entry, (u64) path_table * SECTOR_SIZE + offset, sizeof(PATHTABLE_ENTRY)) != sizeof(PATHTABLE_ENTRY))
 			return false; // kinda dodgy - could be reading too far
 		if (parent->index != entry.parent)
 			parent = entry_from_index(mdescr->iso_rootentry, entry.parent);
@@ -925,18 +1148,25 @@ static MOUNT_DESCR *_ISO9660_mdescr_constructor(const DISC_INTERFACE *disc_inter
 {
 	MOUNT_DESCR *mdescr = NULL;
 
-	mdescr = malloc(sizeof(MOUNT_DESCR));
+	// the buffers are read into directly
+	mdescr = memalign(32, sizeof(MOUNT_DESCR));
 	if (!mdescr)
 		return NULL;
 
 	mdescr->disc_interface = disc_interface;
-	mdescr->cache_start = 0;
-	mdescr->cache_sectors = 0;
+	mdescr->lock = 0;
+	memset(mdescr->cache, 0, sizeof(mdescr->cache));
+	mdescr->cache_use = 0;
+	mdescr->readahead_start = 0;
+	mdescr->readahead_sectors = 0;
+	mdescr->next_sector = 0;
 	mdescr->iso_unicode = false;
 	mdescr->iso_rootentry = NULL;
 	mdescr->iso_currententry = NULL;
+	memset(mdescr->hash, 0, sizeof(mdescr->hash));
+	mdescr->dir_nodes = NULL;
 
-	if (!read_directories(mdescr))
+	if (!read_directories(mdescr) || !hash_directories(mdescr))
 	{
 		free(mdescr);
 		return NULL;
@@ -1017,6 +1247,7 @@ bool ISO9660_Unmount(const char* name)
 		free(mdescr->iso_rootentry);
 	}
 
+	free(mdescr->dir_nodes);
 	free(mdescr);
 	free(devops);
 	return true;
@@ -54,6 +54,7 @@
 #include "../filelist.h"
 #include "../input.h"
 #include "../oggplayer.h"
+#include "../image_loader.h"
 
 
 extern FreeTypeGX *fontSystem[];
@@ -591,11 +592,31 @@ public:
 	//!Gets the image height
 	//!\return image height
 	int GetHeight();
+	//!Starts decoding the image in the background
+	void Prefetch();
+	//!Frees the texture, the image is decoded again when next used
+	void Unload();
+	//!Sets the group of the image data created from now on
+	//!\param g Group, set by the caller
+	static void SetGroup(int g);
+	//!Starts decoding every image of a group in the background
+	static void PrefetchGroup(int g);
+	//!Frees the textures of every image of a group
+	static void UnloadGroup(int g);
+	//!Gets the number and size of the textures loaded
+	static void GetStats(int * count, int * bytes);
 protected:
 	//    u8 * data; //!< Image data
-	struct XenosSurface * data;
+	struct XenosSurface * data; //!< Texture, NULL until the image is used
 	int height; //!< Height of image
 	int width; //!< Width of image
+	const u8 * png; //!< Embedded png
+	int group; //!< Group of the image, for UnloadGroup()
+	IMAGEJOB job; //!< Background decoding
+	GuiImageData * prev; //!< List of every image data
+	GuiImageData * next;
+	static GuiImageData * first;
+	static int currentGroup;
 };
 
 //!Display, manage, and manipulate images in the GUI
@@ -665,6 +686,7 @@ protected:
 	int imgType; //!< Type of image data (IMAGE_TEXTURE, IMAGE_COLOR, IMAGE_DATA)
 	//    u8 * image; //!< Poiner to image data. May be shared with GuiImageData data
 	struct XenosSurface * image;
+	GuiImageData * imageData; //!< Source of image for IMAGE_DATA, loaded when drawn
 	u8 * buf;
 	f32 imageangle; //!< Angle to draw the image
 	int tile; //!< Number of times to draw (tile) the image horizontally
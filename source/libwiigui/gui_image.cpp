@@ -16,6 +16,7 @@
  */
 GuiImage::GuiImage() {
     image = NULL;
+    imageData = NULL;
     width = 0;
     height = 0;
     imageangle = 0;
@@ -27,10 +28,10 @@ GuiImage::GuiImage() {
 GuiImage::GuiImage(GuiImageData * img) {
     //TR;
     image = NULL;
+    imageData = img;
     width = 0;
     height = 0;
     if (img) {
-        image = img->GetImage();
         width = img->GetWidth();
         height = img->GetHeight();
     }
@@ -42,6 +43,7 @@ GuiImage::GuiImage(GuiImageData * img) {
 
 GuiImage::GuiImage(struct XenosSurface * img, int w, int h) {
     image = img;
+    imageData = NULL;
     width = w;
     height = h;
     imageangle = 0;
@@ -53,6 +55,7 @@ GuiImage::GuiImage(struct XenosSurface * img, int w, int h) {
 GuiImage::GuiImage(int w, int h, XeColor c) {
     //image = (u8 *) memalign(32, w * h << 2);
     image = Xe_CreateTexture(g_pVideoDevice,w,h,0,(XE_FMT_8888|XE_FMT_ARGB),0);
+    imageData = NULL;
     width = w;
     height = h;
     imageangle = 0;
@@ -90,15 +93,18 @@ GuiImage::~GuiImage() {
 }
 
 struct XenosSurface * GuiImage::GetImage() {
+    // the texture of the image data may have been unloaded
+    if (imgType == IMAGE_DATA && imageData)
+        image = imageData->GetImage();
     return image;
 }
 
 void GuiImage::SetImage(GuiImageData * img) {
     image = NULL;
+    imageData = img;
     width = 0;
     height = 0;
     if (img) {
-        image = img->GetImage();
         width = img->GetWidth();
         height = img->GetHeight();
     }
@@ -107,6 +113,7 @@ void GuiImage::SetImage(GuiImageData * img) {
 
 void GuiImage::SetImage(struct XenosSurface * img, int w, int h) {
     image = img;
+    imageData = NULL;
     width = w;
     height = h;
     imgType = IMAGE_TEXTURE;
@@ -227,7 +234,10 @@ void GuiImage::ColorStripe(int shift) {
  * Draw the button on screen
  */
 void GuiImage::Draw() {
-    if (!image || !this->IsVisible() || tile == 0)
+    if (!this->IsVisible() || tile == 0)
+        return;
+
+    if (!this->GetImage())
         return;
 
     float currScaleX = this->GetScaleX();
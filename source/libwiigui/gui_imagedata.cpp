@@ -39,34 +39,70 @@ static void png_mem_read(png_structp png_ptr, png_bytep data, png_size_t length)
     src->offset += length;
 }
 
+GuiImageData * GuiImageData::first = NULL;
+int GuiImageData::currentGroup = 0;
+
+static int png_header_dim(const u8 * png, int offset) {
+    return (png[offset] << 24) | (png[offset + 1] << 16) | (png[offset + 2] << 8) | png[offset + 3];
+}
+
 /**
  * Constructor for the GuiImageData class.
+ * Only the png header is read, the image is decoded when first used.
  */
 GuiImageData::GuiImageData(const u8 * i, int maxw, int maxh) {
     data = NULL;
     width = 0;
     height = 0;
+    png = i;
+    group = currentGroup;
+    memset(&job, 0, sizeof (IMAGEJOB));
 
-    if (i){
-        //data = DecodePNG(i, &width, &height, maxw, maxh);
-        data = loadPNGFromMemory((unsigned char*)i);
-        width = data->width;
-        height = data->height;
+    if (i) {
+        // signature then the IHDR chunk
+        width = png_header_dim(i, 16);
+        height = png_header_dim(i, 20);
     }
+
+    prev = NULL;
+    next = first;
+    if (first)
+        first->prev = this;
+    first = this;
 }
 
 /**
  * Destructor for the GuiImageData class.
  */
 GuiImageData::~GuiImageData() {
-    if (data) {
-        //free(data);
-        Xe_DestroyTexture(g_pVideoDevice,data);
-        data = NULL;
-    }
+    Unload();
+
+    if (prev)
+        prev->next = next;
+    else
+        first = next;
+    if (next)
+        next->prev = prev;
 }
 
 XenosSurface * GuiImageData::GetImage() {
+    if (data || !png)
+        return data;
+
+    job.png = png;
+    ImageJobFinish(&job);
+
+    if (job.pixels) {
+        data = loadTextureFromPixels(job.pixels, job.width, job.height);
+        width = job.width;
+        height = job.height;
+    }
+    ImageJobCancel(&job);
+
+    // don't try again every frame
+    if (!data)
+        png = NULL;
+
     return data;
 }
 
@@ -77,3 +113,49 @@ int GuiImageData::GetWidth() {
 int GuiImageData::GetHeight() {
     return height;
 }
+
+void GuiImageData::Prefetch() {
+    if (data || !png)
+        return;
+
+    job.png = png;
+    ImageJobQueue(&job);
+}
+
+void GuiImageData::Unload() {
+    ImageJobCancel(&job);
+
+    if (data) {
+        Xe_DestroyTexture(g_pVideoDevice, data);
+        data = NULL;
+    }
+}
+
+void GuiImageData::SetGroup(int g) {
+    currentGroup = g;
+}
+
+void GuiImageData::PrefetchGroup(int g) {
+    for (GuiImageData * i = first; i; i = i->next) {
+        if (i->group == g)
+            i->Prefetch();
+    }
+}
+
+void GuiImageData::UnloadGroup(int g) {
+    for (GuiImageData * i = first; i; i = i->next) {
+        if (i->group == g)
+            i->Unload();
+    }
+}
+
+void GuiImageData::GetStats(int * count, int * bytes) {
+    *count = 0;
+    *bytes = 0;
+    for (GuiImageData * i = first; i; i = i->next) {
+        if (i->data) {
+            (*count)++;
+            *bytes += i->width * i->height * 4;
+        }
+    }
+}
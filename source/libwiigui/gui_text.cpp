@@ -133,6 +133,19 @@ GuiText::~GuiText() {
 }
 
 void GuiText::SetText(const char * t) {
+	// labels refreshed every frame keep their line cache, unless the
+	// language changed meanwhile
+	if (t && origText && text && !strcmp(t, origText)) {
+		wchar_t * translated = charToWideChar(gettext(t));
+		bool same = translated && !wcscmp(translated, text);
+
+		delete[] translated;
+		textScrollPos = 0;
+		textScrollInitialDelay = TEXT_SCROLL_INITIAL_DELAY;
+		if (same)
+			return;
+	}
+
 	if (origText)
 		free(origText);
 	if (text)
@@ -157,6 +170,12 @@ void GuiText::SetText(const char * t) {
 }
 
 void GuiText::SetWText(wchar_t * t) {
+	if (t && text && !origText && !wcscmp(t, text)) {
+		textScrollPos = 0;
+		textScrollInitialDelay = TEXT_SCROLL_INITIAL_DELAY;
+		return;
+	}
+
 	if (origText)
 		free(origText);
 	if (text)
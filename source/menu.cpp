@@ -16,6 +16,7 @@
 #include <xenon_soc/xenon_power.h>
 #include <sys/iosupport.h>
 #include <ppc/atomic.h>
+#include <ppc/timebase.h>
 //#include <network/network.h>
 #include <time/time.h>
 #include <elf/elf.h>
@@ -115,6 +116,8 @@
 #include "../build/fr_lang.h"
 
 #include "filebrowser.h"
+#include "photo_loader.h"
+#include "image_loader.h"
 
 #include "mplayer_func.h"
 #include "folder_video_icon_png.h"
@@ -308,10 +311,88 @@ static int last_menu;
 
 static int current_menu = HOME_PAGE;
 
+// texture groups, the ones not shown during playback are unloaded
+enum {
+	IMAGES_COMMON,
+	IMAGES_HOME,
+	IMAGES_BROWSER,
+	IMAGES_OSD,
+};
+
+// startup time, measured when the first frame is drawn
+static u64 startup_tb = 0;
+static int startup_msec = 0;
+
+/**
+ * Debug overlay, toggled by clicking both sticks of the first pad
+ */
+static int debug_overlay = 0;
+static GuiText * debug_overlay_txt = NULL;
+static GuiText * debug_overlay_dir_txt = NULL;
+static GuiText * debug_overlay_tex_txt = NULL;
+
+static void DrawDebugOverlay() {
+	u16 held = userInput[0].pad.btns_h;
+	u16 down = userInput[0].pad.btns_d;
+	int draw_calls, vertices;
+	uint32_t hits, misses;
+	int dir_hits, dir_misses, dir_msec, dir_cached;
+	int tex_count, tex_bytes;
+	char str[128];
+
+	if ((held & (PAD_BUTTON_LSTICK | PAD_BUTTON_RSTICK)) == (PAD_BUTTON_LSTICK | PAD_BUTTON_RSTICK)
+		&& (down & (PAD_BUTTON_LSTICK | PAD_BUTTON_RSTICK)))
+		debug_overlay = !debug_overlay;
+
+	if (!debug_overlay)
+		return;
+
+	if (debug_overlay_txt == NULL) {
+		debug_overlay_txt = new GuiText(NULL, 18, 0xFF00FF00);
+		debug_overlay_txt->SetAlignment(ALIGN_LEFT, ALIGN_TOP);
+		debug_overlay_txt->SetPosition(40, 20);
+
+		debug_overlay_dir_txt = new GuiText(NULL, 18, 0xFF00FF00);
+		debug_overlay_dir_txt->SetAlignment(ALIGN_LEFT, ALIGN_TOP);
+		debug_overlay_dir_txt->SetPosition(40, 40);
+
+		debug_overlay_tex_txt = new GuiText(NULL, 18, 0xFF00FF00);
+		debug_overlay_tex_txt->SetAlignment(ALIGN_LEFT, ALIGN_TOP);
+		debug_overlay_tex_txt->SetPosition(40, 60);
+	}
+
+	// refresh twice a second, the label itself goes through the text cache
+	if (FrameTimer % 30 == 0) {
+		Menu_GetDrawStats(&draw_calls, &vertices);
+		GetTextCacheStats(&hits, &misses);
+
+		sprintf(str, "draws: %d  vertices: %d  text cache: %u hits / %u misses", draw_calls, vertices, hits, misses);
+		debug_overlay_txt->SetText(str);
+
+		// cold vs warm directory listing
+		BrowserGetCacheStats(&dir_hits, &dir_misses, &dir_msec, &dir_cached);
+		sprintf(str, "last dir: %d ms (%s)  dir cache: %d hits / %d misses", dir_msec, dir_cached ? "cached" : "scanned", dir_hits, dir_misses);
+		debug_overlay_dir_txt->SetText(str);
+
+		GuiImageData::GetStats(&tex_count, &tex_bytes);
+		sprintf(str, "textures: %d resident, %d KB  first frame after %d ms", tex_count, tex_bytes / 1024, startup_msec);
+		debug_overlay_tex_txt->SetText(str);
+	}
+	debug_overlay_txt->Draw();
+	debug_overlay_dir_txt->Draw();
+	debug_overlay_tex_txt->Draw();
+}
+
 static void update() {
 	UpdatePads();
 	mainWindow->Draw();
+	DrawDebugOverlay();
 	Menu_Render();
+
+	if (startup_tb) {
+		startup_msec = tb_diff_msec(mftb(), startup_tb);
+		startup_tb = 0;
+	}
 	for (int i = 0; i < 4; i++) {
 		mainWindow->Update(&userInput[i]);
 	}
@@ -925,9 +1006,14 @@ int WindowPrompt(const char *title, const char *msg, const char *btn1Label, cons
 
 /** to do **/
 static void loadRessources() {
+	// nothing is decoded here, textures are loaded when first drawn
+	GuiImageData::SetGroup(IMAGES_HOME);
 	loadHomeRessources();
+	GuiImageData::SetGroup(IMAGES_BROWSER);
 	loadBrowserRessources();
+	GuiImageData::SetGroup(IMAGES_OSD);
 	loadOsdRessources();
+	GuiImageData::SetGroup(IMAGES_COMMON);
 }
 
 static void common_setup() {
@@ -1157,12 +1243,141 @@ extern "C" void mplayer_osd_draw(int level) {
 	UpdatePads();
 	Menu_Frame();
 	mainWindow->Draw();
+	DrawDebugOverlay();
+	Menu_Flush();
 	//Menu_Render();
 	for (int i = 0; i < 4; i++) {
 		mainWindow->Update(&userInput[i]);
 	}
 }
 
+/**
+ * Picture next to index in the browser list, -1 if none
+ */
+static int PhotoNeighbour(int index, int dir) {
+	for (int i = index + dir; i >= 0 && i < browser.numEntries; i += dir) {
+		if (!browserList[i].isdir && file_type(browserList[i].filename) == BROWSER_TYPE_PICTURE)
+			return i;
+	}
+	return -1;
+}
+
+static void PhotoPath(int index, char * path) {
+	path[0] = 0;
+	if (index < 0)
+		return;
+
+	sprintf(path, "%s/%s/%s", rootdir, browser.dir, browserList[index].filename);
+	CleanupPath(path);
+}
+
+/**
+ * Full screen picture viewer, left/right go through the pictures of the
+ * current directory, the neighbours are decoded in the background
+ */
+static void PhotoViewer() {
+	static char path[PHOTO_PATH_MAX];
+	static char next_path[PHOTO_PATH_MAX];
+	static char prev_path[PHOTO_PATH_MAX];
+	struct XenosSurface * texture = NULL;
+	int index = browser.selIndex;
+	int request = 1;
+	int shown = 0;
+	u64 request_tb = 0;
+	char str[256];
+
+	GuiWindow photoWindow(screenwidth, screenheight);
+	GuiImage photoBg(screenwidth, screenheight, (XeColor) {
+		255, 0, 0, 0
+	});
+	GuiImage photoImg;
+	photoImg.SetAlignment(ALIGN_CENTRE, ALIGN_MIDDLE);
+	GuiText photoTxt(NULL, 18, (XeColor) {
+		255, 255, 255, 255
+	});
+	photoTxt.SetAlignment(ALIGN_LEFT, ALIGN_BOTTOM);
+	photoTxt.SetPosition(40, -30);
+
+	photoWindow.Append(&photoBg);
+	photoWindow.Append(&photoImg);
+	photoWindow.Append(&photoTxt);
+
+	mainWindow->SetState(STATE_DISABLED);
+	mainWindow->Append(&photoWindow);
+
+	PhotoLoaderSetMaxSize(screenwidth, screenheight);
+
+	while (1) {
+		u16 down = userInput[0].pad.btns_d;
+		int failed;
+
+		if (down & PAD_BUTTON_B)
+			break;
+
+		if (down & (PAD_BUTTON_RIGHT | PAD_BUTTON_RB)) {
+			int i = PhotoNeighbour(index, 1);
+			if (i >= 0) {
+				index = i;
+				request = 1;
+			}
+		} else if (down & (PAD_BUTTON_LEFT | PAD_BUTTON_LB)) {
+			int i = PhotoNeighbour(index, -1);
+			if (i >= 0) {
+				index = i;
+				request = 1;
+			}
+		}
+
+		if (request) {
+			PhotoPath(index, path);
+			PhotoPath(PhotoNeighbour(index, 1), next_path);
+			PhotoPath(PhotoNeighbour(index, -1), prev_path);
+			PhotoLoaderRequest(path, next_path, prev_path);
+
+			request_tb = mftb();
+			request = 0;
+			shown = 0;
+			photoTxt.SetText("Loading...");
+		}
+
+		if (!shown) {
+			PHOTO * photo = PhotoLoaderGet(path, &failed);
+
+			if (photo) {
+				struct XenosSurface * old = texture;
+
+				texture = loadTextureFromPixels(photo->pixels, photo->width, photo->height);
+				photoImg.SetImage(texture, photo->width, photo->height);
+				if (old)
+					Xe_DestroyTexture(g_pVideoDevice, old);
+
+				// time to display, with a prefetched neighbour it's only the upload
+				int msec = tb_diff_msec(mftb(), request_tb);
+				sprintf(str, "%s  %dx%d  decoded in %d ms, shown after %d ms",
+						browserList[index].displayname, photo->src_width, photo->src_height,
+						photo->decode_msec, msec);
+				photoTxt.SetText(str);
+				shown = 1;
+			} else if (failed) {
+				photoImg.SetImage((struct XenosSurface *) NULL, 0, 0);
+				photoTxt.SetText("Can't load this picture");
+				shown = 1;
+			}
+		}
+
+		update();
+	}
+
+	PhotoLoaderStop();
+
+	mainWindow->Remove(&photoWindow);
+	mainWindow->SetState(STATE_DEFAULT);
+
+	photoImg.SetImage((struct XenosSurface *) NULL, 0, 0);
+	if (texture)
+		Xe_DestroyTexture(g_pVideoDevice, texture);
+}
+
 static void Browser(const char * title, const char * root) {
 	// apply correct icon
 	switch (current_menu) {
@@ -1178,6 +1393,7 @@ static void Browser(const char * title, const char * root) {
 		case BROWSE_PICTURE:
 			browser_folder_icon = browser_photo_folder_icon;
 			//browser_file_icon = browser_photo_icon;
+			extValid = extIsValidPictureExt;
 			break;
 		default:
 			extValid = extAlwaysValid;
@@ -1224,6 +1440,10 @@ static void Browser(const char * title, const char * root) {
 	char tmp[256];
 
 	while (current_menu == last_menu) {
+		// entries still coming from the directory scan
+		if (BrowserUpdate())
+			last_sel_item = -1;
+
 		if (last_sel_item != browser.selIndex) {
 			sprintf(tmp, "%d/%d", browser.selIndex + 1, browser.numEntries);
 			browser_pagecounter->SetText(tmp);
@@ -1267,6 +1487,10 @@ static void Browser(const char * title, const char * root) {
 
 					if (file_type(mplayer_filename) == BROWSER_TYPE_ELF) {
 						current_menu = MENU_ELF;
+					} else if (file_type(mplayer_filename) == BROWSER_TYPE_PICTURE) {
+						// stays in the browser, the list is kept
+						PhotoViewer();
+						gui_browser->TriggerUpdate();
 					} else {
 						current_menu = MENU_MPLAYER;
 					}
@@ -1290,6 +1514,8 @@ static void Browser(const char * title, const char * root) {
 	mainWindow->Remove(browser_pagecounter);
 	mainWindow->Remove(gui_browser);
 	mainWindow->Remove(&menuBtn);
+
+	BrowserCancelScan();
 }
 
 static void HomePage() {
@@ -1361,9 +1587,9 @@ static void HomePage() {
 					//				case 2:
 					//					current_menu = BROWSE_AUDIO;
 					//					break;
-					//				case 3:
-					//					current_menu = BROWSE_PICTURE;
-					//					break;
+				case 3:
+					current_menu = BROWSE_PICTURE;
+					break;
 				case 4:
 					current_menu = SETTINGS;
 					break;
@@ -1510,7 +1736,8 @@ static void do_mplayer(char * filename) {
 			"-really-quiet",
 			//"-demuxer","mkv",
 			"-menu",
-			"-lavdopts", "skiploopfilter=all:threads=5",
+			"-lavdopts", "adaptive:threads=5",
+			"-dr",
 			//"-vsync",
 
 			filename,
@@ -1529,6 +1756,13 @@ static void do_mplayer(char * filename) {
 void MenuMplayer() {
 	//sprintf(foldername, "%s/", browser.dir);
 	printf("filename:%s\r\n", mplayer_filename);
+
+	// only the osd is drawn while playing, leave the memory to the player
+	GuiImageData::UnloadGroup(IMAGES_COMMON);
+	GuiImageData::UnloadGroup(IMAGES_HOME);
+	GuiImageData::UnloadGroup(IMAGES_BROWSER);
+	GuiImageData::PrefetchGroup(IMAGES_OSD);
+
 	do_mplayer(mplayer_filename);
 }
 
@@ -1618,6 +1852,7 @@ void loadingThread() {
 }
 
 int main(int argc, char** argv) {
+	startup_tb = mftb();
 	xenon_make_it_faster(XENON_SPEED_FULL);
 	//	
 	// Init Video
@@ -1668,6 +1903,13 @@ int main(int argc, char** argv) {
 		unlock(&loadingThreadLock);
 	}
 
+	// not before, the pthread pool doesn't know the loading thread holds
+	// hardware thread 2 and would give it to the image loader.
+	// The home page comes first
+	GuiImageData::PrefetchGroup(IMAGES_COMMON);
+	GuiImageData::PrefetchGroup(IMAGES_HOME);
+	GuiImageData::PrefetchGroup(IMAGES_BROWSER);
+
 	current_menu = HOME_PAGE;
 	while (1) {
 		// never exit !!
@@ -1697,6 +1939,11 @@ extern "C" void mplayer_return_to_gui() {
 
 	current_menu = last_menu;
 
+	// back to the browser, decode what was unloaded for playback
+	GuiImageData::PrefetchGroup(IMAGES_BROWSER);
+	GuiImageData::PrefetchGroup(IMAGES_COMMON);
+	GuiImageData::PrefetchGroup(IMAGES_HOME);
+
 	TR;
 	gui_loop();
 }
@@ -479,6 +479,7 @@ static void UnmountPartitions(int device) {
 
 
 extern int XTAFMount();
+extern void BrowserFlushCache();
 
 void sleep(int i) {
 	delay(i);
@@ -497,4 +498,6 @@ void mount_all_devices() {
 	if (xenon_atapi_ops.isInserted()) {
 		FindPartitions(DEVICE_ATAPI);
 	}
+	// listings of the previous mounts are meaningless now
+	BrowserFlushCache();
 }
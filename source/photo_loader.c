@@ -0,0 +1,399 @@
+/****************************************************************************
+ * photo_loader.c
+ *
+ * Pictures are decoded with libavcodec and scaled to the screen with
+ * swscale. Jpegs use lowres, the idct outputs 1/2, 1/4 or 1/8 of the size
+ * so a 20 megapixel photo is never decoded at full resolution.
+ *
+ * At most PHOTO_SLOTS screen sized pictures are kept, plus the one being
+ * decoded.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xetypes.h>
+#include <ppc/timebase.h>
+#include <time/time.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+
+#include "../mplayer/libxenon_miss/pthread.h"
+#include "photo_loader.h"
+
+#define PHOTO_SLOTS 3
+
+enum {
+	SLOT_EMPTY,
+	SLOT_DONE,
+	SLOT_FAILED,
+};
+
+typedef struct {
+	char path[PHOTO_PATH_MAX];
+	int state;
+	PHOTO photo;
+} PHOTOSLOT;
+
+static int loader_init = 0;
+static pthread_mutex_t loader_mutex;
+static pthread_t loader_thread;
+static int loader_running = 0; // worker still taking requests
+static int loader_joinable = 0; // worker started and not joined yet
+
+static int max_width = 1280;
+static int max_height = 720;
+
+// under loader_mutex
+static PHOTOSLOT slots[PHOTO_SLOTS];
+static char wanted[PHOTO_SLOTS][PHOTO_PATH_MAX];
+
+static int PhotoWanted(const char * path) {
+	int i;
+
+	for (i = 0; i < PHOTO_SLOTS; i++) {
+		if (wanted[i][0] && strcmp(wanted[i], path) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static PHOTOSLOT * PhotoFind(const char * path) {
+	int i;
+
+	for (i = 0; i < PHOTO_SLOTS; i++) {
+		if (slots[i].state != SLOT_EMPTY && strcmp(slots[i].path, path) == 0)
+			return &slots[i];
+	}
+	return NULL;
+}
+
+static void PhotoSlotFree(PHOTOSLOT * slot) {
+	free(slot->photo.pixels);
+	memset(slot, 0, sizeof (PHOTOSLOT));
+}
+
+static const char * PhotoExt(const char * path) {
+	const char * ext = strrchr(path, '.');
+	return ext ? ext : "";
+}
+
+/**
+ * Size from the SOF marker, needed before opening the decoder to pick lowres
+ */
+static int PhotoJpegSize(const unsigned char * buf, int size, int * width, int * height) {
+	int pos = 2;
+
+	while (pos + 9 < size) {
+		int marker, len;
+
+		if (buf[pos] != 0xFF) {
+			pos++;
+			continue;
+		}
+		marker = buf[pos + 1];
+		if (marker == 0xFF) {
+			pos++;
+			continue;
+		}
+
+		// SOF0 - SOF15, except DHT, JPG and DAC
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+			*height = (buf[pos + 5] << 8) | buf[pos + 6];
+			*width = (buf[pos + 7] << 8) | buf[pos + 8];
+			return 0;
+		}
+
+		// markers without a segment
+		if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+			pos += 2;
+			continue;
+		}
+		if (marker == 0xD9 || marker == 0xDA)
+			break;
+
+		len = (buf[pos + 2] << 8) | buf[pos + 3];
+		pos += 2 + len;
+	}
+	return -1;
+}
+
+static void PhotoFit(int width, int height, int * out_width, int * out_height) {
+	if (width <= max_width && height <= max_height) {
+		*out_width = width;
+		*out_height = height;
+	} else if ((long long) width * max_height > (long long) height * max_width) {
+		*out_width = max_width;
+		*out_height = (long long) height * max_width / width;
+	} else {
+		*out_height = max_height;
+		*out_width = (long long) width * max_height / height;
+	}
+
+	if (*out_width < 1)
+		*out_width = 1;
+	if (*out_height < 1)
+		*out_height = 1;
+}
+
+static int PhotoDecodeFrame(AVCodec * codec, unsigned char * buf, int size, int lowres, PHOTO * photo) {
+	AVCodecContext * avctx;
+	AVFrame * frame;
+	AVPacket pkt;
+	struct SwsContext * sws;
+	int got_picture = 0;
+	int ret = -1;
+
+	avctx = avcodec_alloc_context3(codec);
+	frame = avcodec_alloc_frame();
+	if (avctx == NULL || frame == NULL)
+		goto out;
+
+	avctx->lowres = lowres;
+	if (avcodec_open2(avctx, codec, NULL) < 0)
+		goto out;
+
+	av_init_packet(&pkt);
+	pkt.data = buf;
+	pkt.size = size;
+	if (avcodec_decode_video2(avctx, frame, &got_picture, &pkt) < 0 || !got_picture)
+		goto close;
+
+	if (photo->src_width == 0) {
+		photo->src_width = avctx->width;
+		photo->src_height = avctx->height;
+	}
+	PhotoFit(photo->src_width, photo->src_height, &photo->width, &photo->height);
+
+	sws = sws_getContext(avctx->width, avctx->height, avctx->pix_fmt,
+			photo->width, photo->height, PIX_FMT_ARGB, SWS_BILINEAR, NULL, NULL, NULL);
+	if (sws) {
+		photo->pixels = (unsigned char *) malloc(photo->width * photo->height * 4);
+		if (photo->pixels) {
+			uint8_t * dst[4] = {photo->pixels, NULL, NULL, NULL};
+			int dst_stride[4] = {photo->width * 4, 0, 0, 0};
+
+			sws_scale(sws, (const uint8_t * const *) frame->data, frame->linesize, 0, avctx->height, dst, dst_stride);
+			photo->lowres = lowres;
+			ret = 0;
+		}
+		sws_freeContext(sws);
+	}
+
+close:
+	avcodec_close(avctx);
+out:
+	av_free(frame);
+	av_free(avctx);
+	return ret;
+}
+
+static int PhotoDecode(const char * path, PHOTO * photo) {
+	const char * ext = PhotoExt(path);
+	enum CodecID codec_id;
+	AVCodec * codec;
+	unsigned char * buf;
+	u64 start = mftb();
+	FILE * fd;
+	long size;
+	int lowres = 0;
+	int ret;
+
+	memset(photo, 0, sizeof (PHOTO));
+
+	if (strcasecmp(ext, ".jpg") == 0 || strcasecmp(ext, ".jpeg") == 0)
+		codec_id = CODEC_ID_MJPEG;
+	else if (strcasecmp(ext, ".png") == 0)
+		codec_id = CODEC_ID_PNG;
+	else if (strcasecmp(ext, ".bmp") == 0)
+		codec_id = CODEC_ID_BMP;
+	else
+		return -1;
+
+	avcodec_register_all();
+	codec = avcodec_find_decoder(codec_id);
+	if (codec == NULL)
+		return -1;
+
+	fd = fopen(path, "rb");
+	if (fd == NULL)
+		return -1;
+
+	// -1 or an empty file, nothing to decode
+	if (fseek(fd, 0, SEEK_END) < 0 || (size = ftell(fd)) <= 0 || fseek(fd, 0, SEEK_SET) < 0) {
+		fclose(fd);
+		return -1;
+	}
+
+	// the decoders read a bit past the end
+	buf = (unsigned char *) av_malloc(size + FF_INPUT_BUFFER_PADDING_SIZE);
+	if (buf == NULL || fread(buf, 1, size, fd) != size) {
+		fclose(fd);
+		av_free(buf);
+		return -1;
+	}
+	fclose(fd);
+	memset(buf + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+
+	if (codec_id == CODEC_ID_MJPEG && PhotoJpegSize(buf, size, &photo->src_width, &photo->src_height) == 0) {
+		int out_width, out_height;
+
+		// smallest idct output still at least the size on screen
+		PhotoFit(photo->src_width, photo->src_height, &out_width, &out_height);
+		while (lowres < codec->max_lowres
+				&& (photo->src_width >> (lowres + 1)) >= out_width
+				&& (photo->src_height >> (lowres + 1)) >= out_height)
+			lowres++;
+	}
+
+	ret = PhotoDecodeFrame(codec, buf, size, lowres, photo);
+	// lowres isn't supported for every subsampling
+	if (ret < 0 && lowres)
+		ret = PhotoDecodeFrame(codec, buf, size, 0, photo);
+
+	av_free(buf);
+
+	photo->decode_msec = tb_diff_msec(mftb(), start);
+
+	return ret;
+}
+
+// next wanted picture not decoded yet, under loader_mutex
+static int PhotoLoaderNext(char * path) {
+	int i;
+
+	for (i = 0; i < PHOTO_SLOTS; i++) {
+		if (wanted[i][0] && PhotoFind(wanted[i]) == NULL) {
+			strcpy(path, wanted[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// under loader_mutex
+static void PhotoLoaderStore(const char * path, PHOTO * photo, int failed) {
+	int i;
+
+	if (!PhotoWanted(path)) {
+		free(photo->pixels);
+		return;
+	}
+
+	for (i = 0; i < PHOTO_SLOTS; i++) {
+		if (slots[i].state == SLOT_EMPTY || !PhotoWanted(slots[i].path))
+			break;
+	}
+	if (i == PHOTO_SLOTS) {
+		free(photo->pixels);
+		return;
+	}
+
+	PhotoSlotFree(&slots[i]);
+	strcpy(slots[i].path, path);
+	slots[i].photo = *photo;
+	slots[i].state = failed ? SLOT_FAILED : SLOT_DONE;
+}
+
+static void * PhotoLoaderThread(void * arg) {
+	static char path[PHOTO_PATH_MAX];
+	PHOTO photo;
+	int ret;
+
+	pthread_mutex_lock(&loader_mutex);
+	while (PhotoLoaderNext(path)) {
+		pthread_mutex_unlock(&loader_mutex);
+
+		ret = PhotoDecode(path, &photo);
+
+		pthread_mutex_lock(&loader_mutex);
+		PhotoLoaderStore(path, &photo, ret < 0);
+	}
+	loader_running = 0;
+	pthread_mutex_unlock(&loader_mutex);
+
+	return NULL;
+}
+
+void PhotoLoaderSetMaxSize(int width, int height) {
+	max_width = width;
+	max_height = height;
+}
+
+void PhotoLoaderRequest(const char * current, const char * next, const char * prev) {
+	const char * paths[PHOTO_SLOTS] = {current, next, prev};
+	pthread_attr_t attr;
+	char path[PHOTO_PATH_MAX];
+	int start;
+	int i;
+
+	if (!loader_init) {
+		pthread_mutex_init(&loader_mutex, NULL);
+		loader_init = 1;
+	}
+
+	pthread_mutex_lock(&loader_mutex);
+	for (i = 0; i < PHOTO_SLOTS; i++) {
+		wanted[i][0] = 0;
+		if (paths[i])
+			snprintf(wanted[i], PHOTO_PATH_MAX, "%s", paths[i]);
+	}
+
+	// keep the memory bounded, drop what isn't around the current picture
+	for (i = 0; i < PHOTO_SLOTS; i++) {
+		if (slots[i].state != SLOT_EMPTY && !PhotoWanted(slots[i].path))
+			PhotoSlotFree(&slots[i]);
+	}
+
+	start = !loader_running && PhotoLoaderNext(path);
+	if (start)
+		loader_running = 1;
+	pthread_mutex_unlock(&loader_mutex);
+
+	if (!start)
+		return;
+
+	// the previous worker ran out of pictures
+	if (loader_joinable)
+		pthread_join(loader_thread, NULL);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setrole_np(&attr, XENON_THREAD_DECODE);
+	loader_joinable = (pthread_create(&loader_thread, &attr, PhotoLoaderThread, NULL) == 0);
+	pthread_attr_destroy(&attr);
+
+	// no thread left, decode here
+	if (!loader_joinable)
+		PhotoLoaderThread(NULL);
+}
+
+PHOTO * PhotoLoaderGet(const char * path, int * failed) {
+	PHOTOSLOT * slot;
+	PHOTO * photo = NULL;
+
+	*failed = 0;
+	if (!loader_init)
+		return NULL;
+
+	pthread_mutex_lock(&loader_mutex);
+	slot = PhotoFind(path);
+	if (slot && slot->state == SLOT_DONE)
+		photo = &slot->photo;
+	else if (slot)
+		*failed = 1;
+	pthread_mutex_unlock(&loader_mutex);
+
+	return photo;
+}
+
+void PhotoLoaderStop() {
+	if (!loader_init)
+		return;
+
+	PhotoLoaderRequest(NULL, NULL, NULL);
+
+	if (loader_joinable) {
+		pthread_join(loader_thread, NULL);
+		loader_joinable = 0;
+	}
+}
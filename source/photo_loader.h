@@ -0,0 +1,40 @@
+/****************************************************************************
+ * photo_loader.h
+ *
+ * Pictures decoded to screen size in a background thread, the current one
+ * and its neighbours in the browser are kept.
+ ***************************************************************************/
+
+#ifndef _PHOTO_LOADER_H_
+#define _PHOTO_LOADER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PHOTO_PATH_MAX 2048
+
+typedef struct {
+	unsigned char * pixels; // ARGB, width * height * 4
+	int width;
+	int height;
+	int src_width; // size in the file
+	int src_height;
+	int lowres; // jpeg idct scaled down by 1 << lowres
+	int decode_msec;
+} PHOTO;
+
+// decode at most max_width x max_height, keeps the aspect ratio
+void PhotoLoaderSetMaxSize(int max_width, int max_height);
+// pictures to keep, by priority, other ones are freed. NULL or "" for none
+void PhotoLoaderRequest(const char * current, const char * next, const char * prev);
+// NULL until decoded, the photo is valid until the next request
+PHOTO * PhotoLoaderGet(const char * path, int * failed);
+// wait for the worker and free everything
+void PhotoLoaderStop();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+/****************************************************************************
+ * pixel_convert.c
+ *
+ * The swizzle is a byte permutation, the vector paths use the same mask on
+ * altivec and with gcc vector extensions, the scalar one rotates words in
+ * the host byte order.
+ ***************************************************************************/
+
+#include <string.h>
+#ifdef __ALTIVEC__
+#include <altivec.h>
+#endif
+
+#include "pixel_convert.h"
+
+#if !defined(__ALTIVEC__) && defined(__GNUC__) && !defined(__clang__) && \
+        (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#define PIXEL_VECTOR_EXT
+typedef unsigned char v16u8 __attribute__((vector_size(16), may_alias));
+#endif
+
+static inline uint32_t rgba_to_argb(uint32_t w) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return (w >> 8) | (w << 24);
+#else
+        return (w << 8) | (w >> 24);
+#endif
+}
+
+void PixelSwizzleRGBAToARGB(uint8_t * p, int pixels) {
+        uint32_t * w = (uint32_t *) p;
+        int i = 0;
+
+#if defined(__ALTIVEC__) || defined(PIXEL_VECTOR_EXT)
+        // up to 16 bytes alignment
+        for (; i < pixels && ((uintptr_t) (w + i) & 15); i++)
+                w[i] = rgba_to_argb(w[i]);
+#endif
+
+#ifdef __ALTIVEC__
+        const vector unsigned char perm = {3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14};
+
+        for (; i + 4 <= pixels; i += 4) {
+                vector unsigned char v = vec_ld(0, (unsigned char *) (w + i));
+                vec_st(vec_perm(v, v, perm), 0, (unsigned char *) (w + i));
+        }
+#elif defined(PIXEL_VECTOR_EXT)
+        const v16u8 perm = {3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14};
+
+        for (; i + 4 <= pixels; i += 4) {
+                v16u8 * v = (v16u8 *) (w + i);
+                *v = __builtin_shuffle(*v, perm);
+        }
+#endif
+
+        for (; i < pixels; i++)
+                w[i] = rgba_to_argb(w[i]);
+}
+
+void PixelFillPadding(uint8_t * buf, int width, int height, int wpitch, int hpitch) {
+        int row = width * 4;
+        int y, x;
+
+        for (y = 0; y < height; y++) {
+                uint8_t * line = buf + y * wpitch;
+                for (x = row; x < wpitch; x += row)
+                        memcpy(line + x, line, (wpitch - x < row) ? wpitch - x : row);
+        }
+
+        for (y = height; y < hpitch; y++)
+                memcpy(buf + y * wpitch, buf + (y - height) * wpitch, wpitch);
+}
@@ -0,0 +1,32 @@
+/****************************************************************************
+ * pixel_convert.h
+ *
+ * Pixel kernels of the png loader, no gpu involved so they can be checked
+ * on the host.
+ ***************************************************************************/
+
+#ifndef _PIXEL_CONVERT_H_
+#define _PIXEL_CONVERT_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * RGBA -> ARGB in place, p is 4 bytes aligned
+ */
+void PixelSwizzleRGBAToARGB(uint8_t * p, int pixels);
+
+/**
+ * Repeats a width x height image over the padding of a wpitch x hpitch
+ * surface, wpitch in bytes
+ */
+void PixelFillPadding(uint8_t * buf, int width, int height, int wpitch, int hpitch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
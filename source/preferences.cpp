@@ -11,6 +11,7 @@
 #include <dirent.h>
 #include <mxml.h>
 #include "mplayer_cfg.h"
+#include "filebrowser.h"
 
 #define MAXPATHLEN 256
 #define SAVEBUFFERSIZE (1024 * 512)
@@ -245,6 +246,9 @@ size_t SaveFile(char * buffer, char *filepath, size_t datasize, bool silent) {
 	}
 	fclose(file);
 
+	// the directory changed under the browser
+	BrowserFlushCache();
+
 	if (written != datasize)
 		written = 0;
 
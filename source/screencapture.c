@@ -3,6 +3,8 @@
 #include <time/time.h>
 #include <byteswap.h>
 
+extern void BrowserFlushCache();
+
 struct ati_info {
     uint32_t unknown1[4];
     uint32_t base;
@@ -53,6 +55,7 @@ void doScreenCapture(){
         png_destroy_write_struct(&png_ptr_w, &info_ptr_w);
 
         fclose(outfp);
+        BrowserFlushCache();
 
         printf("ScreenCapture : File saved to : %s\r\n", filename);
 }
\ No newline at end of file
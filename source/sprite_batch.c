@@ -0,0 +1,77 @@
+/****************************************************************************
+ * sprite_batch.c
+ *
+ * Quads are kept in submission order, a run ends when the texture or the
+ * shader changes, so blending stays the same as with one draw per quad.
+ ***************************************************************************/
+
+#include <string.h>
+
+#include "sprite_batch.h"
+
+// the gpu wants the stream start aligned
+#define RUN_ALIGN 512
+
+void SpriteBatch_Init(SpriteBatch * b, const SpriteBatchOps * ops, void * ctx, int base, int size) {
+        memset(b, 0, sizeof (SpriteBatch));
+        b->ops = ops;
+        b->ctx = ctx;
+        b->base = base;
+        b->size = size;
+        b->offset = base;
+}
+
+/**
+ * Start a new frame, the previous frame must be flushed and done with the
+ * vertex buffer.
+ */
+void SpriteBatch_Begin(SpriteBatch * b) {
+        b->count = 0;
+        b->offset = b->base;
+
+        b->last_draw_calls = b->draw_calls;
+        b->last_sprites = b->sprites;
+        b->last_dropped = b->dropped;
+
+        b->draw_calls = 0;
+        b->sprites = 0;
+        b->dropped = 0;
+}
+
+void SpriteBatch_Flush(SpriteBatch * b) {
+        int bytes;
+        void * dst;
+
+        if (b->count == 0)
+                return;
+
+        bytes = b->count * SPRITE_VERTICES * sizeof (DrawVerticeFormats);
+
+        if (b->offset + bytes > b->size) {
+                // out of vertex buffer for this frame
+                b->dropped += b->count;
+                b->count = 0;
+                return;
+        }
+
+        dst = b->ops->lock(b->ctx, b->offset, bytes);
+        memcpy(dst, b->verts, bytes);
+        b->ops->unlock(b->ctx);
+
+        b->ops->draw(b->ctx, b->texture, b->shader, b->offset, b->count);
+
+        b->draw_calls++;
+        b->offset = (b->offset + bytes + RUN_ALIGN - 1) & ~(RUN_ALIGN - 1);
+        b->count = 0;
+}
+
+void SpriteBatch_Add(SpriteBatch * b, void * texture, int shader, const DrawVerticeFormats * v) {
+        if (b->count && (b->texture != texture || b->shader != shader || b->count == SPRITE_BATCH_MAX))
+                SpriteBatch_Flush(b);
+
+        b->texture = texture;
+        b->shader = shader;
+        memcpy(&b->verts[b->count * SPRITE_VERTICES], v, SPRITE_VERTICES * sizeof (DrawVerticeFormats));
+        b->count++;
+        b->sprites++;
+}
@@ -0,0 +1,72 @@
+/****************************************************************************
+ * sprite_batch.h
+ *
+ * Collects pre-transformed quads and draws consecutive quads sharing the
+ * same texture and shader with a single draw call.
+ ***************************************************************************/
+
+#ifndef _SPRITE_BATCH_H_
+#define _SPRITE_BATCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+        float x, y, z, w; // 16
+        unsigned int color; // 20
+        unsigned int padding; // 24
+        float u, v; // 32
+} __attribute__((packed, aligned(32))) DrawVerticeFormats;
+
+// a quad is drawn as a rect list primitive: bottom left, bottom right, top right
+#define SPRITE_VERTICES 3
+#define SPRITE_BATCH_MAX 1024
+
+/**
+ * Device side of the batcher, video.c talks to Xenos, a recording fake can be
+ * plugged in to check the batching on the host.
+ */
+typedef struct {
+        // return a writable pointer to size bytes of the vertex buffer at offset
+        void * (*lock)(void * ctx, int offset, int size);
+        void (*unlock)(void * ctx);
+        // draw count quads stored at offset
+        void (*draw)(void * ctx, void * texture, int shader, int offset, int count);
+} SpriteBatchOps;
+
+typedef struct {
+        const SpriteBatchOps * ops;
+        void * ctx;
+
+        int base; // first usable byte of the vertex buffer
+        int size; // end of the vertex buffer
+        int offset; // where the next run is uploaded
+
+        // pending run
+        void * texture;
+        int shader;
+        int count;
+        DrawVerticeFormats verts[SPRITE_BATCH_MAX * SPRITE_VERTICES];
+
+        // current frame
+        int draw_calls;
+        int sprites;
+        int dropped;
+
+        // last complete frame
+        int last_draw_calls;
+        int last_sprites;
+        int last_dropped;
+} SpriteBatch;
+
+void SpriteBatch_Init(SpriteBatch * b, const SpriteBatchOps * ops, void * ctx, int base, int size);
+void SpriteBatch_Begin(SpriteBatch * b);
+void SpriteBatch_Add(SpriteBatch * b, void * texture, int shader, const DrawVerticeFormats * v);
+void SpriteBatch_Flush(SpriteBatch * b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
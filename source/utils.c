@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <malloc.h>
+#include <string.h>
 #include <xenos/xenos.h>
 #include <xenos/xe.h>
 
@@ -7,6 +8,8 @@
 
 #include <libpng15/png.h>
 #include "_pnginfo.h"
+#include "image_loader.h"
+#include "pixel_convert.h"
 
 extern struct XenosDevice * g_pVideoDevice;
 
@@ -36,136 +39,164 @@ static void png_mem_read(png_structp png_ptr, png_bytep data, png_size_t length)
 	src->offset += length;
 }
 
-static void xeGfx_setTextureData(void * tex, void * buffer) {
-	int w, h, length;
-
-	struct XenosSurface * surf = (struct XenosSurface *) tex;
-
-	uint8_t * surfbuf = (uint8_t*) Xe_Surface_LockRect(g_pVideoDevice, surf, 0, 0, 0, 0, XE_LOCK_WRITE);
-	//memset(surfbuf, 0, surf->hpitch * surf->wpitch);
-
-	uint8_t * src = NULL;
-	uint8_t * dst = (uint8_t *) surfbuf;
-
-	uint8_t * dst_limit = (uint8_t *) surfbuf + ((surf->hpitch) * (surf->wpitch));
-	int hpitch = 0;
-	int wpitch = 0;
-	
-	for (hpitch = 0; hpitch < surf->hpitch; hpitch += surf->height) {
-		//        for (int y = 0; y < bmp->rows; y++)
-		int y, dsty = 0;
-		//        int y_offset = charData->glyphDataTexture->height;
-		int y_offset = 0;
-		
-		int bmp_pitch = surf->width*4;
-		
-		int x = 0;		
-
-		for (y = 0, dsty = y_offset; y < surf->height; y++, dsty++) {
-			for (wpitch = 0; wpitch < surf->wpitch; wpitch += surf->width*4) {
-				src = (uint8_t *) buffer + ((y) * bmp_pitch);
-				dst = (uint8_t *) surfbuf + ((dsty + hpitch) * (surf->wpitch)) + wpitch;
-				for (x = 0; x < surf->width*4; x++) {
-					if (dst < dst_limit)
-					{
-						dst[0] = src[0];
-						dst[1] = src[1];
-						dst[2] = src[2];
-						dst[3] = src[3];
-						
-						src += 4;
-						dst += 4;
-					}
-				}
-			}
-		}
-	}
-
-	Xe_Surface_Unlock(g_pVideoDevice, surf);
-}
-
-//Lits un fichier png en mémoire
-struct XenosSurface *loadPNGFromMemory(unsigned char *PNGdata) {
-	int y = 0;
-	int width, height;
-	png_byte color_type;
-	png_byte bit_depth;
-
+struct png_reader {
+	struct file_buffer_t file;
 	png_structp png_ptr;
 	png_infop info_ptr;
-	//        int number_of_passes;
-	png_bytep * row_pointers;
+	int width;
+	int height;
+	int interlaced; // rows can't be swizzled as they come
+};
 
-	offset = 0;
+static int png_reader_open(struct png_reader * r, const unsigned char *PNGdata) {
+	png_byte color_type;
+	png_byte bit_depth;
 
-	struct file_buffer_t *file;
-	file = (struct file_buffer_t *) malloc(sizeof (struct file_buffer_t));
-	file->length = 1024 * 1024 * 5;
-	file->data = (unsigned char *) malloc(file->length); //5mo ...
-	file->offset = 0;
-	memcpy(file->data, PNGdata, file->length);
+	// libpng reads straight from the embedded data
+	r->file.data = (unsigned char *) PNGdata;
+	r->file.offset = 0;
 
 	/* initialize stuff */
-	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	r->png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 
-	if (!png_ptr) {
+	if (!r->png_ptr) {
 		printf("[read_png_file] png_create_read_struct failed\n");
-		return 0;
+		return -1;
 	}
 
-	info_ptr = png_create_info_struct(png_ptr);
-	if (!info_ptr) {
+	r->info_ptr = png_create_info_struct(r->png_ptr);
+	if (!r->info_ptr) {
 		printf("[read_png_file] png_create_info_struct failed\n");
-		return 0;
+		png_destroy_read_struct(&r->png_ptr, NULL, NULL);
+		return -1;
+	}
+
+	png_set_read_fn(r->png_ptr, (png_voidp *) &r->file, png_mem_read); //permet de lire à  partir de pngfile buff
+
+	png_read_info(r->png_ptr, r->info_ptr);
+
+	r->width = r->info_ptr->width;
+	r->height = r->info_ptr->height;
+	r->interlaced = (r->info_ptr->interlace_type != PNG_INTERLACE_NONE);
+	color_type = r->info_ptr->color_type;
+	bit_depth = r->info_ptr->bit_depth;
+
+	// everything ends up as 8 bits rgba
+	if (color_type == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(r->png_ptr);
+	if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+		png_set_expand_gray_1_2_4_to_8(r->png_ptr);
+	if (png_get_valid(r->png_ptr, r->info_ptr, PNG_INFO_tRNS))
+		png_set_tRNS_to_alpha(r->png_ptr);
+	if (bit_depth == 16)
+		png_set_strip_16(r->png_ptr);
+	if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+		png_set_gray_to_rgb(r->png_ptr);
+
+	if (r->interlaced) {
+		// all passes write into the same rows, let libpng swap
+		png_set_filler(r->png_ptr, 0xFF, PNG_FILLER_BEFORE);
+		png_set_swap_alpha(r->png_ptr);
+		png_set_interlace_handling(r->png_ptr);
+	} else {
+		png_set_filler(r->png_ptr, 0xFF, PNG_FILLER_AFTER);
 	}
 
-	png_set_read_fn(png_ptr, (png_voidp *) file, png_mem_read); //permet de lire à  partir de pngfile buff
+	png_read_update_info(r->png_ptr, r->info_ptr);
 
-	//png_set_sig_bytes(png_ptr, 8);//on avance de 8 ?
+	return 0;
+}
 
-	png_read_info(png_ptr, info_ptr);
+static void png_reader_close(struct png_reader * r) {
+	png_destroy_read_struct(&r->png_ptr, &r->info_ptr, NULL);
+}
 
-	width = info_ptr->width;
-	height = info_ptr->height;
-	color_type = info_ptr->color_type;
-	bit_depth = info_ptr->bit_depth;
+/**
+ * Decodes all rows to ARGB, rows are pitch bytes apart
+ */
+static void png_reader_read(struct png_reader * r, uint8_t * dst, int pitch) {
+	int y;
 
-	//        number_of_passes = png_set_interlace_handling(png_ptr);
+	if (r->interlaced) {
+		png_bytep * row_pointers = (png_bytep*) malloc(sizeof (png_bytep) * r->height);
+		for (y = 0; y < r->height; y++)
+			row_pointers[y] = (png_bytep) (dst + pitch * y);
 
+		png_read_image(r->png_ptr, row_pointers);
+		free(row_pointers);
+		return;
+	}
 
-	if (color_type != PNG_COLOR_TYPE_RGB && color_type != PNG_COLOR_TYPE_RGB_ALPHA) {
-		printf("no support :( \n bit_depth = %08x\n", bit_depth);
-		return 0;
+	// the row is still in cache when it gets swizzled
+	for (y = 0; y < r->height; y++, dst += pitch) {
+		png_read_row(r->png_ptr, (png_bytep) dst, NULL);
+		PixelSwizzleRGBAToARGB(dst, r->width);
 	}
+}
+
+/**
+ * Decodes a png to ARGB pixels, width * height * 4 bytes to free().
+ * Doesn't touch the gpu, safe to call from any thread.
+ */
+unsigned char * decodePNG(const unsigned char *PNGdata, int *width, int *height) {
+	struct png_reader r;
+	uint8_t * data;
+
+	if (png_reader_open(&r, PNGdata) < 0)
+		return NULL;
 
-	if (color_type == PNG_COLOR_TYPE_RGB)
-		png_set_filler(png_ptr, 0xFF, PNG_FILLER_BEFORE);
+	*width = r.width;
+	*height = r.height;
 
-	png_set_swap_alpha(png_ptr);
+	data = (uint8_t*) malloc(*width * *height * 4);
+	if (data)
+		png_reader_read(&r, data, *width * 4);
 
-	png_read_update_info(png_ptr, info_ptr);
-	
-	//On créer la surface
+	png_reader_close(&r);
+
+	return data;
+}
+
+/**
+ * Creates a texture from decodePNG() pixels, main thread only
+ */
+struct XenosSurface *loadTextureFromPixels(unsigned char *pixels, int width, int height) {
 	struct XenosSurface *surface = Xe_CreateTexture(g_pVideoDevice, width, height, 1, XE_FMT_8888 | XE_FMT_ARGB, 0);
+	uint8_t * surfbuf;
+	int y;
 
-	uint8_t *data = (uint8_t*) malloc(width * height * 4);
-	row_pointers = (png_bytep*) malloc(sizeof (png_bytep) * surface->height);
-	for (y = 0; y < surface->height; y++)
-		row_pointers[y] = (png_bytep)(data + (width * 4) * y); //data + surface->wpitch * y;
+	if (surface == NULL)
+		return NULL;
 
+	surfbuf = (uint8_t*) Xe_Surface_LockRect(g_pVideoDevice, surface, 0, 0, 0, 0, XE_LOCK_WRITE);
+	for (y = 0; y < height; y++)
+		memcpy(surfbuf + y * surface->wpitch, pixels + y * width * 4, width * 4);
+	PixelFillPadding(surfbuf, surface->width, surface->height, surface->wpitch, surface->hpitch);
+	Xe_Surface_Unlock(g_pVideoDevice, surface);
 
-	png_read_image(png_ptr, row_pointers);
-	
-	xeGfx_setTextureData(surface, data);
+	return surface;
+}
 
-	
-	free(file->data);
-	free(file);
+//Lits un fichier png en mémoire
+struct XenosSurface *loadPNGFromMemory(unsigned char *PNGdata) {
+	struct png_reader r;
+	struct XenosSurface *surface;
+	uint8_t * surfbuf;
+
+	if (png_reader_open(&r, PNGdata) < 0)
+		return NULL;
+
+	surface = Xe_CreateTexture(g_pVideoDevice, r.width, r.height, 1, XE_FMT_8888 | XE_FMT_ARGB, 0);
+	if (surface) {
+		// no temporary buffer, rows are decoded into the texture
+		surfbuf = (uint8_t*) Xe_Surface_LockRect(g_pVideoDevice, surface, 0, 0, 0, 0, XE_LOCK_WRITE);
+		png_reader_read(&r, surfbuf, surface->wpitch);
+		PixelFillPadding(surfbuf, surface->width, surface->height, surface->wpitch, surface->hpitch);
+		Xe_Surface_Unlock(g_pVideoDevice, surface);
+	}
 
-	free(data);
+	png_reader_close(&r);
 
-	free(row_pointers);
-	
 	return surface;
 }
 
@@ -231,4 +262,4 @@ int LoadTextureFromFile(char * pSrcFile, struct XenosSurface **ppTexture) {
 	free(PNGdata);
 
 	return dest == NULL ? 1 : 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <unistd.h>
 #include <input/input.h>
 #include <console/console.h>
@@ -24,6 +25,7 @@
 #include "input.h"
 #include "video.h"
 #include "Vec.h"
+#include "sprite_batch.h"
 
 typedef unsigned int DWORD;
 //#include "ps.h"
@@ -56,14 +58,12 @@ matrix4x4 modelView2D;
 matrix4x4 projection;
 //matrix4x4 WVP;
 
-static int nb_vertices = 0;
+enum {
+        SHADER_TEXTURED,
+        SHADER_COLORED
+};
 
-typedef struct {
-        float x, y, z, w; // 32
-        unsigned int color; // 36
-        unsigned int padding; // 40
-        float u, v; // 48
-} __attribute__((packed, aligned(32))) DrawVerticeFormats;
+static SpriteBatch batch;
 
 // Init Matrices
 
@@ -88,75 +88,40 @@ void ResetVideo_Menu() {
         InitMatrices();
 }
 
-static void CreateVbText(float x, float y, float w, float h, uint32_t color, DrawVerticeFormats * Rect) {
-        // bottom left
-        Rect[0].x = x - w;
-        Rect[0].y = y + h;
-        Rect[0].u = 0;
-        Rect[0].v = 1;
-        Rect[0].color = color;
-
-        // bottom right
-        Rect[1].x = x + w;
-        Rect[1].y = y + h;
-        Rect[1].u = 1;
-        Rect[1].v = 1;
-        Rect[1].color = color;
-
-        // top right
-        Rect[2].x = x + w;
-        Rect[2].y = y - h;
-        Rect[2].u = 1;
-        Rect[2].v = 0;
-        Rect[2].color = color;
-
-        // Top left
-        Rect[3].x = x - w;
-        Rect[3].y = y - h;
-        Rect[3].u = 0;
-        Rect[3].v = 0;
-        Rect[3].color = color;
-
-        int i = 0;
-        for (i = 0; i < 4; i++) {
-                Rect[i].z = 0.0;
-                Rect[i].w = 1.0;
+#define DegToRad(a)   ( (a) *  0.01745329252f )
+
+/**
+ * Build the rect list vertices of a quad centered on (x + w, y + h), scaled,
+ * rotated and translated on the cpu so that quads can share a draw call.
+ */
+static void CreateVbQuad(float x, float y, float w, float h, float degrees, float scaleX, float scaleY, uint32_t color, DrawVerticeFormats * Rect) {
+        // bottom left, bottom right, top right
+        static const float corner[SPRITE_VERTICES][2] = {
+                {-1, -1},
+                {1, -1},
+                {1, 1}
+        };
+        float c = 1.f, s = 0.f;
+        int i;
+
+        if (degrees != 0) {
+                c = cosf(DegToRad(degrees));
+                s = sinf(DegToRad(degrees));
         }
-}
 
-static void CreateVbQuad(float width, float height, uint32_t color, DrawVerticeFormats * Rect) {
-        // bottom left
-        Rect[0].x = -width;
-        Rect[0].y = -height;
-        Rect[0].u = 0;
-        Rect[0].v = 0;
-        Rect[0].color = color;
-
-        // bottom right
-        Rect[1].x = width;
-        Rect[1].y = -height;
-        Rect[1].u = 1;
-        Rect[1].v = 0;
-        Rect[1].color = color;
-
-        // top right
-        Rect[2].x = width;
-        Rect[2].y = height;
-        Rect[2].u = 1;
-        Rect[2].v = 1;
-        Rect[2].color = color;
-
-        // Top left
-        Rect[3].x = -width;
-        Rect[3].y = height;
-        Rect[3].u = 0;
-        Rect[3].v = 1;
-        Rect[3].color = color;
-
-        int i = 0;
-        for (i = 0; i < 4; i++) {
+        for (i = 0; i < SPRITE_VERTICES; i++) {
+                // scale => rotate => translate
+                float px = corner[i][0] * w * scaleX;
+                float py = corner[i][1] * h * scaleY;
+
+                Rect[i].x = px * c - py * s + x + w;
+                Rect[i].y = px * s + py * c + y + h;
                 Rect[i].z = 0.0;
                 Rect[i].w = 1.0;
+                Rect[i].u = corner[i][0] > 0 ? 1 : 0;
+                Rect[i].v = corner[i][1] > 0 ? 1 : 0;
+                Rect[i].color = color;
+                Rect[i].padding = 0;
         }
 }
 
@@ -168,6 +133,46 @@ struct XenosVertexBuffer * GetSharedVertexBuffer() {
         return vb;
 }
 
+// first bytes of the vb are used by the video output
+#define SHARED_VB_SIZE 512
+
+static void * BatchLock(void * ctx, int offset, int size) {
+        return Xe_VB_Lock(g_pVideoDevice, vb, offset, size, XE_LOCK_WRITE);
+}
+
+static void BatchUnlock(void * ctx) {
+        Xe_VB_Unlock(g_pVideoDevice, vb);
+}
+
+static void BatchDraw(void * ctx, void * texture, int shader, int offset, int count) {
+        matrix4x4 WVP;
+
+        // vertices are already transformed
+        matrixLoadIdentity(&WVP);
+        Xe_SetVertexShaderConstantF(g_pVideoDevice, 0, (float*) &WVP, 4);
+
+        Xe_SetTexture(g_pVideoDevice, 0, (struct XenosSurface *) texture);
+
+        Xe_SetShader(g_pVideoDevice, SHADER_TYPE_PIXEL, shader == SHADER_COLORED ? g_pPixelColoredShader : g_pPixelTexturedShader, 0);
+        Xe_SetShader(g_pVideoDevice, SHADER_TYPE_VERTEX, g_pVertexShader, 0);
+
+        Xe_SetBlendOp(g_pVideoDevice, XE_BLENDOP_ADD);
+        Xe_SetSrcBlend(g_pVideoDevice, XE_BLEND_SRCALPHA);
+        Xe_SetDestBlend(g_pVideoDevice, XE_BLEND_INVSRCALPHA);
+        Xe_SetAlphaTestEnable(g_pVideoDevice, 1);
+
+        Xe_SetCullMode(g_pVideoDevice, XE_CULL_NONE);
+        Xe_SetStreamSource(g_pVideoDevice, 0, vb, offset, sizeof (DrawVerticeFormats));
+
+        Xe_DrawPrimitive(g_pVideoDevice, XE_PRIMTYPE_RECTLIST, 0, count);
+}
+
+static const SpriteBatchOps xe_batch_ops = {
+        BatchLock,
+        BatchUnlock,
+        BatchDraw
+};
+
 /****************************************************************************
  * InitVideo
  *
@@ -215,6 +220,7 @@ void InitVideo() {
         edram_init(g_pVideoDevice);
 
         vb = Xe_CreateVertexBuffer(g_pVideoDevice, MAX_VERTEX_COUNT * sizeof (DrawVerticeFormats));
+        SpriteBatch_Init(&batch, &xe_batch_ops, NULL, SHARED_VB_SIZE, MAX_VERTEX_COUNT * sizeof (DrawVerticeFormats));
 
         Xe_SetClearColor(g_pVideoDevice, 0xFF888888);
 
@@ -234,8 +240,6 @@ void doScreenCapture();
  *
  * Renders everything current sent to GX, and flushes video
  ***************************************************************************/
-#define SHARED_VB_SIZE 512
-
 void Menu_Frame() {
         FrameTimer++;
         
@@ -243,11 +247,30 @@ void Menu_Frame() {
        Xe_VB_Lock(g_pVideoDevice, vb, SHARED_VB_SIZE, MAX_VERTEX_COUNT * sizeof (DrawVerticeFormats) - SHARED_VB_SIZE, XE_LOCK_READ | XE_LOCK_WRITE);
         Xe_VB_Unlock(g_pVideoDevice, vb);
 
-        nb_vertices = SHARED_VB_SIZE;
+        SpriteBatch_Begin(&batch);
+}
+
+/****************************************************************************
+ * Menu_Flush
+ *
+ * Draws the pending quads, call it before resolving
+ ***************************************************************************/
+void Menu_Flush() {
+        SpriteBatch_Flush(&batch);
+}
+
+/**
+ * Draw calls and vertices of the last complete frame
+ */
+void Menu_GetDrawStats(int * draw_calls, int * vertices) {
+        *draw_calls = batch.last_draw_calls;
+        *vertices = batch.last_sprites * SPRITE_VERTICES;
 }
 
 void Menu_Render() {
 
+        Menu_Flush();
+
         Xe_Resolve(g_pVideoDevice);
 
         while (!Xe_IsVBlank(g_pVideoDevice));
@@ -259,50 +282,6 @@ void Menu_Render() {
         Menu_Frame();
 }
 
-static void SetRS() {
-        Xe_SetBlendOp(g_pVideoDevice, XE_BLENDOP_ADD);
-        Xe_SetSrcBlend(g_pVideoDevice, XE_BLEND_SRCALPHA);
-        Xe_SetDestBlend(g_pVideoDevice, XE_BLEND_INVSRCALPHA);
-        Xe_SetAlphaTestEnable(g_pVideoDevice, 1);
-
-        Xe_SetCullMode(g_pVideoDevice, XE_CULL_NONE);
-        Xe_SetStreamSource(g_pVideoDevice, 0, vb, nb_vertices, sizeof (DrawVerticeFormats));
-}
-
-static void Draw() {
-        SetRS();
-
-        Xe_DrawPrimitive(g_pVideoDevice, XE_PRIMTYPE_RECTLIST, 0, 1);
-        //nb_vertices += 4 * sizeof (DrawVerticeFormats);
-        nb_vertices += 512; // fixe aligement
-}
-
-static void UpdatesMatrices(f32 xpos, f32 ypos, f32 width, f32 height, f32 degrees, f32 scaleX, f32 scaleY) {
-#define DegToRad(a)   ( (a) *  0.01745329252f )
-
-        matrix4x4 m;
-        matrix4x4 rotation;
-        matrix4x4 scale;
-        matrix4x4 translation;
-        matrix4x4 WVP;
-
-        matrixLoadIdentity(&WVP);
-        matrixLoadIdentity(&m);
-        matrixLoadIdentity(&rotation);
-        matrixLoadIdentity(&scale);
-        matrixLoadIdentity(&translation);
-
-        matrixRotationZ(&rotation, DegToRad(degrees));
-        matrixTranslation(&translation, xpos + width, ypos + height, 0);
-        matrixScaling(&scale, scaleX, scaleY, 1.0f);
-
-        //    // scale => rotate => translate
-        matrixMultiply(&m, &scale, &rotation);
-        matrixMultiply(&WVP, &m, &translation);
-
-        Xe_SetVertexShaderConstantF(g_pVideoDevice, 0, (float*) &WVP, 4);
-}
-
 /****************************************************************************
  * Menu_DrawImg
  *
@@ -315,6 +294,7 @@ void Menu_DrawImg(f32 xpos, f32 ypos, u16 width, u16 height, struct XenosSurface
                 return;
 
         XeColor color;
+        DrawVerticeFormats Rect[SPRITE_VERTICES];
         float x, y, w, h;
 
         x = (float) xpos;
@@ -335,23 +315,9 @@ void Menu_DrawImg(f32 xpos, f32 ypos, u16 width, u16 height, struct XenosSurface
         color.g = 0xFF;
         color.b = 0xFF;
 
-        DrawVerticeFormats* Rect = (DrawVerticeFormats*) Xe_VB_Lock(g_pVideoDevice, vb, nb_vertices, 4 * sizeof (DrawVerticeFormats), XE_LOCK_WRITE);
-        {
-                // CreateVb(x,y,w*scaleX,h*scaleY,color.lcol,Rect);
-                CreateVbQuad(w, h, color.lcol, Rect);
-        }
-        Xe_VB_Unlock(g_pVideoDevice, vb);
-
-        Xe_SetTexture(g_pVideoDevice, 0, data);
-
-        UpdatesMatrices(x, y, w, h, degrees, scaleX, scaleY);
-
-        Xe_SetShader(g_pVideoDevice, SHADER_TYPE_PIXEL, g_pPixelTexturedShader, 0);
-        Xe_SetShader(g_pVideoDevice, SHADER_TYPE_VERTEX, g_pVertexShader, 0);
+        CreateVbQuad(x, y, w, h, degrees, scaleX, scaleY, color.lcol, Rect);
 
-        Draw();
-        
-        
+        SpriteBatch_Add(&batch, data, SHADER_TEXTURED, Rect);
 }
 
 /****************************************************************************
@@ -360,6 +326,7 @@ void Menu_DrawImg(f32 xpos, f32 ypos, u16 width, u16 height, struct XenosSurface
  * Draws a rectangle at the specified coordinates using GX
  ***************************************************************************/
 void Menu_DrawRectangle(f32 x, f32 y, f32 width, f32 height, XeColor color, u8 filled) {
+        DrawVerticeFormats Rect[SPRITE_VERTICES];
         float w, h;
 
         x = (float) x;
@@ -373,25 +340,13 @@ void Menu_DrawRectangle(f32 x, f32 y, f32 width, f32 height, XeColor color, u8 f
         w = (float) w / ((float) screenwidth);
         h = (float) h / ((float) screenheight);
 
-        DrawVerticeFormats* Rect = (DrawVerticeFormats*) Xe_VB_Lock(g_pVideoDevice, vb, nb_vertices, 4 * sizeof (DrawVerticeFormats), XE_LOCK_WRITE);
-        {
-                CreateVbQuad(w, h, color.lcol, Rect);
-                //CreateVb(x,y,w,h,_color.lcol,Rect);
-        }
-        Xe_VB_Unlock(g_pVideoDevice, vb);
-
-        Xe_SetTexture(g_pVideoDevice, 0, NULL);
-
-        UpdatesMatrices(x, y, w, h, 0, 1, 1);
-
-        Xe_SetShader(g_pVideoDevice, SHADER_TYPE_PIXEL, g_pPixelColoredShader, 0);
-        Xe_SetShader(g_pVideoDevice, SHADER_TYPE_VERTEX, g_pVertexShader, 0);
+        CreateVbQuad(x, y, w, h, 0, 1, 1, color.lcol, Rect);
 
-        Draw();
+        SpriteBatch_Add(&batch, NULL, SHADER_COLORED, Rect);
 }
 
 void Menu_T(struct XenosSurface * surf, f32 texWidth, f32 texHeight, int16_t screenX, int16_t screenY, XeColor color) {
-        //return;
+        DrawVerticeFormats Rect[SPRITE_VERTICES];
         float x, y, w, h;
         if (surf == NULL) {
                 printf("Surf==NULL\r\n");
@@ -409,26 +364,46 @@ void Menu_T(struct XenosSurface * surf, f32 texWidth, f32 texHeight, int16_t scr
         w = (float) w / ((float) screenwidth);
         h = (float) h / ((float) screenheight);
 
-        // Correct aspect ratio
-        //    h = h * ((float) screenwidth/(float) screenheight);
+        CreateVbQuad(x, y, w, h, 0, 1, 1, color.lcol, Rect);
 
-        //    w = w/2;
-        //    w = h/2;
+        SpriteBatch_Add(&batch, surf, SHADER_TEXTURED, Rect);
+}
 
-        DrawVerticeFormats* Rect = (DrawVerticeFormats*) Xe_VB_Lock(g_pVideoDevice, vb, nb_vertices, 4 * sizeof (DrawVerticeFormats), XE_LOCK_WRITE);
-        {
-                CreateVbText(0, 0, w, h, color.lcol, Rect);
-        }
-        Xe_VB_Unlock(g_pVideoDevice, vb);
+/****************************************************************************
+ * Menu_TSub
+ *
+ * Same as Menu_T but only draws the srcX, srcY, width, height part of the
+ * texture, used for glyphs stored in an atlas
+ ***************************************************************************/
+void Menu_TSub(struct XenosSurface * surf, f32 srcX, f32 srcY, f32 width, f32 height, int16_t screenX, int16_t screenY, XeColor color) {
+        DrawVerticeFormats Rect[SPRITE_VERTICES];
+        float x, y, w, h;
+        float u0, v0, u1, v1;
+        int i;
 
-        Xe_SetTexture(g_pVideoDevice, 0, surf);
+        if (surf == NULL)
+                return;
 
-        UpdatesMatrices(x, y, w, h, 0, 1, 1);
+        x = (float) screenX;
+        y = (float) screenY;
 
-        Xe_SetShader(g_pVideoDevice, SHADER_TYPE_PIXEL, g_pPixelTexturedShader, 0);
-        Xe_SetShader(g_pVideoDevice, SHADER_TYPE_VERTEX, g_pVertexShader, 0);
+        x = (x / ((float) screenwidth / 2.f)) - 1.f; // 1280/2
+        y = (y / ((float) screenheight / 2.f)) - 1.f; // 720/2
+
+        w = width / ((float) screenwidth);
+        h = height / ((float) screenheight);
+
+        u0 = srcX / (float) surf->width;
+        v0 = srcY / (float) surf->height;
+        u1 = (srcX + width) / (float) surf->width;
+        v1 = (srcY + height) / (float) surf->height;
 
-        Draw();
+        CreateVbQuad(x, y, w, h, 0, 1, 1, color.lcol, Rect);
 
-        //Menu_DrawRectangle(screenX,screenY,texWidth,texHeight,color,1);
-}
\ No newline at end of file
+        for (i = 0; i < SPRITE_VERTICES; i++) {
+                Rect[i].u = Rect[i].u ? u1 : u0;
+                Rect[i].v = Rect[i].v ? v1 : v0;
+        }
+
+        SpriteBatch_Add(&batch, surf, SHADER_TEXTURED, Rect);
+}
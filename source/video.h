@@ -36,10 +36,13 @@ void InitVideo();
 void ResetVideo_Menu();
 
 void Menu_Frame();
+void Menu_Flush();
 void Menu_Render();
+void Menu_GetDrawStats(int * draw_calls, int * vertices);
 void Menu_DrawImg(f32 xpos, f32 ypos, u16 width, u16 height, struct XenosSurface * data, f32 degrees, f32 scaleX, f32 scaleY, u8 alphaF);
 void Menu_DrawRectangle(f32 x, f32 y, f32 width, f32 height, XeColor color, u8 filled);
 void Menu_T(struct XenosSurface * surf, f32 texWidth, f32 texHeight, int16_t screenX, int16_t screenY, XeColor color);
+void Menu_TSub(struct XenosSurface * surf, f32 srcX, f32 srcY, f32 width, f32 height, int16_t screenX, int16_t screenY, XeColor color);
 
 extern int screenheight;
 extern int screenwidth;
@@ -0,0 +1,24 @@
+/*
+ * What ao_xenon.c needs from the rest of MPlayer
+ */
+
+#include "mp_msg.h"
+#include "libao2/audio_out.h"
+#include "audio_out_stubs.h"
+
+ao_data_t ao_data;
+
+void mp_ao_resume_refill(const ao_functions_t *ao, int prepause_space);
+
+int resume_refill_calls;
+int resume_refill_space;
+
+void mp_ao_resume_refill(const ao_functions_t *ao, int prepause_space)
+{
+    resume_refill_calls++;
+    resume_refill_space = prepause_space;
+}
+
+void mp_msg(int mod, int lev, const char *format, ...)
+{
+}
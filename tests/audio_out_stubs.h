@@ -0,0 +1,11 @@
+/*
+ * What ao_xenon.c needs from the rest of MPlayer
+ */
+
+#ifndef AUDIO_OUT_STUBS_H
+#define AUDIO_OUT_STUBS_H
+
+extern int resume_refill_calls;
+extern int resume_refill_space;
+
+#endif
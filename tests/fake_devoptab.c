@@ -0,0 +1,59 @@
+/*
+ * Device table of newlib, "name:" prefixes of paths map to a devoptab
+ */
+
+#include <string.h>
+
+#include <sys/iosupport.h>
+
+#define MAX_DEVICES 8
+
+static const devoptab_t *devices[MAX_DEVICES];
+
+static int name_len(const char *path)
+{
+    const char *colon = strchr(path, ':');
+    return colon ? colon - path : (int) strlen(path);
+}
+
+int FindDevice(const char *name)
+{
+    int len = name_len(name);
+    int i;
+
+    for (i = 0; i < MAX_DEVICES; i++) {
+        if (devices[i] && strlen(devices[i]->name) == len &&
+            !strncmp(devices[i]->name, name, len))
+            return i;
+    }
+    return -1;
+}
+
+int AddDevice(const devoptab_t *device)
+{
+    int i;
+
+    for (i = 0; i < MAX_DEVICES; i++) {
+        if (!devices[i]) {
+            devices[i] = device;
+            return i;
+        }
+    }
+    return -1;
+}
+
+int RemoveDevice(const char *name)
+{
+    int i = FindDevice(name);
+
+    if (i < 0)
+        return -1;
+    devices[i] = NULL;
+    return 0;
+}
+
+const devoptab_t *GetDeviceOpTab(const char *name)
+{
+    int i = FindDevice(name);
+    return i < 0 ? NULL : devices[i];
+}
@@ -0,0 +1,62 @@
+/*
+ * Directory scan handing out a generated listing, a few chunks per read
+ * like the background scanner of source/dirscan.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dirscan.h"
+#include "fake_dirscan.h"
+
+struct dirscan {
+    int next;
+};
+
+static int scan_count;
+static int scan_chunk;
+
+void fake_dirscan_set(int count, int chunk)
+{
+    scan_count = count;
+    scan_chunk = chunk;
+}
+
+// unsorted, every tenth one a folder
+void fake_dirscan_entry(int i, DIRSCANENTRY *e)
+{
+    unsigned h = (unsigned) i * 2654435761u;
+
+    e->isdir = i % 10 == 0;
+    if (e->isdir)
+        snprintf(e->name, sizeof(e->name), "Folder %08x-%d", h, i);
+    else
+        snprintf(e->name, sizeof(e->name), "movie %08x-%d.mkv", h, i);
+}
+
+DIRSCAN *DirScanStart(const char *path)
+{
+    return calloc(1, sizeof(DIRSCAN));
+}
+
+int DirScanRead(DIRSCAN *scan, DIRSCANENTRY *entries, int max, int *done)
+{
+    int n = scan_count - scan->next;
+    int i;
+
+    if (n > max)
+        n = max;
+    if (n > scan_chunk)
+        n = scan_chunk;
+    for (i = 0; i < n; i++)
+        fake_dirscan_entry(scan->next + i, &entries[i]);
+    scan->next += n;
+    *done = scan->next == scan_count;
+    return n;
+}
+
+void DirScanClose(DIRSCAN *scan)
+{
+    free(scan);
+}
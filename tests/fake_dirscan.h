@@ -0,0 +1,18 @@
+#ifndef FAKE_DIRSCAN_H
+#define FAKE_DIRSCAN_H
+
+#include "dirscan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the next scans list count entries, at most chunk per DirScanRead()
+void fake_dirscan_set(int count, int chunk);
+void fake_dirscan_entry(int i, DIRSCANENTRY *e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Hardware threads of the console as host threads: xenon_run_thread_task()
+ * starts one running the task with mfspr(pir) returning its number, it stops
+ * when the task returns.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <xenon_soc/xenon_power.h>
+
+__thread int fake_hw_thread;
+
+static volatile int fake_running[6];
+
+typedef struct {
+    int thread;
+    void (*task)(void);
+} fake_task_t;
+
+static void *fake_thread_main(void *arg)
+{
+    fake_task_t t = *(fake_task_t *) arg;
+
+    free(arg);
+    fake_hw_thread = t.thread;
+    t.task();
+    __sync_synchronize();
+    fake_running[t.thread] = 0;
+    return NULL;
+}
+
+int xenon_run_thread_task(int thread, void *stack, void *task)
+{
+    fake_task_t *t = malloc(sizeof(*t));
+    pthread_attr_t attr;
+    pthread_t th;
+    int ret;
+
+    t->thread = thread;
+    t->task = (void (*)(void)) task;
+    fake_running[thread] = 1;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&th, &attr, fake_thread_main, t);
+    pthread_attr_destroy(&attr);
+    return ret;
+}
+
+int xenon_is_thread_task_running(int thread)
+{
+    return fake_running[thread];
+}
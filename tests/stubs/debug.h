@@ -0,0 +1,2 @@
+/* host stand-in */
+#define TR
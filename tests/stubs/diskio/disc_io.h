@@ -0,0 +1,22 @@
+/* host stand-in */
+
+#ifndef FAKE_DISC_IO_H
+#define FAKE_DISC_IO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef uint32_t sec_t;
+
+typedef struct DISC_INTERFACE_STRUCT {
+    unsigned long ioType;
+    unsigned long features;
+    bool (*startup)(void);
+    bool (*isInserted)(void);
+    bool (*readSectors)(sec_t sector, sec_t numSectors, void *buffer);
+    bool (*writeSectors)(sec_t sector, sec_t numSectors, const void *buffer);
+    bool (*clearStatus)(void);
+    bool (*shutdown)(void);
+} DISC_INTERFACE;
+
+#endif
@@ -0,0 +1,19 @@
+/* host stand-in, the same spinlock on gcc atomics */
+
+#ifndef FAKE_PPC_ATOMIC_H
+#define FAKE_PPC_ATOMIC_H
+
+#include <sched.h>
+
+static inline void lock(void *l)
+{
+    while (__sync_lock_test_and_set((volatile unsigned int *) l, 1))
+        sched_yield();
+}
+
+static inline void unlock(void *l)
+{
+    __sync_lock_release((volatile unsigned int *) l);
+}
+
+#endif
@@ -0,0 +1,9 @@
+/* host stand-in, the hardware thread id is set by fake_xenon_thread.c */
+
+#ifndef FAKE_PPC_REGISTER_H
+#define FAKE_PPC_REGISTER_H
+
+extern __thread int fake_hw_thread;
+#define mfspr(reg) fake_hw_thread
+
+#endif
@@ -0,0 +1,18 @@
+/* host stand-in, a 50 MHz timebase on the monotonic clock */
+
+#ifndef FAKE_PPC_TIMEBASE_H
+#define FAKE_PPC_TIMEBASE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define PPC_TIMEBASE_FREQ 50000000ULL
+
+static inline uint64_t mftb(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * PPC_TIMEBASE_FREQ + ts.tv_nsec / 20;
+}
+
+#endif
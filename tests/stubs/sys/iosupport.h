@@ -0,0 +1,58 @@
+/* host stand-in of the newlib devoptab interface, see fake_devoptab.c */
+
+#ifndef FAKE_SYS_IOSUPPORT_H
+#define FAKE_SYS_IOSUPPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+// newlib's spare stat fields
+#define st_spare1 st_atim.tv_nsec
+#define st_spare2 st_mtim.tv_nsec
+#define st_spare3 st_ctim.tv_nsec
+#define st_spare4 __glibc_reserved
+
+struct _reent {
+    int _errno;
+};
+
+typedef struct {
+    int device;
+    void *dirStruct;
+} DIR_ITER;
+
+typedef struct {
+    const char *name;
+    int structSize;
+    int (*open_r)(struct _reent *r, void *fileStruct, const char *path, int flags, int mode);
+    int (*close_r)(struct _reent *r, int fd);
+    ssize_t (*write_r)(struct _reent *r, int fd, const char *ptr, size_t len);
+    ssize_t (*read_r)(struct _reent *r, int fd, char *ptr, size_t len);
+    off_t (*seek_r)(struct _reent *r, int fd, off_t pos, int dir);
+    int (*fstat_r)(struct _reent *r, int fd, struct stat *st);
+    int (*stat_r)(struct _reent *r, const char *file, struct stat *st);
+    int (*link_r)(struct _reent *r, const char *existing, const char *newLink);
+    int (*unlink_r)(struct _reent *r, const char *name);
+    int (*chdir_r)(struct _reent *r, const char *name);
+    int (*rename_r)(struct _reent *r, const char *oldName, const char *newName);
+    int (*mkdir_r)(struct _reent *r, const char *path, int mode);
+    int dirStateSize;
+    DIR_ITER *(*diropen_r)(struct _reent *r, DIR_ITER *dirState, const char *path);
+    int (*dirreset_r)(struct _reent *r, DIR_ITER *dirState);
+    int (*dirnext_r)(struct _reent *r, DIR_ITER *dirState, char *filename, struct stat *filestat);
+    int (*dirclose_r)(struct _reent *r, DIR_ITER *dirState);
+    int (*statvfs_r)(struct _reent *r, const char *path, struct statvfs *buf);
+    int (*ftruncate_r)(struct _reent *r, int fd, off_t len);
+    int (*fsync_r)(struct _reent *r, int fd);
+    void *deviceData;
+} devoptab_t;
+
+int AddDevice(const devoptab_t *device);
+int FindDevice(const char *name);
+int RemoveDevice(const char *name);
+const devoptab_t *GetDeviceOpTab(const char *name);
+
+#endif
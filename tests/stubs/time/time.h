@@ -0,0 +1,12 @@
+/* host stand-in */
+
+#ifndef FAKE_TIME_TIME_H
+#define FAKE_TIME_TIME_H
+
+#include <ppc/timebase.h>
+
+#define tb_diff_sec(end, start)  (((end) - (start)) / PPC_TIMEBASE_FREQ)
+#define tb_diff_msec(end, start) (((end) - (start)) / (PPC_TIMEBASE_FREQ / 1000))
+#define tb_diff_usec(end, start) (((end) - (start)) / (PPC_TIMEBASE_FREQ / 1000000))
+
+#endif
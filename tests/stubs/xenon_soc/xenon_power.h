@@ -0,0 +1,15 @@
+/* host stand-in, hardware threads are host threads, see fake_xenon_thread.c */
+
+#ifndef FAKE_XENON_POWER_H
+#define FAKE_XENON_POWER_H
+
+#define XENON_SPEED_FULL 1
+
+static inline void xenon_make_it_faster(int speed)
+{
+}
+
+int xenon_run_thread_task(int thread, void *stack, void *task);
+int xenon_is_thread_task_running(int thread);
+
+#endif
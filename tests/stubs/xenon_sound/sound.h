@@ -0,0 +1,19 @@
+/*
+ * Host stand-in for libxenon's sound ring, see fake_sound.c
+ */
+
+#ifndef FAKE_XENON_SOUND_H
+#define FAKE_XENON_SOUND_H
+
+void xenon_sound_init(void);
+void xenon_sound_submit(void *data, int len);
+int xenon_sound_get_free(void);
+int xenon_sound_get_unplayed(void);
+
+/* test side */
+void fake_sound_set_ring(int size);
+void fake_sound_consume(int bytes);
+int fake_sound_queued(void);
+int fake_sound_overflows(void);
+
+#endif
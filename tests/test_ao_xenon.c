@@ -0,0 +1,123 @@
+/*
+ * Buffering and delay math of libao2/ao_xenon.c against a fake hardware ring
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "libao2/audio_out.h"
+#include "libaf/af_format.h"
+#include "audio_out_stubs.h"
+#include <xenon_sound/sound.h>
+
+#include "test.h"
+
+extern const ao_functions_t audio_out_xenon;
+
+static void test_init(void)
+{
+    const ao_functions_t *ao = &audio_out_xenon;
+
+    fake_sound_set_ring(60000);
+    CHECK(ao->init(44100, 2, AF_FORMAT_S16_LE, 0));
+    CHECK(ao_data.samplerate == 48000);
+    CHECK(ao_data.channels == 2);
+    CHECK(ao_data.bps == 48000 * 4);
+    // measured ring, rounded to outburst
+    CHECK(ao_data.buffersize <= 60000);
+    CHECK(ao_data.buffersize % ao_data.outburst == 0);
+    CHECK(ao_data.buffersize > 60000 - ao_data.outburst);
+    CHECK(ao->get_delay() == 0);
+}
+
+static void test_play(void)
+{
+    const ao_functions_t *ao = &audio_out_xenon;
+    static char buf[128 * 1024];
+    int space, len;
+
+    fake_sound_set_ring(60000);
+    ao->init(48000, 2, AF_FORMAT_S16_LE, 0);
+
+    space = ao->get_space();
+    CHECK(space % ao_data.outburst == 0);
+    CHECK(space <= xenon_sound_get_free());
+
+    // rounded down to outburst
+    len = ao->play(buf, ao_data.outburst * 3 + 100, 0);
+    CHECK(len == ao_data.outburst * 3);
+    CHECK(fake_sound_queued() == len);
+    CHECK(ao->get_delay() == (float) len / ao_data.bps);
+
+    // the last chunk goes out whole
+    len = ao->play(buf, 100, AOPLAY_FINAL_CHUNK);
+    CHECK(len == 100);
+
+    // more than is free never reaches the hardware
+    len = ao->play(buf, sizeof(buf), 0);
+    CHECK(len <= 60000);
+    CHECK(fake_sound_overflows() == 0);
+    CHECK(ao->get_space() < ao_data.outburst);
+    CHECK(ao->play(buf, ao_data.outburst, 0) == 0);
+}
+
+/* the way mplayer.c feeds it, while the hardware drains at the sample rate */
+static void test_playback(void)
+{
+    const ao_functions_t *ao = &audio_out_xenon;
+    static char buf[64 * 1024];
+    int ms, min_queued = 1 << 30;
+
+    fake_sound_set_ring(60000);
+    ao->init(48000, 2, AF_FORMAT_S16_LE, 0);
+
+    for (ms = 0; ms < 10000; ms++) {
+        float delay;
+        int space;
+
+        fake_sound_consume(ao_data.bps / 1000);
+        // refill every 10 ms
+        if (ms % 10 == 0) {
+            space = ao->get_space();
+            if (space)
+                CHECK(ao->play(buf, space, 0) == space);
+        }
+        delay = ao->get_delay();
+        CHECK(delay >= 0);
+        CHECK(delay <= (float) ao_data.buffersize / ao_data.bps + 0.001f);
+        CHECK(delay == (float) fake_sound_queued() / ao_data.bps);
+        if (ms > 100 && fake_sound_queued() < min_queued)
+            min_queued = fake_sound_queued();
+    }
+    CHECK(fake_sound_overflows() == 0);
+    // never ran dry once started
+    CHECK(min_queued > 0);
+}
+
+static void test_pause(void)
+{
+    const ao_functions_t *ao = &audio_out_xenon;
+    static char buf[16 * 1024];
+    int space;
+
+    fake_sound_set_ring(60000);
+    ao->init(48000, 2, AF_FORMAT_S16_LE, 0);
+    ao->play(buf, sizeof(buf), 0);
+    space = ao->get_space();
+
+    ao->pause();
+    CHECK(fake_sound_queued() == 0);
+    ao->resume();
+    // resume refills what was queued before the pause
+    CHECK(resume_refill_calls == 1);
+    CHECK(resume_refill_space == space);
+}
+
+int main(void)
+{
+    test_init();
+    test_play();
+    test_playback();
+    test_pause();
+    return test_done("ao_xenon");
+}
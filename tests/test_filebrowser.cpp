@@ -0,0 +1,128 @@
+/*
+ * Incremental listing of source/filebrowser.cpp on a 100000 entry folder:
+ * time to the first page, the final order and the selection while entries
+ * are merged in
+ */
+
+#include <string.h>
+
+#include "filebrowser.h"
+#include "fake_dirscan.h"
+#include <time/time.h>
+
+#include "test.h"
+
+#define ENTRIES 100000
+#define PAGE 10
+
+int ParseDirectory();
+
+// BrowserUpdate() until the scan is over, the number of calls
+static int finish_scan()
+{
+    int updates = 0;
+
+    while (browser.numEntries < ENTRIES && updates < ENTRIES) {
+        BrowserUpdate();
+        updates++;
+    }
+    return updates;
+}
+
+static void open_folder()
+{
+    strcpy(browser.dir, "/");
+    ParseDirectory();
+}
+
+static void test_first_page()
+{
+    u64 start, first, end;
+    int updates;
+
+    fake_dirscan_set(ENTRIES, 1024);
+    BrowserFlushCache();
+
+    start = mftb();
+    open_folder();
+    first = mftb();
+    CHECK(browser.numEntries >= PAGE);
+
+    updates = finish_scan();
+    end = mftb();
+
+    printf("first page after %.2f ms, %d entries after %.2f ms in %d updates\n",
+           tb_diff_usec(first, start) / 1000.0, browser.numEntries,
+           tb_diff_usec(end, start) / 1000.0, updates);
+
+    CHECK(browser.numEntries == ENTRIES);
+    // the first page doesn't wait for the whole folder
+    CHECK(tb_diff_usec(first, start) * 10 < tb_diff_usec(end, start));
+
+    for (int i = 1; i < browser.numEntries; i++) {
+        if (FileSortCallback(&browserList[i - 1], &browserList[i]) > 0) {
+            CHECK(!"sorted");
+            break;
+        }
+    }
+}
+
+static void test_selection_follows()
+{
+    char name[MAXJOLIET + 1];
+    int moved = 0;
+
+    fake_dirscan_set(ENTRIES, 1024);
+    BrowserFlushCache();
+    open_folder();
+
+    // the fourth row of the page starting at 2
+    browser.pageIndex = 2;
+    browser.selIndex = 5;
+    strcpy(name, browserList[browser.selIndex].filename);
+
+    while (browser.numEntries < ENTRIES && moved < ENTRIES) {
+        int sel = browser.selIndex;
+
+        if (BrowserUpdate())
+            moved++;
+        if (strcmp(browserList[browser.selIndex].filename, name) || browser.selIndex - browser.pageIndex != 3) {
+            CHECK(!"selection kept");
+            break;
+        }
+        CHECK(browser.selIndex >= sel);
+    }
+
+    CHECK(!strcmp(browserList[browser.selIndex].filename, name));
+    CHECK(browser.selIndex - browser.pageIndex == 3);
+    CHECK(browser.selIndex > 5);
+    CHECK(moved > 0);
+}
+
+static void test_cached()
+{
+    int hits, misses, msec, cached;
+
+    fake_dirscan_set(ENTRIES, 1024);
+    BrowserFlushCache();
+    open_folder();
+    finish_scan();
+
+    BrowserGetCacheStats(&hits, &misses, &msec, &cached);
+    open_folder();
+    CHECK(browser.numEntries == ENTRIES);
+    CHECK(!BrowserUpdate());
+
+    int h2, m2;
+    BrowserGetCacheStats(&h2, &m2, &msec, &cached);
+    CHECK(h2 == hits + 1);
+    CHECK(cached);
+}
+
+int main()
+{
+    test_first_page();
+    test_selection_follows();
+    test_cached();
+    return test_done("filebrowser");
+}
@@ -0,0 +1,424 @@
+/*
+ * source/iso9660.c on an image file: directory scans, file streams and
+ * lookups running at the same time on one mount, then a small benchmark
+ *
+ * The devoptab reads the big endian fields of the image natively and the
+ * volume descriptor through a struct of unsigned longs, the image is laid
+ * out the way this host reads them.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "iso9660.h"
+#include <ppc/timebase.h>
+
+#include "test.h"
+
+#define SECTOR 2048
+#define NDIRS 24
+#define NFILES 30
+#define NBIG 4
+#define BIG_SIZE (4 * 1024 * 1024)
+
+#define PVD_SECTOR 16
+#define PATH_TABLE_SECTOR 18
+#define ROOT_SECTOR 19
+#define DIR_SECTOR(d) (20 + (d))
+#define SMALL_SECTOR(d, f) (20 + NDIRS + (d) * NFILES + (f))
+#define BIG_SECTOR(b) (20 + NDIRS + NDIRS * NFILES + (b) * (BIG_SIZE / SECTOR))
+#define IMAGE_SECTORS BIG_SECTOR(NBIG)
+
+static int image_fd = -1;
+static volatile int reads_in_flight;
+static volatile int overlapped_reads;
+static volatile int sector_reads;
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, 4);
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    memcpy(p, &v, 2);
+}
+
+static int put_record(uint8_t *buf, uint32_t sector, uint32_t size, int dir, const char *name, int namelen)
+{
+    int len = 33 + namelen + !(namelen & 1);
+
+    buf[0] = len;
+    put32(buf + 6, sector);
+    put32(buf + 14, size);
+    buf[25] = dir ? 2 : 0;
+    buf[32] = namelen;
+    memcpy(buf + 33, name, namelen);
+    return len;
+}
+
+static uint32_t big_word(int b, uint32_t pos)
+{
+    return ((uint32_t) b << 24) ^ (pos / 4);
+}
+
+static void small_name(char *name, int d, int f)
+{
+    sprintf(name, "F%02d_%02d.TXT", d, f);
+}
+
+static int small_size(int d, int f)
+{
+    return 100 + d * 7 + f;
+}
+
+static char small_byte(int d, int f, int i)
+{
+    return 'a' + (d * 31 + f * 7 + i) % 26;
+}
+
+static void write_sector(int sector, const void *buf, int len)
+{
+    CHECK(pwrite(image_fd, buf, len, (off_t) sector * SECTOR) == len);
+}
+
+static void build_image(void)
+{
+    char path[] = "/tmp/test_iso9660_XXXXXX";
+    const int L = sizeof(unsigned long);
+    uint8_t buf[SECTOR];
+    uint8_t *big;
+    char name[32];
+    int d, f, b, off;
+
+    image_fd = mkstemp(path);
+    CHECK(image_fd >= 0);
+    unlink(path);
+    CHECK(!ftruncate(image_fd, (off_t) IMAGE_SECTORS * SECTOR));
+
+    // primary volume descriptor and terminator
+    memset(buf, 0, SECTOR);
+    buf[0] = 1;
+    memcpy(buf + 1, "CD001\1", 6);
+    memcpy(buf + 40, "TESTISO", 7);
+    put32(buf + 116 + 5 * L, 10 + 14 * NDIRS);
+    put32(buf + 116 + 8 * L, PATH_TABLE_SECTOR);
+    put32(buf + 116 + 10 * L + 6, ROOT_SECTOR);
+    write_sector(PVD_SECTOR, buf, SECTOR);
+    memset(buf, 0, SECTOR);
+    buf[0] = 0xff;
+    memcpy(buf + 1, "CD001\1", 6);
+    write_sector(PVD_SECTOR + 1, buf, SECTOR);
+
+    // path table, the root then its folders
+    memset(buf, 0, SECTOR);
+    buf[0] = 1;
+    put32(buf + 2, ROOT_SECTOR);
+    put16(buf + 6, 1);
+    off = 10;
+    for (d = 0; d < NDIRS; d++) {
+        buf[off] = 5;
+        put32(buf + off + 2, DIR_SECTOR(d));
+        put16(buf + off + 6, 1);
+        sprintf((char *) buf + off + 8, "DIR%02d", d);
+        off += 14;
+    }
+    write_sector(PATH_TABLE_SECTOR, buf, SECTOR);
+
+    memset(buf, 0, SECTOR);
+    off = put_record(buf, ROOT_SECTOR, SECTOR, 1, "\0", 1);
+    off += put_record(buf + off, ROOT_SECTOR, SECTOR, 1, "\1", 1);
+    for (d = 0; d < NDIRS; d++) {
+        sprintf(name, "DIR%02d", d);
+        off += put_record(buf + off, DIR_SECTOR(d), SECTOR, 1, name, 5);
+    }
+    for (b = 0; b < NBIG; b++) {
+        sprintf(name, "BIG%d.BIN;1", b);
+        off += put_record(buf + off, BIG_SECTOR(b), BIG_SIZE, 0, name, strlen(name));
+    }
+    CHECK(off < SECTOR);
+    write_sector(ROOT_SECTOR, buf, SECTOR);
+
+    for (d = 0; d < NDIRS; d++) {
+        memset(buf, 0, SECTOR);
+        off = put_record(buf, DIR_SECTOR(d), SECTOR, 1, "\0", 1);
+        off += put_record(buf + off, ROOT_SECTOR, SECTOR, 1, "\1", 1);
+        for (f = 0; f < NFILES; f++) {
+            small_name(name, d, f);
+            strcat(name, ";1");
+            off += put_record(buf + off, SMALL_SECTOR(d, f), small_size(d, f), 0, name, strlen(name));
+        }
+        CHECK(off < SECTOR);
+        write_sector(DIR_SECTOR(d), buf, SECTOR);
+
+        for (f = 0; f < NFILES; f++) {
+            int i;
+            memset(buf, 0, SECTOR);
+            for (i = 0; i < small_size(d, f); i++)
+                buf[i] = small_byte(d, f, i);
+            write_sector(SMALL_SECTOR(d, f), buf, SECTOR);
+        }
+    }
+
+    big = malloc(BIG_SIZE);
+    for (b = 0; b < NBIG; b++) {
+        uint32_t pos;
+        for (pos = 0; pos < BIG_SIZE; pos += 4)
+            put32(big + pos, big_word(b, pos));
+        write_sector(BIG_SECTOR(b), big, BIG_SIZE);
+    }
+    free(big);
+}
+
+// the drivers aren't reentrant, a second caller inside is a bug
+static bool disc_read(sec_t sector, sec_t count, void *buffer)
+{
+    ssize_t len = (ssize_t) count * SECTOR;
+    bool ok;
+
+    if (__sync_add_and_fetch(&reads_in_flight, 1) > 1)
+        __sync_add_and_fetch(&overlapped_reads, 1);
+    __sync_add_and_fetch(&sector_reads, 1);
+
+    memset(buffer, 0, len);
+    ok = sector < IMAGE_SECTORS && pread(image_fd, buffer, len, (off_t) sector * SECTOR) >= 0;
+
+    __sync_sub_and_fetch(&reads_in_flight, 1);
+    return ok;
+}
+
+static bool disc_true(void)
+{
+    return true;
+}
+
+static const DISC_INTERFACE image_disc = {
+    0, 0,
+    disc_true,
+    disc_true,
+    disc_read,
+    NULL,
+    disc_true,
+    disc_true
+};
+
+static const devoptab_t *dev;
+
+// open_r returns the file struct as an int, keep it in the low 2 GB
+static void *file_struct(void)
+{
+    void *p = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    CHECK(p != MAP_FAILED);
+    return p;
+}
+
+static int iso_open(void *fs, const char *path)
+{
+    struct _reent r;
+    return dev->open_r(&r, fs, path, O_RDONLY, 0);
+}
+
+static ssize_t iso_read(int fd, void *buf, size_t len)
+{
+    struct _reent r;
+    return dev->read_r(&r, fd, buf, len);
+}
+
+static int check_big(int b, uint32_t pos, const uint8_t *buf, int len)
+{
+    int i;
+    for (i = 0; i + 4 <= len; i += 4) {
+        uint32_t w;
+        memcpy(&w, buf + i, 4);
+        if (w != big_word(b, pos + i))
+            return 0;
+    }
+    return 1;
+}
+
+static int stream_errors, scan_errors;
+
+// a player: small reads, big aligned reads and seeks
+static void *stream_thread(void *arg)
+{
+    int b = (intptr_t) arg;
+    static __thread uint8_t buf[65536] __attribute__((aligned(32)));
+    void *fs = file_struct();
+    char path[32];
+    struct _reent r;
+    uint32_t pos = 0;
+    int fd, n, round;
+
+    sprintf(path, "iso:/BIG%d.BIN", b);
+    fd = iso_open(fs, path);
+    if (fd == -1) {
+        __sync_add_and_fetch(&stream_errors, 1);
+        return NULL;
+    }
+
+    for (round = 0; round < 3000; round++) {
+        int len = 1000 + round % 3000;
+        int skip;
+
+        if (round % 97 == 96)
+            pos = ((uint32_t) round * 2654435761u) % (BIG_SIZE - 65536);
+        // every fifth read is big and aligned
+        if (round % 5 == 4) {
+            len = 65536;
+            pos &= ~(SECTOR - 1);
+        }
+        dev->seek_r(&r, fd, pos, SEEK_SET);
+
+        n = iso_read(fd, buf, len);
+        if (n <= 0) {
+            pos = 0;
+            continue;
+        }
+        // from the first whole word
+        skip = (4 - pos % 4) % 4;
+        if (!check_big(b, pos + skip, buf + skip, n - skip))
+            __sync_add_and_fetch(&stream_errors, 1);
+        pos += n;
+    }
+    dev->close_r(&r, fd);
+    return NULL;
+}
+
+// the browser: list folders, stat and read their files
+static void *scan_thread(void *arg)
+{
+    int first = (intptr_t) arg;
+    DIR_ITER dir;
+    void *fs = file_struct();
+    char path[64], name[256], expect[32], data[512];
+    struct _reent r;
+    struct stat st;
+    int k, i, f, fd;
+
+    dir.dirStruct = malloc(dev->dirStateSize);
+    for (k = 0; k < NDIRS * 4; k++) {
+        int d = (first + k * 7) % NDIRS;
+
+        sprintf(path, "iso:/DIR%02d", d);
+        if (!dev->diropen_r(&r, &dir, path)) {
+            __sync_add_and_fetch(&scan_errors, 1);
+            continue;
+        }
+        f = 0;
+        while (!dev->dirnext_r(&r, &dir, name, &st)) {
+            if (!strcmp(name, ".."))
+                continue;
+            small_name(expect, d, f);
+            if (strcmp(name, expect) || st.st_size != small_size(d, f))
+                __sync_add_and_fetch(&scan_errors, 1);
+            f++;
+        }
+        dev->dirclose_r(&r, &dir);
+        if (f != NFILES)
+            __sync_add_and_fetch(&scan_errors, 1);
+
+        // lookups, in another case
+        f = k % NFILES;
+        sprintf(path, "iso:/dir%02d/f%02d_%02d.txt", d, d, f);
+        if (dev->stat_r(&r, path, &st) || st.st_size != small_size(d, f)) {
+            __sync_add_and_fetch(&scan_errors, 1);
+            continue;
+        }
+        fd = iso_open(fs, path);
+        if (fd == -1 || iso_read(fd, data, sizeof(data)) != small_size(d, f)) {
+            __sync_add_and_fetch(&scan_errors, 1);
+            continue;
+        }
+        for (i = 0; i < small_size(d, f); i++) {
+            if (data[i] != small_byte(d, f, i)) {
+                __sync_add_and_fetch(&scan_errors, 1);
+                break;
+            }
+        }
+        dev->close_r(&r, fd);
+    }
+    free(dir.dirStruct);
+    return NULL;
+}
+
+static void test_concurrent(void)
+{
+    pthread_t th[NBIG + 2];
+    int i;
+
+    for (i = 0; i < NBIG; i++)
+        pthread_create(&th[i], NULL, stream_thread, (void *) (intptr_t) i);
+    for (i = 0; i < 2; i++)
+        pthread_create(&th[NBIG + i], NULL, scan_thread, (void *) (intptr_t) (i * 5));
+    for (i = 0; i < NBIG + 2; i++)
+        pthread_join(th[i], NULL);
+
+    CHECK(stream_errors == 0);
+    CHECK(scan_errors == 0);
+    CHECK(overlapped_reads == 0);
+}
+
+static void bench(void)
+{
+    static uint8_t buf[65536] __attribute__((aligned(32)));
+    void *fs = file_struct();
+    struct _reent r;
+    struct stat st;
+    char path[64];
+    u64 start, t;
+    int fd, n, reads, i;
+
+    fd = iso_open(fs, "iso:/BIG0.BIN");
+    CHECK(fd != -1);
+
+    // small sequential reads, served from the read-ahead window
+    start = mftb();
+    reads = sector_reads;
+    for (n = 0; iso_read(fd, buf, 4096) == 4096; n++)
+        ;
+    t = mftb() - start;
+    printf("4 KB reads: %d in %.1f ms, %.0f MB/s, %d disc reads\n", n, t / 50000.0,
+           (double) n * 4096 / (t / 50.0), sector_reads - reads);
+
+    // big aligned reads, straight to the buffer
+    dev->seek_r(&r, fd, 0, SEEK_SET);
+    start = mftb();
+    reads = sector_reads;
+    for (n = 0; iso_read(fd, buf, sizeof(buf)) == sizeof(buf); n++)
+        ;
+    t = mftb() - start;
+    printf("64 KB reads: %d in %.1f ms, %.0f MB/s, %d disc reads\n", n, t / 50000.0,
+           (double) n * sizeof(buf) / (t / 50.0), sector_reads - reads);
+    dev->close_r(&r, fd);
+
+    // lookups in listings already read
+    start = mftb();
+    for (i = 0; i < 100000; i++) {
+        int d = i % NDIRS, f = (i / NDIRS) % NFILES;
+        sprintf(path, "iso:/DIR%02d/F%02d_%02d.TXT", d, d, f);
+        CHECK(!dev->stat_r(&r, path, &st));
+    }
+    t = mftb() - start;
+    printf("stat: %d in %.1f ms, %.2f us each\n", i, t / 50000.0, t / 50.0 / i);
+}
+
+int main(void)
+{
+    build_image();
+    CHECK(ISO9660_Mount("iso", &image_disc));
+    dev = GetDeviceOpTab("iso:");
+    CHECK(dev != NULL);
+    CHECK(!strcmp(ISO9660_GetVolumeLabel("iso"), "TESTISO"));
+
+    test_concurrent();
+    bench();
+
+    CHECK(ISO9660_Unmount("iso"));
+    close(image_fd);
+    return test_done("iso9660");
+}
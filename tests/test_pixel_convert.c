@@ -0,0 +1,97 @@
+/*
+ * Pixel kernels of source/pixel_convert.c against byte by byte references,
+ * at every alignment the vector path can start from
+ */
+
+#include <string.h>
+
+#include "pixel_convert.h"
+
+#include "test.h"
+
+#define MAX_PIXELS 67
+
+static uint32_t words[MAX_PIXELS + 8] __attribute__((aligned(16)));
+
+static void ref_swizzle(uint8_t * p, int pixels)
+{
+    int i;
+
+    for (i = 0; i < pixels; i++, p += 4) {
+        uint8_t r = p[0], g = p[1], b = p[2], a = p[3];
+        p[0] = a;
+        p[1] = r;
+        p[2] = g;
+        p[3] = b;
+    }
+}
+
+static void test_swizzle(void)
+{
+    uint8_t expect[sizeof(words)];
+    int shift, pixels, i;
+
+    for (shift = 0; shift < 4; shift++) {
+        for (pixels = 0; pixels <= MAX_PIXELS; pixels++) {
+            uint8_t *p = (uint8_t *) (words + shift);
+
+            for (i = 0; i < (int) sizeof(words); i++)
+                ((uint8_t *) words)[i] = i * 7 + pixels;
+            memcpy(expect, words, sizeof(words));
+
+            ref_swizzle(expect + shift * 4, pixels);
+            PixelSwizzleRGBAToARGB(p, pixels);
+            // converted in place, neighbours untouched
+            if (memcmp(expect, words, sizeof(words))) {
+                CHECK(!"swizzle matches the reference");
+                return;
+            }
+        }
+    }
+}
+
+static void test_padding(void)
+{
+    static const int sizes[][4] = {
+        // width, height, wpitch in pixels, hpitch
+        { 1, 1, 32, 32 },
+        { 5, 3, 32, 8 },
+        { 32, 32, 32, 32 },
+        { 20, 7, 32, 32 },
+        { 33, 10, 64, 16 },
+    };
+    int n, x, y, c;
+
+    for (n = 0; n < (int) (sizeof(sizes) / sizeof(sizes[0])); n++) {
+        int width = sizes[n][0], height = sizes[n][1];
+        int wpitch = sizes[n][2] * 4, hpitch = sizes[n][3];
+        uint8_t buf[64 * 4 * 32];
+        int failed = 0;
+
+        memset(buf, 0, sizeof(buf));
+        for (y = 0; y < height; y++)
+            for (x = 0; x < width * 4; x++)
+                buf[y * wpitch + x] = y * 31 + x + 1;
+
+        PixelFillPadding(buf, width, height, wpitch, hpitch);
+
+        // the image tiles the whole surface
+        for (y = 0; y < hpitch; y++)
+            for (x = 0; x < wpitch / 4; x++)
+                for (c = 0; c < 4; c++)
+                    failed |= buf[y * wpitch + x * 4 + c] !=
+                        (uint8_t) ((y % height) * 31 + (x % width) * 4 + c + 1);
+        CHECK(!failed);
+        // nothing written past the surface
+        for (x = wpitch * hpitch; x < (int) sizeof(buf); x++)
+            failed |= buf[x] != 0;
+        CHECK(!failed);
+    }
+}
+
+int main(void)
+{
+    test_swizzle();
+    test_padding();
+    return test_done("pixel_convert");
+}
@@ -0,0 +1,199 @@
+/*
+ * Batching of source/sprite_batch.c against a device recording the draws
+ */
+
+#include <string.h>
+
+#include "sprite_batch.h"
+
+#include "test.h"
+
+#define VB_SIZE (256 * 1024)
+#define MAX_DRAWS 64
+
+typedef struct {
+    void *texture;
+    int shader;
+    int offset;
+    int count;
+} fake_draw_t;
+
+typedef struct {
+    unsigned char vb[VB_SIZE];
+    int locked;
+    int lock_offset, lock_size;
+    fake_draw_t draws[MAX_DRAWS];
+    int num_draws;
+} fake_device_t;
+
+static void *fake_lock(void *ctx, int offset, int size)
+{
+    fake_device_t *d = ctx;
+    CHECK(!d->locked);
+    CHECK(offset >= 0 && offset + size <= VB_SIZE);
+    d->locked = 1;
+    d->lock_offset = offset;
+    d->lock_size = size;
+    return d->vb + offset;
+}
+
+static void fake_unlock(void *ctx)
+{
+    fake_device_t *d = ctx;
+    CHECK(d->locked);
+    d->locked = 0;
+}
+
+static void fake_draw(void *ctx, void *texture, int shader, int offset, int count)
+{
+    fake_device_t *d = ctx;
+    CHECK(!d->locked);
+    // drawn from what was just uploaded
+    CHECK(offset == d->lock_offset);
+    CHECK(count * SPRITE_VERTICES * (int) sizeof(DrawVerticeFormats) == d->lock_size);
+    if (d->num_draws < MAX_DRAWS) {
+        fake_draw_t *r = &d->draws[d->num_draws];
+        r->texture = texture;
+        r->shader = shader;
+        r->offset = offset;
+        r->count = count;
+    }
+    d->num_draws++;
+}
+
+static const SpriteBatchOps fake_ops = {
+    fake_lock,
+    fake_unlock,
+    fake_draw
+};
+
+static fake_device_t dev;
+static SpriteBatch batch;
+static int tex_a, tex_b;
+
+static void start(int base, int size)
+{
+    memset(&dev, 0, sizeof(dev));
+    SpriteBatch_Init(&batch, &fake_ops, &dev, base, size);
+    SpriteBatch_Begin(&batch);
+}
+
+// a quad tagged with its submission index
+static void add(void *texture, int shader, int tag)
+{
+    DrawVerticeFormats v[SPRITE_VERTICES];
+    int i;
+
+    memset(v, 0, sizeof(v));
+    for (i = 0; i < SPRITE_VERTICES; i++)
+        v[i].color = tag;
+    SpriteBatch_Add(&batch, texture, shader, v);
+}
+
+static unsigned int tag_at(int offset, int quad)
+{
+    const DrawVerticeFormats *v = (const DrawVerticeFormats *) (dev.vb + offset);
+    return v[quad * SPRITE_VERTICES].color;
+}
+
+static void test_runs(void)
+{
+    int i, tag = 0;
+
+    start(0, VB_SIZE);
+    for (i = 0; i < 20; i++)
+        add(&tex_a, 0, tag++);
+    add(NULL, 1, tag++);
+    add(NULL, 1, tag++);
+    for (i = 0; i < 5; i++)
+        add(&tex_b, 0, tag++);
+    add(&tex_a, 0, tag++);
+    // same texture, other shader
+    add(&tex_a, 1, tag++);
+    CHECK(dev.num_draws == 4);
+    SpriteBatch_Flush(&batch);
+
+    CHECK(dev.num_draws == 5);
+    CHECK(dev.draws[0].texture == &tex_a && dev.draws[0].count == 20);
+    CHECK(dev.draws[1].texture == NULL && dev.draws[1].shader == 1 && dev.draws[1].count == 2);
+    CHECK(dev.draws[2].texture == &tex_b && dev.draws[2].count == 5);
+    CHECK(dev.draws[3].texture == &tex_a && dev.draws[3].shader == 0 && dev.draws[3].count == 1);
+    CHECK(dev.draws[4].texture == &tex_a && dev.draws[4].shader == 1 && dev.draws[4].count == 1);
+
+    // submission order kept, runs don't overlap and start aligned
+    tag = 0;
+    for (i = 0; i < dev.num_draws; i++) {
+        int q;
+        CHECK(dev.draws[i].offset % 512 == 0);
+        if (i)
+            CHECK(dev.draws[i].offset >= dev.draws[i - 1].offset +
+                  dev.draws[i - 1].count * SPRITE_VERTICES * (int) sizeof(DrawVerticeFormats));
+        for (q = 0; q < dev.draws[i].count; q++)
+            CHECK(tag_at(dev.draws[i].offset, q) == tag++);
+    }
+
+    // flushing twice draws nothing more
+    SpriteBatch_Flush(&batch);
+    CHECK(dev.num_draws == 5);
+}
+
+static void test_stats(void)
+{
+    int i;
+
+    start(1024, VB_SIZE);
+    for (i = 0; i < 10; i++)
+        add(i & 1 ? &tex_a : &tex_b, 0, i);
+    SpriteBatch_Flush(&batch);
+    CHECK(dev.draws[0].offset == 1024);
+
+    SpriteBatch_Begin(&batch);
+    CHECK(batch.last_draw_calls == 10);
+    CHECK(batch.last_sprites == 10);
+    CHECK(batch.last_dropped == 0);
+    CHECK(batch.draw_calls == 0 && batch.sprites == 0);
+
+    // a new frame starts over at the base
+    add(&tex_a, 0, 0);
+    SpriteBatch_Flush(&batch);
+    CHECK(dev.draws[10].offset == 1024);
+}
+
+static void test_limits(void)
+{
+    int quad = SPRITE_VERTICES * sizeof(DrawVerticeFormats);
+    int i;
+
+    // a run is split at SPRITE_BATCH_MAX
+    start(0, VB_SIZE);
+    for (i = 0; i < SPRITE_BATCH_MAX + 3; i++)
+        add(&tex_a, 0, i);
+    SpriteBatch_Flush(&batch);
+    CHECK(dev.num_draws == 2);
+    CHECK(dev.draws[0].count == SPRITE_BATCH_MAX);
+    CHECK(dev.draws[1].count == 3);
+    CHECK(tag_at(dev.draws[1].offset, 0) == SPRITE_BATCH_MAX);
+
+    // out of vertex buffer, the runs that don't fit are dropped and counted
+    start(0, 4 * 512);
+    for (i = 0; i < 8; i++)
+        add(&tex_a, 0, i);
+    add(&tex_b, 0, 8);
+    for (i = 0; i < 100; i++)
+        add(&tex_a, 0, 9 + i);
+    SpriteBatch_Flush(&batch);
+    CHECK(8 * quad <= 4 * 512);
+    CHECK(dev.num_draws == 2);
+    CHECK(batch.dropped == 100);
+    SpriteBatch_Begin(&batch);
+    CHECK(batch.last_dropped == 100);
+    CHECK(batch.last_sprites == 109);
+}
+
+int main(void)
+{
+    test_runs();
+    test_stats();
+    test_limits();
+    return test_done("sprite_batch");
+}
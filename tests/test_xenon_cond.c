@@ -0,0 +1,211 @@
+/*
+ * Mutexes and condition variables of libxenon_miss/xenon_pthread.c under
+ * contention, hardware threads being host threads
+ */
+
+#include <string.h>
+
+#include "xenon_pthread_host.h"
+
+#include "test.h"
+
+#define ITEMS 200000
+#define SLOTS 16
+#define PRODUCERS 2
+#define CONSUMERS 2
+
+// four threads fit in the pool with two decoders and two services
+static int spawn(xp_t *th, int i, void *(*fn)(void *), void *arg)
+{
+    xp_attr_t attr;
+
+    xp_attr_init(&attr);
+    xp_attr_setrole_np(&attr, i < 2 ? XENON_THREAD_DECODE : XENON_THREAD_SERVICE);
+    return xp_create(th, &attr, fn, arg);
+}
+
+static xp_mutex_t lock_;
+static xp_cond_t not_empty, not_full;
+static int ring[SLOTS];
+static int head, count, produced, consumed;
+static long long sum;
+
+static void *producer(void *arg)
+{
+    for (;;) {
+        xp_mutex_lock(&lock_);
+        while (count == SLOTS && produced < ITEMS)
+            xp_cond_wait(&not_full, &lock_);
+        if (produced == ITEMS) {
+            xp_mutex_unlock(&lock_);
+            return NULL;
+        }
+        ring[(head + count) % SLOTS] = ++produced;
+        count++;
+        xp_cond_signal(&not_empty);
+        xp_mutex_unlock(&lock_);
+    }
+}
+
+static void *consumer(void *arg)
+{
+    long long local = 0;
+
+    for (;;) {
+        xp_mutex_lock(&lock_);
+        while (!count && consumed < ITEMS)
+            xp_cond_wait(&not_empty, &lock_);
+        if (consumed == ITEMS) {
+            xp_mutex_unlock(&lock_);
+            break;
+        }
+        local += ring[head];
+        head = (head + 1) % SLOTS;
+        count--;
+        // the last one wakes everybody up to see the end
+        if (++consumed == ITEMS)
+            xp_cond_broadcast(&not_empty);
+        xp_cond_signal(&not_full);
+        xp_mutex_unlock(&lock_);
+    }
+    xp_mutex_lock(&lock_);
+    sum += local;
+    xp_mutex_unlock(&lock_);
+    return NULL;
+}
+
+static void test_producer_consumer(void)
+{
+    xp_t th[PRODUCERS + CONSUMERS];
+    int i;
+
+    xp_mutex_init(&lock_, NULL);
+    xp_cond_init(&not_empty, NULL);
+    xp_cond_init(&not_full, NULL);
+
+    for (i = 0; i < PRODUCERS + CONSUMERS; i++)
+        CHECK(!spawn(&th[i], i, i < PRODUCERS ? producer : consumer, NULL));
+    for (i = 0; i < PRODUCERS + CONSUMERS; i++)
+        CHECK(!xp_join(th[i], NULL));
+
+    CHECK(produced == ITEMS);
+    CHECK(consumed == ITEMS);
+    CHECK(count == 0);
+    CHECK(sum == (long long) ITEMS * (ITEMS + 1) / 2);
+}
+
+#define INCREMENTS 500000
+
+static xp_mutex_t counter_lock;
+static volatile int counter;
+
+static void *incrementer(void *arg)
+{
+    int i;
+    for (i = 0; i < INCREMENTS; i++) {
+        xp_mutex_lock(&counter_lock);
+        counter = counter + 1;
+        xp_mutex_unlock(&counter_lock);
+    }
+    return arg;
+}
+
+static void test_mutex(void)
+{
+    xp_t th[4];
+    void *ret;
+    int i;
+
+    xp_mutex_init(&counter_lock, NULL);
+    for (i = 0; i < 4; i++)
+        CHECK(!spawn(&th[i], i, incrementer, &th[i]));
+    for (i = 0; i < 4; i++) {
+        CHECK(!xp_join(th[i], &ret));
+        CHECK(ret == &th[i]);
+    }
+    CHECK(counter == 4 * INCREMENTS);
+}
+
+static xp_mutex_t gate_lock;
+static xp_cond_t gate;
+static int gate_open, waiting, passed;
+
+static void *gate_waiter(void *arg)
+{
+    xp_mutex_lock(&gate_lock);
+    waiting++;
+    while (!gate_open)
+        xp_cond_wait(&gate, &gate_lock);
+    passed++;
+    xp_mutex_unlock(&gate_lock);
+    return NULL;
+}
+
+static void test_broadcast(void)
+{
+    xp_t th[4];
+    int i, n;
+
+    xp_mutex_init(&gate_lock, NULL);
+    xp_cond_init(&gate, NULL);
+    for (i = 0; i < 4; i++)
+        CHECK(!spawn(&th[i], i, gate_waiter, NULL));
+
+    do {
+        xp_mutex_lock(&gate_lock);
+        n = waiting;
+        xp_mutex_unlock(&gate_lock);
+    } while (n < 4);
+
+    xp_mutex_lock(&gate_lock);
+    CHECK(passed == 0);
+    gate_open = 1;
+    xp_cond_broadcast(&gate);
+    xp_mutex_unlock(&gate_lock);
+
+    for (i = 0; i < 4; i++)
+        CHECK(!xp_join(th[i], NULL));
+    CHECK(passed == 4);
+}
+
+static void test_timedwait(void)
+{
+    xp_mutex_t m;
+    xp_cond_t c;
+    struct timeval before, after;
+    struct timespec ts;
+    long ms;
+
+    xp_mutex_init(&m, NULL);
+    xp_cond_init(&c, NULL);
+
+    gettimeofday(&before, NULL);
+    ts.tv_sec = before.tv_sec;
+    ts.tv_nsec = before.tv_usec * 1000 + 50000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    xp_mutex_lock(&m);
+    CHECK(xp_cond_timedwait(&c, &m, &ts) == ETIMEDOUT);
+    xp_mutex_unlock(&m);
+
+    gettimeofday(&after, NULL);
+    ms = (after.tv_sec - before.tv_sec) * 1000 + (after.tv_usec - before.tv_usec) / 1000;
+    CHECK(ms >= 49);
+    CHECK(ms < 1000);
+
+    // the mutex is held again after the timeout
+    CHECK(xp_mutex_unlock(&m) == 0);
+}
+
+int main(void)
+{
+    xp_init();
+    test_producer_consumer();
+    test_mutex();
+    test_broadcast();
+    test_timedwait();
+    return test_done("xenon_pthread cond");
+}
@@ -0,0 +1,199 @@
+/*
+ * Worker pool of libxenon_miss/xenon_pthread.c: a created thread always has a
+ * hardware thread of its own, the pool refuses instead of queueing
+ */
+
+#include <unistd.h>
+
+#include "xenon_pthread_host.h"
+#include <xenon_soc/xenon_power.h>
+
+#include "test.h"
+
+static xp_mutex_t lock_;
+static xp_cond_t cond;
+static int started, released;
+
+// like an ffmpeg worker, only returns once told so
+static void *long_lived(void *arg)
+{
+    xp_mutex_lock(&lock_);
+    started++;
+    xp_cond_broadcast(&cond);
+    while (!released)
+        xp_cond_wait(&cond, &lock_);
+    xp_mutex_unlock(&lock_);
+    return arg;
+}
+
+static void wait_started(int n)
+{
+    xp_mutex_lock(&lock_);
+    while (started < n)
+        xp_cond_wait(&cond, &lock_);
+    xp_mutex_unlock(&lock_);
+}
+
+static void release_all(void)
+{
+    xp_mutex_lock(&lock_);
+    released = 1;
+    xp_cond_broadcast(&cond);
+    xp_mutex_unlock(&lock_);
+}
+
+static void reset(void)
+{
+    started = released = 0;
+}
+
+static xp_attr_t role_attr(int role)
+{
+    xp_attr_t attr;
+    xp_attr_init(&attr);
+    xp_attr_setrole_np(&attr, role);
+    return attr;
+}
+
+// a service thread then as many decoders as wanted: the ones past the decode
+// slots are refused
+static void test_contention(void)
+{
+    xp_attr_t service = role_attr(XENON_THREAD_SERVICE);
+    xp_attr_t decode = role_attr(XENON_THREAD_DECODE);
+    xp_t svc, th[8];
+    int i, n = 0;
+
+    reset();
+    CHECK(xenon_thread_available(XENON_THREAD_DECODE) == 3);
+    CHECK(xenon_thread_available(XENON_THREAD_SERVICE) == 3);
+
+    CHECK(!xp_create(&svc, &service, long_lived, NULL));
+    CHECK(xenon_thread_available(XENON_THREAD_DECODE) == 3);
+
+    for (i = 0; i < 8; i++) {
+        int ret = xp_create(&th[n], &decode, long_lived, NULL);
+        if (ret) {
+            CHECK(ret == EAGAIN);
+            continue;
+        }
+        n++;
+    }
+    CHECK(n == 3);
+    CHECK(xenon_thread_available(XENON_THREAD_DECODE) == 0);
+    CHECK(xenon_thread_available(XENON_THREAD_SERVICE) == 1);
+
+    // everything created is running, nothing waits for a free worker
+    wait_started(n + 1);
+
+    release_all();
+    for (i = 0; i < n; i++)
+        CHECK(!xp_join(th[i], NULL));
+    CHECK(!xp_join(svc, NULL));
+    CHECK(xenon_thread_available(XENON_THREAD_DECODE) == 3);
+}
+
+// vd_ffmpeg sizes the decoder on what is free first, the cache, the audio
+// feeder and the frame queue still get a worker each afterwards
+static void sized_decoder(int policy)
+{
+    xp_attr_t service = role_attr(XENON_THREAD_SERVICE);
+    xp_attr_t decode = role_attr(XENON_THREAD_DECODE);
+    xp_t svc[2], th[4];
+    int i, count;
+
+    xenon_thread_policy = policy;
+    reset();
+    CHECK(!xp_create(&svc[0], &service, long_lived, NULL));
+
+    count = xenon_thread_available(XENON_THREAD_DECODE);
+    CHECK(count == 3);
+    for (i = 0; i < count; i++)
+        CHECK(!xp_create(&th[i], &decode, long_lived, NULL));
+    CHECK(xp_create(&th[count], &decode, long_lived, NULL) == EAGAIN);
+
+    CHECK(!xp_create(&svc[1], &service, long_lived, NULL));
+    wait_started(count + 2);
+    CHECK(xenon_thread_available(XENON_THREAD_SERVICE) == 0);
+
+    release_all();
+    for (i = 0; i < count; i++)
+        CHECK(!xp_join(th[i], NULL));
+    for (i = 0; i < 2; i++)
+        CHECK(!xp_join(svc[i], NULL));
+    xenon_thread_policy = XENON_POLICY_SPREAD;
+}
+
+static void test_sized_decoder(void)
+{
+    int policy;
+
+    for (policy = 0; policy < XENON_POLICY_NB; policy++)
+        sized_decoder(policy);
+}
+
+static void *short_lived(void *arg)
+{
+    return arg;
+}
+
+// workers and task slots are given back by join
+static void test_cycles(void)
+{
+    xp_attr_t decode = role_attr(XENON_THREAD_DECODE);
+    xp_t th[3];
+    int cycle, i, failed = 0;
+    void *ret;
+
+    for (cycle = 0; cycle < 2000; cycle++) {
+        for (i = 0; i < 3; i++)
+            failed += xp_create(&th[i], &decode, short_lived, &th[i]) != 0;
+        for (i = 0; i < 3; i++) {
+            CHECK(!xp_join(th[i], &ret));
+            CHECK(ret == &th[i]);
+        }
+        if (failed)
+            break;
+    }
+    CHECK(!failed);
+    CHECK(xenon_thread_available(XENON_THREAD_DECODE) == 3);
+}
+
+// idle workers leave their hardware thread and come back for the next task
+static void test_parking(void)
+{
+    xp_attr_t decode = role_attr(XENON_THREAD_DECODE);
+    xp_t th[3];
+    void *ret;
+    int i, hw, running = 0;
+
+    for (i = 0; i < 3; i++)
+        CHECK(!xp_create(&th[i], &decode, short_lived, &th[i]));
+    for (i = 0; i < 3; i++)
+        CHECK(!xp_join(th[i], NULL));
+
+    usleep(200 * 1000);
+    for (hw = 1; hw < 6; hw++)
+        running += xenon_is_thread_task_running(hw);
+    CHECK(running == 0);
+
+    for (i = 0; i < 3; i++)
+        CHECK(!xp_create(&th[i], &decode, short_lived, &th[i]));
+    for (i = 0; i < 3; i++) {
+        CHECK(!xp_join(th[i], &ret));
+        CHECK(ret == &th[i]);
+    }
+}
+
+int main(void)
+{
+    xp_init();
+    xp_mutex_init(&lock_, NULL);
+    xp_cond_init(&cond, NULL);
+
+    test_contention();
+    test_sized_decoder();
+    test_cycles();
+    test_parking();
+    return test_done("xenon_pthread pool");
+}
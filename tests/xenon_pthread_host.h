@@ -0,0 +1,64 @@
+/*
+ * libxenon_miss/xenon_pthread.c built on the host next to the real pthread:
+ * its functions and types get an xp_ prefix. Force-included when building
+ * it, included by the tests.
+ */
+
+#ifndef XENON_PTHREAD_HOST_H
+#define XENON_PTHREAD_HOST_H
+
+// the system headers first, with the real names
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define pthread_t                   xp_t
+#define pthread_mutex_t             xp_mutex_t
+#define pthread_cond_t              xp_cond_t
+#define pthread_attr_t              xp_attr_t
+#define pthread_init                xp_init
+#define pthread_mutex_init          xp_mutex_init
+#define pthread_mutex_destroy       xp_mutex_destroy
+#define pthread_mutex_lock          xp_mutex_lock
+#define pthread_mutex_unlock        xp_mutex_unlock
+#define pthread_cond_init           xp_cond_init
+#define pthread_cond_destroy        xp_cond_destroy
+#define pthread_cond_wait           xp_cond_wait
+#define pthread_cond_timedwait      xp_cond_timedwait
+#define pthread_cond_signal         xp_cond_signal
+#define pthread_cond_broadcast      xp_cond_broadcast
+#define pthread_attr_init           xp_attr_init
+#define pthread_attr_destroy        xp_attr_destroy
+#define pthread_attr_setstacksize   xp_attr_setstacksize
+#define pthread_attr_setrole_np     xp_attr_setrole_np
+#define pthread_create              xp_create
+#define pthread_join                xp_join
+
+#ifndef XENON_PTHREAD_BUILD
+#include "libxenon_miss/xenon_pthread.h"
+
+typedef unsigned int __attribute__ ((aligned (128))) xp_mutex_t;
+typedef unsigned int __attribute__ ((aligned (128))) xp_cond_t;
+typedef unsigned int xp_t;
+typedef xenon_pthread_attr_t xp_attr_t;
+
+void xp_init(void);
+int xp_mutex_init(xp_mutex_t *mutex, void *u);
+int xp_mutex_lock(xp_mutex_t *mutex);
+int xp_mutex_unlock(xp_mutex_t *mutex);
+int xp_cond_init(xp_cond_t *cond, void *u);
+int xp_cond_wait(xp_cond_t *cond, xp_mutex_t *mutex);
+int xp_cond_timedwait(xp_cond_t *cond, xp_mutex_t *mutex, const struct timespec *abstime);
+int xp_cond_signal(xp_cond_t *cond);
+int xp_cond_broadcast(xp_cond_t *cond);
+int xp_attr_init(xp_attr_t *attr);
+int xp_attr_setrole_np(xp_attr_t *attr, int role);
+int xp_attr_setstacksize(xp_attr_t *attr, size_t stacksize);
+int xp_create(xp_t *thread, const xp_attr_t *attr, void *(*start_routine)(void *), void *arg);
+int xp_join(xp_t thread, void **value_ptr);
+#endif
+
+#endif